@@ -0,0 +1,381 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Complete program (this compiles):
+// Pivot Phase Function - Standalone Benchmark
+//
+// g++ -O3 benchmark.cpp -o benchmark
+//
+// Measures the cost of the pivot phase function of pivot.cpp against the
+// Henyey-Greenstein (HG) phase function without a Mitsuba install. The
+// pivot phase function runs the exact math of the plugin (see
+// pivot_phase.h). For each phase function, the program reports
+//   - the throughput of sampling and of density evaluations
+//   - the mean cosine of the sampled directions
+//   - the multiple scattering albedo of a homogeneous slab and sphere,
+//     estimated with an analog random walk
+// The slab has a unit optical thickness (by default), and is lit by a
+// collimated beam at normal incidence; its albedo is the energy it
+// reflects. The sphere has a unit optical radius (by default), and is lit
+// by a collimated beam; its albedo is the energy that escapes it.
+// Run with --help for the list of options.
+//
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+#include "pivot_phase.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Application Manager
+struct AppManager {
+	struct {
+		float g;         // asymmetry parameter
+		float albedo;    // single scattering albedo
+		float thickness; // optical thickness of the slab
+		float radius;    // optical radius of the sphere
+	} medium;
+	struct {
+		int sampleCount; // phase function samples of the throughput tests
+		int pathCount;   // random walks per geometry
+	} run;
+} g_app = {
+	/*medium*/ {0.8f, 0.99f, 1.f, 1.f},
+	/*run*/    {1 << 24, 1 << 20}
+};
+
+// keeps the results of the throughput tests alive
+volatile double g_sink;
+
+#define BENCH_PI 3.14159265358979323846
+
+////////////////////////////////////////////////////////////////////////////////
+// Utility functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// minimal vector type, compatible with pivot_phase.h
+struct vec3 {
+	vec3() {}
+	vec3(double x, double y, double z): x(x), y(y), z(z) {}
+	double x, y, z;
+};
+vec3 operator+(const vec3& a, const vec3& b) {return vec3(a.x + b.x, a.y + b.y, a.z + b.z);}
+vec3 operator-(const vec3& a, const vec3& b) {return vec3(a.x - b.x, a.y - b.y, a.z - b.z);}
+vec3 operator-(const vec3& a) {return vec3(-a.x, -a.y, -a.z);}
+vec3 operator*(double s, const vec3& a) {return vec3(s * a.x, s * a.y, s * a.z);}
+vec3 operator/(const vec3& a, double s) {return (1.0 / s) * a;}
+double dot(const vec3& a, const vec3& b) {return a.x * b.x + a.y * b.y + a.z * b.z;}
+vec3 cross(const vec3& a, const vec3& b)
+{
+	return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// -----------------------------------------------------------------------------
+// expresses a direction of the frame of n in world space (Duff et al. 2017)
+vec3 toWorld(const vec3& n, const vec3& v)
+{
+	double sign = std::copysign(1.0, n.z);
+	double a = -1.0 / (sign + n.z);
+	double b = n.x * n.y * a;
+	vec3 s = vec3(1.0 + sign * n.x * n.x * a, sign * b, -sign * n.x);
+	vec3 t = vec3(b, sign + n.y * n.y * a, -n.y);
+
+	return v.x * s + v.y * t + v.z * n;
+}
+
+// -----------------------------------------------------------------------------
+// PCG32 random generator
+struct Random {
+	Random(uint64_t seed): m_state(seed * 6364136223846793005ull + 1442695040888963407ull) {}
+	uint32_t next()
+	{
+		uint64_t s = m_state;
+		m_state = s * 6364136223846793005ull + 1442695040888963407ull;
+		uint32_t x = (uint32_t)(((s >> 18u) ^ s) >> 27u);
+		uint32_t r = (uint32_t)(s >> 59u);
+
+		return (x >> r) | (x << ((32u - r) & 31u));
+	}
+	double nextf() {return (double)next() * (1.0 / 4294967296.0);}
+	uint64_t m_state;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Phase Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// pivot phase function, as in pivot.cpp
+struct PivotPhase {
+	static const char *name() {return "pivot";}
+	static vec3 sample(double u1, double u2, double g, double *pdf)
+	{
+		double qf;
+		vec3 wo = pivot_phase::sample<vec3>(u1, u2, g, &qf);
+
+		*pdf = pivot_phase::pdf(qf, g);
+		return wo;
+	}
+	static double eval(double cosTheta, double g)
+	{
+		return pivot_phase::eval(cosTheta, g);
+	}
+};
+
+// -----------------------------------------------------------------------------
+// Henyey-Greenstein phase function, as in Mitsuba's hg plugin
+struct HGPhase {
+	static const char *name() {return "hg";}
+	static vec3 sample(double u1, double u2, double g, double *pdf)
+	{
+		double cosTheta;
+
+		if (std::fabs(g) < 1e-3) {
+			cosTheta = 1.0 - 2.0 * u1;
+		} else {
+			double sqrTerm = (1.0 - g * g) / (1.0 - g + 2.0 * g * u1);
+			cosTheta = (1.0 + g * g - sqrTerm * sqrTerm) / (2.0 * g);
+		}
+		double sinTheta = std::sqrt(std::fmax(0.0, 1.0 - cosTheta * cosTheta));
+		double phi = 2.0 * BENCH_PI * u2;
+
+		*pdf = eval(-cosTheta, g);
+		return vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+	}
+	static double eval(double cosTheta, double g)
+	{
+		double temp = 1.0 + g * g + 2.0 * g * cosTheta;
+
+		return (1.0 / (4.0 * BENCH_PI)) * (1.0 - g * g) / (temp * std::sqrt(temp));
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// seconds elapsed since t0
+double elapsed(const std::chrono::high_resolution_clock::time_point& t0)
+{
+	std::chrono::duration<double> dt = std::chrono::high_resolution_clock::now() - t0;
+
+	return dt.count();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Throughput Tests
+ *
+ * Draws sampleCount directions and evaluates sampleCount densities; the
+ * results are accumulated so that the compiler keeps the computations.
+ */
+template <typename Phase>
+void benchThroughput(double g, int sampleCount)
+{
+	Random rng(1);
+	double meanCos = 0.0, sum = 0.0;
+	std::chrono::high_resolution_clock::time_point t0 =
+		std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < sampleCount; ++i) {
+		double pdf;
+		vec3 wo = Phase::sample(rng.nextf(), rng.nextf(), g, &pdf);
+
+		meanCos+= wo.z;
+		sum+= pdf;
+	}
+	double sampleTime = elapsed(t0);
+
+	t0 = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < sampleCount; ++i)
+		sum+= Phase::eval(2.0 * rng.nextf() - 1.0, g);
+	double evalTime = elapsed(t0);
+
+	g_sink = sum;
+
+	LOG("%-6s sample: %8.2f M/s   eval: %8.2f M/s   mean cosine: %.4f\n",
+	    Phase::name(),
+	    sampleCount / sampleTime * 1e-6, sampleCount / evalTime * 1e-6,
+	    meanCos / sampleCount);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Random Walks
+ *
+ * Traces analog random walks in a homogeneous medium of unit extinction.
+ * The inside() predicate and the entry point and direction define the
+ * geometry; a path terminates when it leaves the medium or is absorbed.
+ * Returns the energy that leaves the medium after at least one scattering
+ * event, split between the two sides of the plane z = 0 (for the slab,
+ * this separates reflection from transmission).
+ */
+template <typename Phase, typename Inside>
+void
+randomWalk(
+	const char *geometry,
+	Inside inside,
+	const vec3& entryPoint,
+	int pathCount,
+	double g,
+	double albedo
+) {
+	Random rng(2);
+	double escaped[2] = {0.0, 0.0};
+	long long eventCount = 0;
+	std::chrono::high_resolution_clock::time_point t0 =
+		std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < pathCount; ++i) {
+		vec3 x = entryPoint, wi = vec3(0, 0, 1); // wi: direction of travel
+		int bounces = 0;
+
+		for (;;) {
+			double t = -std::log(1.0 - rng.nextf());
+
+			x = x + t * wi;
+			if (!inside(x)) {
+				if (bounces > 0) escaped[x.z < 0.0 ? 0 : 1]+= 1.0;
+				break;
+			}
+			if (rng.nextf() >= albedo)
+				break;
+
+			// the frame of the sampled direction is that of Mitsuba's -pRec.wi
+			double pdf;
+			vec3 wo = Phase::sample(rng.nextf(), rng.nextf(), g, &pdf);
+
+			wi = toWorld(wi, wo);
+			++bounces;
+			++eventCount;
+		}
+	}
+	double dt = elapsed(t0);
+
+	LOG("%-6s %-6s albedo: %.4f (z < 0) + %.4f (z > 0)   %8.2f M scattering events/s\n",
+	    Phase::name(), geometry,
+	    escaped[0] / pathCount, escaped[1] / pathCount,
+	    eventCount / dt * 1e-6);
+}
+
+// -----------------------------------------------------------------------------
+struct InsideSlab {
+	double thickness;
+	bool operator()(const vec3& x) const {return x.z >= 0.0 && x.z <= thickness;}
+};
+struct InsideSphere {
+	double radius;
+	bool operator()(const vec3& x) const {return dot(x, x) <= radius * radius;}
+};
+
+template <typename Phase>
+void bench(const AppManager& app)
+{
+	InsideSlab slab = {app.medium.thickness};
+	InsideSphere sphere = {app.medium.radius};
+
+	benchThroughput<Phase>(app.medium.g, app.run.sampleCount);
+	randomWalk<Phase>("slab", slab, vec3(0, 0, 0),
+	                  app.run.pathCount, app.medium.g, app.medium.albedo);
+	randomWalk<Phase>("sphere", sphere, vec3(0, 0, -app.medium.radius),
+	                  app.run.pathCount, app.medium.g, app.medium.albedo);
+}
+
+// -----------------------------------------------------------------------------
+void usage(const char *app)
+{
+	LOG("usage: %s [options]\n"\
+	    "  --g <float>              asymmetry parameter, in (-1, 1) (default %g)\n"\
+	    "  --albedo <float>         single scattering albedo (default %g)\n"\
+	    "  --thickness <float>      optical thickness of the slab (default %g)\n"\
+	    "  --radius <float>         optical radius of the sphere (default %g)\n"\
+	    "  --samples <int>          samples of the throughput tests (default %i)\n"\
+	    "  --paths <int>            random walks per geometry (default %i)\n",
+	    app,
+	    g_app.medium.g, g_app.medium.albedo,
+	    g_app.medium.thickness, g_app.medium.radius,
+	    g_app.run.sampleCount, g_app.run.pathCount);
+}
+
+bool parseArgs(int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		}
+		if (!val) {
+			LOG("error: missing value for %s\n", arg);
+			return false;
+		}
+		++i;
+		if      (!strcmp(arg, "--g"))         g_app.medium.g = atof(val);
+		else if (!strcmp(arg, "--albedo"))    g_app.medium.albedo = atof(val);
+		else if (!strcmp(arg, "--thickness")) g_app.medium.thickness = atof(val);
+		else if (!strcmp(arg, "--radius"))    g_app.medium.radius = atof(val);
+		else if (!strcmp(arg, "--samples"))   g_app.run.sampleCount = atoi(val);
+		else if (!strcmp(arg, "--paths"))     g_app.run.pathCount = atoi(val);
+		else {
+			LOG("error: unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (g_app.medium.g <= -1.f || g_app.medium.g >= 1.f) {
+		LOG("error: the asymmetry parameter must lie in (-1, 1)\n");
+		return false;
+	}
+	if (g_app.medium.albedo < 0.f || g_app.medium.albedo > 1.f) {
+		LOG("error: the albedo must lie in [0, 1]\n");
+		return false;
+	}
+	if (g_app.medium.thickness <= 0.f || g_app.medium.radius <= 0.f) {
+		LOG("error: invalid geometry\n");
+		return false;
+	}
+	if (g_app.run.sampleCount < 1 || g_app.run.pathCount < 1) {
+		LOG("error: invalid sample or path count\n");
+		return false;
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+	if (!parseArgs(argc, argv)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	LOG("-- Begin -- Benchmark (g = %g, albedo = %g)\n",
+	    g_app.medium.g, g_app.medium.albedo);
+	bench<PivotPhase>(g_app);
+	bench<HGPhase>(g_app);
+	LOG("-- End -- Benchmark\n");
+
+	return EXIT_SUCCESS;
+}
+//
+//
+////////////////////////////////////////////////////////////////////////////////
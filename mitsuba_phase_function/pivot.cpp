@@ -1,15 +1,25 @@
 #include <mitsuba/render/phase.h>
+#include <mitsuba/render/medium.h>
+#include <mitsuba/render/volume.h>
 #include <mitsuba/render/sampler.h>
 #include <mitsuba/core/properties.h>
 #include <mitsuba/core/frame.h>
 #include <mitsuba/core/warp.h>
 
+#include "pivot_phase.h"
+
+/* Number of directions processed at once by the batched entry points */
+#define PIVOT_PACKET_SIZE 16
+
+/* Maximum resolution of the cached asymmetry grid, along each axis */
+#define PIVOT_MAX_GRID_RES 512
+
 MTS_NAMESPACE_BEGIN
 
 /*!\plugin{hg}{Pivot phase function}
  * \order{2}
  * \parameters{
- *     \parameter{g}{\Float}{
+ *     \parameter{g}{\Float\Or\VolumeDataSource}{
  *       This parameter must be somewhere in the range $-1$ to $1$
  *       (but not equal to $-1$ or $1$). It denotes the \emph{mean cosine}
  *       of scattering interactions. A value greater than zero indicates that
@@ -17,11 +27,19 @@ MTS_NAMESPACE_BEGIN
  *       direction (i.e. the medium is \emph{forward-scattering}), whereas
  *       values smaller than zero cause the medium to be
  *       scatter more light in the opposite direction.
+ *       When a volume is given, $g$ varies spatially: the plugin caches
+ *       the lobe of each voxel of the volume at load time, and looks
+ *       it up at the scattering point.
  *     }
  * }
  * This plugin implements the phase function model proposed by
  * Dupuy et al.. It is parameterizable from backward- ($g<0$) through
  * isotropic- ($g=0$) to forward ($g>0$) scattering.
+ *
+ * Besides the standard interface, the plugin provides batched versions
+ * of \code{sample()} and \code{eval()}, which process packets of
+ * directions and vectorize across them; volumetric integrators may
+ * access them through a \code{dynamic_cast}.
  */
 class PivotPhaseFunction : public PhaseFunction {
 public:
@@ -37,6 +55,8 @@ public:
 	PivotPhaseFunction(Stream *stream, InstanceManager *manager)
 		: PhaseFunction(stream, manager) {
 		m_g = stream->readFloat();
+		if (stream->readBool())
+			m_gVolume = static_cast<VolumeDataSource *>(manager->getInstance(stream));
 		configure();
 	}
 
@@ -46,58 +66,256 @@ public:
 		PhaseFunction::serialize(stream, manager);
 
 		stream->writeFloat(m_g);
+		stream->writeBool(m_gVolume.get() != NULL);
+		if (m_gVolume.get())
+			manager->serialize(stream, m_gVolume.get());
+	}
+
+	void addChild(const std::string &name, ConfigurableObject *child) {
+		if (child->getClass()->derivesFrom(MTS_CLASS(VolumeDataSource)) && name == "g") {
+			m_gVolume = static_cast<VolumeDataSource *>(child);
+		} else {
+			PhaseFunction::addChild(name, child);
+		}
 	}
 
 	void configure() {
 		PhaseFunction::configure();
 		m_type = EAngleDependence;
+		m_lobe = Lobe(m_g);
+		m_lobes.clear();
+		if (m_gVolume.get())
+			cacheLobes();
 	}
 
-	inline Vector project(const Vector& std, const Vector& pivot) const {
-		Vector tmp = std - pivot;
-		Vector cp1 = cross(std, pivot);
-		Vector cp2 = cross(tmp, cp1);
-		Float dp = dot(std, pivot) - 1.0;
-		Float qf = dp * dp + dot(cp1, cp1);
+	/* Pivot transform; qf receives the squared distance between std
+	   and the pivot, from which the density of the result follows */
+	inline Vector project(const Vector& std, const Vector& pivot,
+			Float &qf) const {
+		return pivot_phase::project(std, pivot, &qf);
+	}
 
-		return ((dp * tmp - cp2) / qf);
+	/* Density of a direction projected from a uniform sample: the pivot
+	   transform is an involution, so |w - pivot| = (1 - g^2) / sqrt(qf)
+	   and eval() reduces to the expression below */
+	inline Float projectedPdf(Float qf, Float oneMinusG2) const {
+		Float temp = qf / oneMinusG2;
+		return INV_FOURPI * (temp * temp);
 	}
 
 	inline Float sample(PhaseFunctionSamplingRecord &pRec,
 			Sampler *sampler) const {
+		Float pdf;
+		return PivotPhaseFunction::sample(pRec, pdf, sampler);
+	}
+
+	Float sample(PhaseFunctionSamplingRecord &pRec,
+			Float &pdf, Sampler *sampler) const {
+		const Lobe &lobe = lookup(pRec.mRec.p);
 		Point2 sample(sampler->next2D());
 		Vector std = warp::squareToUniformSphere(sample);
+		Float qf;
 
-		pRec.wo = Frame(-pRec.wi).toWorld(project(std, Vector(0, 0, m_g)));
+		pRec.wo = Frame(-pRec.wi).toWorld(project(std, lobe.pivot, qf));
+		pdf = projectedPdf(qf, lobe.oneMinusG2);
 
 		return 1.0f;
 	}
 
-	Float sample(PhaseFunctionSamplingRecord &pRec,
-			Float &pdf, Sampler *sampler) const {
-		PivotPhaseFunction::sample(pRec, sampler);
-		pdf = PivotPhaseFunction::eval(pRec);
-		return 1.0f;
+	/**
+	 * \brief Batched sampling
+	 *
+	 * Samples \c count directions: \c p holds the scattering points (or
+	 * NULL in homogeneous media), \c wi the incident directions and
+	 * \c sample the uniform sample pairs; \c wo receives the sampled
+	 * directions and \c pdf their densities, which come out of the pivot
+	 * transform instead of an extra call to eval(). Each direction is
+	 * mapped exactly as in the scalar version, up to the tangent frame
+	 * of -wi, which is built without branches (Duff et al. 2017); the
+	 * distribution is symmetric about -wi, so this does not matter.
+	 */
+	void sample(size_t count, const Point *p, const Vector *wi,
+			const Point2 *sample, Vector *wo, Float *pdf) const {
+		for (size_t i = 0; i < count; i += PIVOT_PACKET_SIZE) {
+			size_t n = std::min(count - i, (size_t) PIVOT_PACKET_SIZE);
+			samplePacket(n, p ? p + i : NULL, wi + i, sample + i, wo + i, pdf + i);
+		}
+	}
+
+	/// Batched evaluation, see eval() and the batched sample()
+	void eval(size_t count, const Point *p, const Vector *wi,
+			const Vector *wo, Float *value) const {
+		for (size_t i = 0; i < count; ++i) {
+			const Lobe &lobe = p ? lookup(p[i]) : m_lobe;
+			Float g = lobe.pivot.z;
+			Float temp1 = 2 - lobe.oneMinusG2 + 2.0f * g * dot(wi[i], wo[i]);
+			Float temp2 = lobe.oneMinusG2 / temp1;
+			value[i] = INV_FOURPI * (temp2 * temp2);
+		}
 	}
 
 	Float eval(const PhaseFunctionSamplingRecord &pRec) const {
-		Float temp1 = 1.0f + m_g * m_g + 2.0f * m_g * dot(pRec.wi, pRec.wo);
-		Float temp2 = (1 - m_g * m_g) / temp1;
+		const Lobe &lobe = lookup(pRec.mRec.p);
+		Float g = lobe.pivot.z;
+		Float temp1 = 2 - lobe.oneMinusG2 + 2.0f * g * dot(pRec.wi, pRec.wo);
+		Float temp2 = lobe.oneMinusG2 / temp1;
 		return INV_FOURPI * (temp2 * temp2);
 	}
 
 	Float getMeanCosine() const {
-		return m_g;
+		return m_gVolume.get() ? m_meanG : m_g;
 	}
 
 	std::string toString() const {
 		std::ostringstream oss;
-		oss << "PivotPhaseFunction[g=" << m_g << "]";
+		oss << "PivotPhaseFunction[" << endl;
+		if (m_gVolume.get())
+			oss << "  g = " << indent(m_gVolume->toString()) << endl;
+		else
+			oss << "  g = " << m_g << endl;
+		oss << "]";
 		return oss.str();
 	}
 
 	MTS_DECLARE_CLASS()
 private:
+	/* Lobe of the phase function: the pivot (0, 0, g), along with
+	   1 - g^2, which both the density and the sampling PDF divide by */
+	struct Lobe {
+		Vector pivot;
+		Float oneMinusG2;
+
+		Lobe() { }
+		explicit Lobe(Float g) : pivot(0, 0, g), oneMinusG2(1 - g * g) { }
+	};
+
+	/* Returns the lobe at p, i.e., that of the voxel holding p when g
+	   is given as a volume */
+	inline const Lobe &lookup(const Point &p) const {
+		if (m_lobes.empty())
+			return m_lobe;
+
+		size_t index = 0;
+		for (int i = 2; i >= 0; --i) {
+			int x = (int) ((p[i] - m_aabb.min[i]) * m_invVoxelSize[i]);
+			index = index * m_res[i] + std::min(std::max(x, 0), m_res[i] - 1);
+		}
+
+		return m_lobes[index];
+	}
+
+	/* Caches the lobes of the voxels of the asymmetry volume, so that
+	   heterogeneous media need a single memory fetch per interaction
+	   instead of a volume lookup; the step size of Mitsuba volumes is
+	   half their voxel size */
+	void cacheLobes() {
+		if (!m_gVolume->supportsFloatLookups())
+			Log(EError, "The asymmetry volume must support float lookups!");
+
+		m_aabb = m_gVolume->getAABB();
+		Vector extents = m_aabb.getExtents();
+		Float voxelSize = 2 * m_gVolume->getStepSize();
+		size_t voxelCount = 1, clampedCount = 0;
+		Float sumG = 0;
+
+		for (int i = 0; i < 3; ++i) {
+			Float res = std::ceil(extents[i] / voxelSize);
+
+			m_res[i] = std::max(1, (int) std::min(res, (Float) PIVOT_MAX_GRID_RES));
+			m_invVoxelSize[i] = extents[i] > 0 ? m_res[i] / extents[i] : 0;
+			voxelCount *= m_res[i];
+		}
+		m_lobes.resize(voxelCount);
+
+		for (int z = 0; z < m_res[2]; ++z)
+		for (int y = 0; y < m_res[1]; ++y)
+		for (int x = 0; x < m_res[0]; ++x) {
+			Point p = m_aabb.min + Vector(
+				(x + 0.5f) * extents.x / m_res[0],
+				(y + 0.5f) * extents.y / m_res[1],
+				(z + 0.5f) * extents.z / m_res[2]);
+			Float g = m_gVolume->lookupFloat(p);
+
+			if (g >= 1 || g <= -1) {
+				g = std::min(std::max(g, (Float) -0.999f), (Float) 0.999f);
+				++clampedCount;
+			}
+			m_lobes[(z * m_res[1] + y) * m_res[0] + x] = Lobe(g);
+			sumG += g;
+		}
+		m_meanG = sumG / voxelCount;
+
+		if (clampedCount > 0)
+			Log(EWarn, "Clamped %i asymmetry values to the interval (-1, 1)",
+				(int) clampedCount);
+		Log(EInfo, "Cached %i x %i x %i asymmetry voxels (mean cosine %f)",
+			m_res[0], m_res[1], m_res[2], m_meanG);
+	}
+
+	/* Samples a packet of n <= PIVOT_PACKET_SIZE directions. The pivot
+	   lies on the z-axis, so the pivot transform of a uniform direction
+	   (x, y, z) simplifies to
+	     ((g^2 - 1) x, (g^2 - 1) y, (zg - 1)(z - g) + g (x^2 + y^2)) / qf,
+	   with qf = (zg - 1)^2 + g^2 (x^2 + y^2). The loop has no branches
+	   and works on arrays of scalars, so the compiler vectorizes it
+	   (the trigonometric functions require -ffast-math and libmvec). */
+	void samplePacket(size_t n, const Point *p, const Vector *wi,
+			const Point2 *sample, Vector *wo, Float *pdf) const {
+		Float ux[PIVOT_PACKET_SIZE], uy[PIVOT_PACKET_SIZE];
+		Float nx[PIVOT_PACKET_SIZE], ny[PIVOT_PACKET_SIZE], nz[PIVOT_PACKET_SIZE];
+		Float gs[PIVOT_PACKET_SIZE], cs[PIVOT_PACKET_SIZE];
+		Float ox[PIVOT_PACKET_SIZE], oy[PIVOT_PACKET_SIZE], oz[PIVOT_PACKET_SIZE];
+		Float pd[PIVOT_PACKET_SIZE];
+
+		/* gather */
+		for (size_t k = 0; k < n; ++k) {
+			const Lobe &lobe = p ? lookup(p[k]) : m_lobe;
+
+			ux[k] = sample[k].x; uy[k] = sample[k].y;
+			nx[k] = -wi[k].x; ny[k] = -wi[k].y; nz[k] = -wi[k].z;
+			gs[k] = lobe.pivot.z; cs[k] = lobe.oneMinusG2;
+		}
+
+		/* sample the sphere, apply the pivot transform and express the
+		   result in the frame of -wi */
+		for (size_t k = 0; k < n; ++k) {
+			Float z = 1 - 2 * ux[k];
+			Float r = std::sqrt(std::max((Float) 0, 1 - z * z));
+			Float phi = (Float) (2 * M_PI) * uy[k];
+			/* GCC merges sin and cos into sincos, which has no
+			   vector variant, so we only call cos */
+			Float x = r * std::cos(phi), y = r * std::cos(phi - (Float) M_PI_2);
+			Float g = gs[k], g2m1 = -cs[k];
+			Float dp = z * g - 1;
+			Float qf = dp * dp + g * g * (r * r);
+			Float rcp = 1 / qf;
+			Float lx = g2m1 * x * rcp, ly = g2m1 * y * rcp;
+			Float lz = (dp * (z - g) + g * (r * r)) * rcp;
+
+			Float sign = std::copysign((Float) 1, nz[k]);
+			Float a = -1 / (sign + nz[k]);
+			Float b = nx[k] * ny[k] * a;
+			ox[k] = (1 + sign * nx[k] * nx[k] * a) * lx + b * ly + nx[k] * lz;
+			oy[k] = sign * b * lx + (sign + ny[k] * ny[k] * a) * ly + ny[k] * lz;
+			oz[k] = -sign * nx[k] * lx - ny[k] * ly + nz[k] * lz;
+			Float temp = qf / cs[k];
+			pd[k] = INV_FOURPI * (temp * temp); // see projectedPdf()
+		}
+
+		/* scatter */
+		for (size_t k = 0; k < n; ++k) {
+			wo[k] = Vector(ox[k], oy[k], oz[k]);
+			pdf[k] = pd[k];
+		}
+	}
+
+	ref<VolumeDataSource> m_gVolume;
+	std::vector<Lobe> m_lobes; // cached lobes of the voxels of m_gVolume
+	AABB m_aabb;
+	Vector m_invVoxelSize;
+	int m_res[3];
+	Float m_meanG;
+	Lobe m_lobe; // lobe of homogeneous media
 	Float m_g;
 };
 
@@ -0,0 +1,196 @@
+#include <mitsuba/render/phase.h>
+#include <mitsuba/render/medium.h>
+#include <mitsuba/render/sampler.h>
+#include <mitsuba/core/properties.h>
+#include <mitsuba/core/frame.h>
+#include <mitsuba/core/warp.h>
+
+#include "pivot_phase.h"
+
+MTS_NAMESPACE_BEGIN
+
+/*!\plugin{pivotmixture}{Mixture of pivot phase functions}
+ * \order{3}
+ * \parameters{
+ *     \parameter{g}{\String}{
+ *       A comma-separated list of asymmetry parameters, one per lobe.
+ *       Each value must lie in the range $-1$ to $1$ (but not equal to
+ *       $-1$ or $1$), see the \pluginref{pivot} plugin.
+ *     }
+ *     \parameter{weights}{\String}{
+ *       A comma-separated list of non-negative weights, one per lobe.
+ *       The weights are normalized so that they sum to one.
+ *     }
+ * }
+ * This plugin implements a weighted sum of pivot phase functions, e.g.,
+ * a forward and a backward lobe:
+ * \begin{xml}
+ * <phase type="pivotmixture">
+ *     <string name="g" value="0.8, -0.3"/>
+ *     <string name="weights" value="0.9, 0.1"/>
+ * </phase>
+ * \end{xml}
+ * Contrary to the \pluginref{mixturephase} plugin, the lobes are not
+ * separate plugins: sampling selects a lobe in constant time with an
+ * alias table, and the density of the mixture is evaluated in a single
+ * pass over the lobes, whose parameters are stored as arrays.
+ */
+class PivotMixturePhaseFunction : public PhaseFunction {
+public:
+	PivotMixturePhaseFunction(const Properties &props)
+		: PhaseFunction(props) {
+		m_g = parseList(props.getString("g", "0.8"), "asymmetry parameters");
+		m_weights = parseList(props.getString("weights", "1"), "weights");
+
+		if (m_g.size() != m_weights.size())
+			Log(EError, "Expected as many weights (%i) as asymmetry parameters (%i)!",
+				(int) m_weights.size(), (int) m_g.size());
+
+		Float sum = 0;
+		for (size_t i = 0; i < m_g.size(); ++i) {
+			if (m_g[i] >= 1 || m_g[i] <= -1)
+				Log(EError, "The asymmetry parameters must lie in the interval (-1, 1)!");
+			if (m_weights[i] < 0)
+				Log(EError, "The weights must be non-negative!");
+			sum += m_weights[i];
+		}
+		if (sum <= 0)
+			Log(EError, "The weights must not all be zero!");
+	}
+
+	PivotMixturePhaseFunction(Stream *stream, InstanceManager *manager)
+		: PhaseFunction(stream, manager) {
+		size_t count = stream->readSize();
+		m_g.resize(count);
+		m_weights.resize(count);
+		stream->readFloatArray(&m_g[0], count);
+		stream->readFloatArray(&m_weights[0], count);
+		configure();
+	}
+
+	virtual ~PivotMixturePhaseFunction() { }
+
+	void serialize(Stream *stream, InstanceManager *manager) const {
+		PhaseFunction::serialize(stream, manager);
+
+		stream->writeSize(m_g.size());
+		stream->writeFloatArray(&m_g[0], m_g.size());
+		stream->writeFloatArray(&m_weights[0], m_weights.size());
+	}
+
+	void configure() {
+		PhaseFunction::configure();
+		m_type = EAngleDependence;
+
+		/* normalize the weights and build the lobe selection table */
+		size_t count = m_g.size();
+		Float sum = 0;
+		for (size_t i = 0; i < count; ++i)
+			sum += m_weights[i];
+
+		m_prob.resize(count);
+		m_alias.resize(count);
+		pivot_phase::alias_build(&m_weights[0], (int) count, &m_prob[0], &m_alias[0]);
+
+		/* each lobe of the density is c / (a + b cos_theta)^2, see eval() */
+		m_a.resize(count);
+		m_b.resize(count);
+		m_c.resize(count);
+		m_meanG = 0;
+		for (size_t i = 0; i < count; ++i) {
+			Float g = m_g[i], oneMinusG2 = 1 - g * g;
+
+			m_a[i] = 1 + g * g;
+			m_b[i] = 2 * g;
+			m_c[i] = (m_weights[i] / sum) * INV_FOURPI * (oneMinusG2 * oneMinusG2);
+			m_meanG += (m_weights[i] / sum) * g;
+		}
+	}
+
+	inline Float sample(PhaseFunctionSamplingRecord &pRec,
+			Sampler *sampler) const {
+		Float pdf;
+		return PivotMixturePhaseFunction::sample(pRec, pdf, sampler);
+	}
+
+	/* The lobe is selected with an alias table and sampled as in the
+	   pivot plugin; the density of the direction is that of the whole
+	   mixture, so the sample weight is always one */
+	Float sample(PhaseFunctionSamplingRecord &pRec,
+			Float &pdf, Sampler *sampler) const {
+		int lobe = pivot_phase::alias_sample(sampler->next1D(),
+			&m_prob[0], &m_alias[0], (int) m_prob.size());
+		Point2 sample(sampler->next2D());
+		Vector std = warp::squareToUniformSphere(sample);
+		Float qf;
+		Vector wo = pivot_phase::project(std, Vector(0, 0, m_g[lobe]), &qf);
+
+		pRec.wo = Frame(-pRec.wi).toWorld(wo);
+		pdf = evalMixture(-wo.z); // dot(wi, wo) in the frame of -wi
+
+		return 1.0f;
+	}
+
+	Float eval(const PhaseFunctionSamplingRecord &pRec) const {
+		return evalMixture(dot(pRec.wi, pRec.wo));
+	}
+
+	Float getMeanCosine() const {
+		return m_meanG;
+	}
+
+	std::string toString() const {
+		std::ostringstream oss;
+		oss << "PivotMixturePhaseFunction[" << endl;
+		for (size_t i = 0; i < m_g.size(); ++i)
+			oss << "  lobe " << i << ": g = " << m_g[i]
+				<< ", weight = " << m_weights[i] << endl;
+		oss << "]";
+		return oss.str();
+	}
+
+	MTS_DECLARE_CLASS()
+private:
+	/* Parses a comma-separated list of floats */
+	static std::vector<Float> parseList(const std::string &str, const char *what) {
+		std::vector<std::string> tokens = tokenize(str, " ,;");
+		std::vector<Float> values;
+
+		for (size_t i = 0; i < tokens.size(); ++i) {
+			char *end_ptr = NULL;
+			Float value = (Float) strtod(tokens[i].c_str(), &end_ptr);
+			if (*end_ptr != '\0')
+				SLog(EError, "Could not parse the %s!", what);
+			values.push_back(value);
+		}
+		if (values.empty())
+			SLog(EError, "Expected at least one lobe!");
+
+		return values;
+	}
+
+	/* Density of the mixture, where cos_theta = dot(wi, wo); the loop
+	   has no branches, so the compiler vectorizes it */
+	inline Float evalMixture(Float cos_theta) const {
+		const Float *a = &m_a[0], *b = &m_b[0], *c = &m_c[0];
+		size_t count = m_a.size();
+		Float sum = 0;
+
+		for (size_t i = 0; i < count; ++i) {
+			Float temp = a[i] + b[i] * cos_theta;
+			sum += c[i] / (temp * temp);
+		}
+
+		return sum;
+	}
+
+	std::vector<Float> m_g, m_weights;   // parameters of the lobes
+	std::vector<Float> m_prob;           // alias table of the weights
+	std::vector<int> m_alias;
+	std::vector<Float> m_a, m_b, m_c;    // lobe coefficients, see evalMixture()
+	Float m_meanG;
+};
+
+MTS_IMPLEMENT_CLASS_S(PivotMixturePhaseFunction, false, PhaseFunction)
+MTS_EXPORT_PLUGIN(PivotMixturePhaseFunction, "Mixture of pivot phase functions");
+MTS_NAMESPACE_END
@@ -0,0 +1,177 @@
+/* pivot_phase.h - public domain C++ library
+by Jonathan Dupuy
+
+	This file provides the math of the pivot phase function, i.e., the
+	Mitsuba plugin of pivot.cpp, without any dependency. The phase function
+	is the pivot transformed uniform spherical distribution (PTSD), whose
+	pivot lies at distance g of the origin, in the direction of
+	propagation.
+
+	USAGE
+
+	The library is header-only: simply include this file. All functions
+	live in the pivot_phase namespace.
+
+	The alias table functions build and sample a discrete distribution in
+	constant time (Walker 1977; Vose 1991); the mixture plugin of
+	pivot_mixture.cpp uses them to select its lobes.
+
+	The functions are templated over the scalar type T and the vector type
+	V; V must provide an (x, y, z) constructor and the usual arithmetic
+	operators, along with dot() and cross() overloads that are reachable
+	through argument dependent lookup (Mitsuba's Vector qualifies).
+
+	NOTES
+
+	Directions follow Mitsuba's conventions: wi points towards the previous
+	vertex and wo towards the next one, so that eval() is maximal for
+	wo = -wi when g > 0.
+*/
+
+#ifndef PIVOT_INCLUDE_PIVOT_PHASE_H
+#define PIVOT_INCLUDE_PIVOT_PHASE_H
+
+#include <cmath>
+#include <vector>
+
+namespace pivot_phase {
+
+// Pivot transform; qf receives the squared distance between std and the
+// pivot, from which the density of the result follows (see pdf())
+template <typename V, typename T>
+inline V project(const V& std, const V& pivot, T *qf);
+
+// Density of the phase function, where cos_theta = dot(wi, wo)
+template <typename T>
+inline T eval(T cos_theta, T g);
+
+// Density of the transform of a uniform direction, given its qf
+template <typename T>
+inline T pdf(T qf, T g);
+
+// Samples a direction about the z-axis, i.e., about -wi; qf is as above
+template <typename V, typename T>
+inline V sample(T u1, T u2, T g, T *qf);
+
+// Builds the alias table of count weights (which need not be normalized);
+// prob and alias receive count entries each
+template <typename T>
+inline void alias_build(const T *weights, int count, T *prob, int *alias);
+
+// Samples the alias table built by alias_build() from u in [0, 1)
+template <typename T>
+inline int alias_sample(T u, const T *prob, const int *alias, int count);
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+
+#define PIVOT_PHASE__INV_FOURPI 0.07957747154594766788
+#define PIVOT_PHASE__TWOPI 6.28318530717958647693
+
+// -----------------------------------------------------------------------------
+// Projection
+template <typename V, typename T>
+inline V project(const V& std, const V& pivot, T *qf)
+{
+	V tmp = std - pivot;
+	V cp1 = cross(std, pivot);
+	V cp2 = cross(tmp, cp1);
+	T dp = dot(std, pivot) - (T) 1;
+	*qf = dp * dp + dot(cp1, cp1);
+
+	return ((dp * tmp - cp2) / *qf);
+}
+
+// -----------------------------------------------------------------------------
+// Evaluation
+template <typename T>
+inline T eval(T cos_theta, T g)
+{
+	T temp1 = (T) 1 + g * g + (T) 2 * g * cos_theta;
+	T temp2 = ((T) 1 - g * g) / temp1;
+
+	return (T) PIVOT_PHASE__INV_FOURPI * (temp2 * temp2);
+}
+
+// -----------------------------------------------------------------------------
+// the pivot transform is an involution, so |w - pivot| = (1 - g^2) / sqrt(qf)
+// and eval() reduces to the expression below
+template <typename T>
+inline T pdf(T qf, T g)
+{
+	T temp = qf / ((T) 1 - g * g);
+
+	return (T) PIVOT_PHASE__INV_FOURPI * (temp * temp);
+}
+
+// -----------------------------------------------------------------------------
+// Sampling
+template <typename V, typename T>
+inline V sample(T u1, T u2, T g, T *qf)
+{
+	T z = (T) 1 - (T) 2 * u1;
+	T r = std::sqrt(std::fmax((T) 0, (T) 1 - z * z));
+	T phi = (T) PIVOT_PHASE__TWOPI * u2;
+
+	return project(V(r * std::cos(phi), r * std::sin(phi), z), V(0, 0, g), qf);
+}
+
+// -----------------------------------------------------------------------------
+// Alias Table
+// The weights are scaled so that they average to one, and the table is
+// filled by pairing an entry whose weight lies below one with an entry
+// whose weight lies above; the former keeps its weight as probability and
+// gives the rest of its bin to the latter (Vose 1991). The worklist holds
+// the small entries at its front and the large ones at its back.
+template <typename T>
+inline void alias_build(const T *weights, int count, T *prob, int *alias)
+{
+	std::vector<int> worklist(count);
+	int small = 0, large = count;
+	T sum = 0;
+
+	for (int i = 0; i < count; ++i)
+		sum+= weights[i];
+	for (int i = 0; i < count; ++i) {
+		prob[i] = weights[i] * (T) count / sum;
+		alias[i] = i;
+		if (prob[i] < (T) 1) worklist[small++] = i; else worklist[--large] = i;
+	}
+
+	// pair the entries; a large entry that becomes small moves to the front
+	while (small > 0 && large < count) {
+		int i = worklist[--small], j = worklist[large];
+
+		alias[i] = j;
+		prob[j] = (prob[j] + prob[i]) - (T) 1;
+		if (prob[j] < (T) 1) {
+			++large;
+			worklist[small++] = j;
+		}
+	}
+
+	// the remaining entries fill their bin, up to roundoff
+	for (int i = 0; i < small; ++i) prob[worklist[i]] = (T) 1;
+	for (int i = large; i < count; ++i) prob[worklist[i]] = (T) 1;
+}
+
+// -----------------------------------------------------------------------------
+// the integer part of u * count picks a bin, and its fractional part picks
+// either the entry of the bin or its alias
+template <typename T>
+inline int alias_sample(T u, const T *prob, const int *alias, int count)
+{
+	T x = u * (T) count;
+	int i = (int) x;
+
+	if (i >= count) i = count - 1;
+	return (x - (T) i) < prob[i] ? i : alias[i];
+}
+
+#undef PIVOT_PHASE__INV_FOURPI
+#undef PIVOT_PHASE__TWOPI
+
+} // namespace pivot_phase
+
+#endif // PIVOT_INCLUDE_PIVOT_PHASE_H
@@ -0,0 +1,1158 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Sphere Light Shading Demo - CPU Renderer
+//
+// This file implements a CPU reference renderer for the planets scene. The
+// spheres are ray-cast analytically and shaded with a C++ port of
+// sphere.glsl, so that every shading mode of the OpenGL demo can be rendered
+// without a GPU. Each pass rendered by cpu::render mirrors one progressive
+// pass of the OpenGL renderer: the framebuffer accumulates radiance sums in
+// its RGB channels and sample counts in its alpha channel. The work is
+// distributed over threads with a work-stealing tile scheduler, and tiles
+// may stop early once their variance estimate has converged (adaptive
+// sampling, see variance.glsl).
+// It must be included after scene.h.
+//
+
+#ifndef CPU_RENDERER_H
+#define CPU_RENDERER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "ggx.h"
+#include "pivot_fit.h"
+#include "lights.h"
+#include "sampler.h"
+
+namespace cpu {
+
+using pivot::vec2;
+using pivot::vec3;
+using pivot::cap;
+using pivot::sphere;
+
+////////////////////////////////////////////////////////////////////////////////
+// Renderer Data
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Single channel texture (sampled with bilinear filtering and GL_REPEAT)
+struct Texture {
+	int w, h;
+	std::vector<float> texels;
+};
+
+// -----------------------------------------------------------------------------
+// RGBA32F pivot fit table (sampled like u_PivotSampler in sphere.glsl)
+struct PivotTable {
+	int w, h;
+	const float *texels;
+};
+
+// -----------------------------------------------------------------------------
+// RGBA32F pivot fit table of anisotropic GGX (see fit_aniso.inl, whose half
+// precision texels decode with halfToFloat()), indexed by sqrt(alpha_x),
+// theta, phi and sqrt(alpha_y)
+struct AnisoPivotTable {
+	int res[4];
+	const float *texels;
+};
+
+// -----------------------------------------------------------------------------
+// Accumulation framebuffer (rgb: radiance sum; a: sample count), along with
+// the moments of the luminance of the pass estimates (sum, sum of squares
+// and pass count), rows are stored bottom to top, as in OpenGL
+struct Framebuffer {
+	int w, h;
+	std::vector<float> rgba;
+	std::vector<float> moments;
+};
+
+// -----------------------------------------------------------------------------
+// Scene data, as produced by computeSphereData
+struct Scene {
+	const SphereTransform *transforms;
+	const SphereData *spheres;
+	int sphereCount;
+	const int32_t *lightIds; // indexes of the spheres that emit light
+	int lightCount;
+	const LightClusters *clusters; // optional clustered light lists
+	const LightTree *lightTree;    // optional light tree for the MC MIS modes
+};
+
+// -----------------------------------------------------------------------------
+// Renderer settings
+struct Settings {
+	int shadingMode;    // one of the SHADING_* modes
+	int sampler;        // one of the SAMPLER_* generators
+	int samplesPerPass; // Monte Carlo samples per pixel and per pass
+	int threadCount;    // number of worker threads
+	int tileSize;       // tile width and height, in pixels
+	struct {float r, g, b;} clearColor;
+	const Texture *roughness;
+	const PivotTable *pivotTable; // NULL selects the analytic fit (pivot_fit.h)
+	const AnisoPivotTable *anisoPivotTable;
+	struct {
+		float threshold;  // relative error target, 0 disables adaptive sampling
+		int minPassCount; // passes rendered before estimating the variance
+	} adaptive;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Utility functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+inline float fract(float x) {return x - std::floor(x);}
+
+// -----------------------------------------------------------------------------
+// same as hash() in sphere.glsl
+inline float hash(const vec2& p)
+{
+	float h = p.x * 127.1f + p.y * 311.7f;
+
+	return fract(std::sin(h) * 43758.5453123f);
+}
+
+// -----------------------------------------------------------------------------
+// integer hash, used to jitter the primary rays
+inline uint32_t hash32(uint32_t x)
+{
+	x^= x >> 16; x*= 0x7feb352du;
+	x^= x >> 15; x*= 0x846ca68bu;
+	x^= x >> 16;
+
+	return x;
+}
+
+inline float u01(uint32_t x)
+{
+	return (float)(x >> 8) * (1.f / 16777216.f);
+}
+
+// -----------------------------------------------------------------------------
+// decodes a half precision float (e.g., the texels of fit_aniso.inl)
+inline float halfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+	uint32_t exponent = (h >> 10) & 0x1Fu, mantissa = h & 0x3FFu, x;
+	float f;
+
+	if (exponent == 0) { // zero or subnormal
+		f = (float)mantissa * (1.f / 16777216.f);
+		return sign ? -f : f;
+	}
+	if (exponent == 31) // infinity or NaN
+		x = sign | 0x7F800000u | (mantissa << 13);
+	else
+		x = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+	memcpy(&f, &x, sizeof(f));
+
+	return f;
+}
+
+// -----------------------------------------------------------------------------
+// Marsaglia random generator (same as the one that fills the Random buffer)
+struct Random {
+	Random(uint32_t seed): m_z(1u + seed), m_w(2u + hash32(seed)) {}
+	uint32_t next()
+	{
+		m_z = 36969u * (m_z & 65535u) + (m_z >> 16u);
+		m_w = 18000u * (m_w & 65535u) + (m_w >> 16u);
+
+		return ((m_z << 16u) + m_w);
+	}
+	float nextf() {return (float)((double)next() / (double)0xFFFFFFFFu);}
+	uint32_t m_z, m_w;
+};
+
+// -----------------------------------------------------------------------------
+// bilinear texture fetch with GL_REPEAT wrapping
+inline float textureRepeat(const Texture& t, float s, float r)
+{
+	float x = s * t.w - 0.5f, y = r * t.h - 0.5f;
+	float fx = std::floor(x), fy = std::floor(y);
+	float ax = x - fx, ay = y - fy;
+	int x0 = (int)fx % t.w, y0 = (int)fy % t.h;
+
+	if (x0 < 0) x0+= t.w;
+	if (y0 < 0) y0+= t.h;
+	int x1 = (x0 + 1) % t.w, y1 = (y0 + 1) % t.h;
+	const float *row0 = &t.texels[y0 * t.w];
+	const float *row1 = &t.texels[y1 * t.w];
+
+	return (1.f - ay) * ((1.f - ax) * row0[x0] + ax * row0[x1])
+	     + ay * ((1.f - ax) * row1[x0] + ax * row1[x1]);
+}
+
+// -----------------------------------------------------------------------------
+// bilinear RGBA fetch with GL_CLAMP_TO_EDGE wrapping; (x, y) in [0, 1]
+// are mapped to the texel centers of the first and last texels
+inline void textureClamp(const PivotTable& t, float x, float y, float rgba[4])
+{
+	x = pivot::clamp(x, 0.f, 1.f) * (t.w - 1);
+	y = pivot::clamp(y, 0.f, 1.f) * (t.h - 1);
+	int x0 = (int)x, y0 = (int)y;
+	int x1 = x0 + 1 < t.w ? x0 + 1 : x0;
+	int y1 = y0 + 1 < t.h ? y0 + 1 : y0;
+	float ax = x - x0, ay = y - y0;
+
+	for (int i = 0; i < 4; ++i) {
+		float t00 = t.texels[4 * (y0 * t.w + x0) + i];
+		float t10 = t.texels[4 * (y0 * t.w + x1) + i];
+		float t01 = t.texels[4 * (y1 * t.w + x0) + i];
+		float t11 = t.texels[4 * (y1 * t.w + x1) + i];
+
+		rgba[i] = (1.f - ay) * ((1.f - ax) * t00 + ax * t10)
+		        + ay * ((1.f - ax) * t01 + ax * t11);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// same as extractPivot() in sphere.glsl; a NULL table selects the analytic fit
+// wo is assumed to be expressed in tangent space
+inline vec3
+extractPivot(const PivotTable *table, const vec3& wo, float alpha, float *brdfScale)
+{
+	if (!table) {
+		pivot::fit_params fit = pivot::ggx_pivot_fit(std::sqrt(alpha), wo.z);
+		vec3 p = vec3(-fit.t * wo.x, -fit.t * wo.y, fit.n);
+		float nrm2 = dot(p, p);
+
+		if (nrm2 > 0.998f) p = p * (0.999f / std::sqrt(nrm2));
+		*brdfScale = fit.s;
+
+		return p;
+	}
+
+	// fetch pivot fit params
+	float theta = std::acos(pivot::clamp(wo.z, -1.f, 1.f));
+	float pivotParams[4];
+	textureClamp(*table, std::sqrt(alpha), 2.f * theta / 3.14159f, pivotParams);
+	float pivotNorm = pivotParams[0];
+	float pivotElev = pivotParams[1];
+	vec3 p = pivotNorm * vec3(std::sin(pivotElev), 0, std::cos(pivotElev));
+
+	// express the pivot in tangent space
+	vec3 b0 = wo.z < 0.999f ? pivot::normalize(vec3(wo.x, wo.y, 0))
+	                        : vec3(1, 0, 0);
+	vec3 b1 = pivot::cross(vec3(0, 0, 1), b0);
+
+	// return
+	*brdfScale = pivotParams[3];
+	return b0 * p.x + b1 * p.y + vec3(0, 0, p.z);
+}
+
+// -----------------------------------------------------------------------------
+// quadrilinear RGBA fetch with GL_CLAMP_TO_EDGE wrapping; the coordinates
+// in [0, 1] are mapped to the texel centers of the first and last texels
+inline void textureClamp(const AnisoPivotTable& t, const float x[4], float rgba[4])
+{
+	int x0[4], x1[4];
+	float a[4];
+
+	for (int i = 0; i < 4; ++i) {
+		float xi = pivot::clamp(x[i], 0.f, 1.f) * (t.res[i] - 1);
+
+		x0[i] = (int)xi;
+		x1[i] = x0[i] + 1 < t.res[i] ? x0[i] + 1 : x0[i];
+		a[i] = xi - x0[i];
+	}
+	for (int i = 0; i < 4; ++i)
+		rgba[i] = 0.f;
+	for (int c = 0; c < 16; ++c) {
+		int texel = 0;
+		float w = 1.f;
+
+		for (int i = 3; i >= 0; --i) {
+			bool hi = (c >> i) & 1;
+
+			texel = texel * t.res[i] + (hi ? x1[i] : x0[i]);
+			w*= hi ? a[i] : 1.f - a[i];
+		}
+		for (int i = 0; i < 4; ++i)
+			rgba[i]+= w * t.texels[4 * texel + i];
+	}
+}
+
+// -----------------------------------------------------------------------------
+// same as the anisotropic extractPivot() in sphere.glsl
+inline vec3
+extractPivot(
+	const PivotTable *table,
+	const AnisoPivotTable *anisoTable,
+	const vec3& wo,
+	const vec2& alpha,
+	float *brdfScale
+) {
+	if (alpha.x == alpha.y || !anisoTable)
+		return extractPivot(table, wo, alpha.x, brdfScale);
+
+	// fold wo into the first quadrant
+	float theta = std::acos(pivot::clamp(wo.z, -1.f, 1.f));
+	float phi = std::atan2(std::fabs(wo.y), std::fabs(wo.x));
+	float x[4] = {
+		std::sqrt(alpha.x), 2.f * theta / 3.14159f,
+		2.f * phi / 3.14159f, std::sqrt(alpha.y)
+	};
+	float pivotParams[4];
+	textureClamp(*anisoTable, x, pivotParams);
+
+	vec3 p = vec3(pivotParams[0], pivotParams[1], pivotParams[2]);
+
+	// express the pivot in tangent space and unfold it
+	float c = std::cos(phi), s = std::sin(phi);
+	float px = c * p.x - s * p.y, py = s * p.x + c * p.y;
+
+	// return
+	*brdfScale = pivotParams[3];
+	return vec3(wo.x < 0.f ? -px : px, wo.y < 0.f ? -py : py, p.z);
+}
+
+// -----------------------------------------------------------------------------
+// same as anisotropicAlpha() in sphere.glsl
+inline vec2 anisotropicAlpha(float alpha, float anisotropy)
+{
+	float aspect = std::sqrt(1.f - 0.9f * anisotropy);
+
+	return vec2(pivot::clamp(alpha / aspect, 5e-3f, 1.f),
+	            pivot::clamp(alpha * aspect, 5e-3f, 1.f));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Shading
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Surface point, expressed in view space
+struct Fragment {
+	vec3 pos;        // position
+	vec3 wx, wy;     // tangents
+	vec2 texCoord;   // sphere parameterization
+	vec2 fragCoord;  // window coordinates
+	int sphereId;
+};
+
+// -----------------------------------------------------------------------------
+// importance of a light tree node (same as lightNodeImportance() in sphere.glsl)
+inline float
+lightNodeImportance(
+	const LightNode& node,
+	const Fragment& frag,
+	const vec3& wx, const vec3& wy, const vec3& wn,
+	const vec3& wo, const vec3& p
+) {
+	using namespace pivot;
+	vec3 d = vec3(node.bounds.x, node.bounds.y, node.bounds.z) - frag.pos;
+	sphere s = sphere(vec3(dot(wx, d), dot(wy, d), dot(wn, d)), node.bounds.w);
+
+	if (node.sphereId == frag.sphereId) return 0.f;
+	if (node.sphereId >= 0 && dot(s.pos, s.pos) <= s.r * s.r) return 0.f; // overlapping light
+
+	return node.energy / (s.r * s.r) * GGXSphereLightingPivotApprox(s, wo, p);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Sample the Light Tree
+ *
+ * Selects a light proportionally to the importance of the nodes along a
+ * root to leaf path; returns the sphere index of the light and stores its
+ * probability in pdf, or returns -1 if no light contributes. Same as
+ * lightTreeSample() in sphere.glsl.
+ */
+inline int
+lightTreeSample(
+	const LightTree& tree,
+	const Fragment& frag,
+	const vec3& wx, const vec3& wy, const vec3& wn,
+	const vec3& wo, const vec3& p,
+	float u, float *pdf
+) {
+	const LightNode *nodes = tree.nodes.data();
+	int n = 0;
+
+	*pdf = 1.f;
+	if (tree.nodes.empty()) return -1;
+	while (nodes[n].sphereId < 0) {
+		int n1 = nodes[n].children[0];
+		int n2 = nodes[n].children[1];
+		float i1 = lightNodeImportance(nodes[n1], frag, wx, wy, wn, wo, p);
+		float i2 = lightNodeImportance(nodes[n2], frag, wx, wy, wn, wo, p);
+
+		if (i1 + i2 <= 0.f) return -1;
+		float p1 = i1 / (i1 + i2);
+		if (u < p1) {
+			n = n1;
+			*pdf*= p1;
+			u = std::min(u / p1, 0.99999994f);
+		} else {
+			n = n2;
+			*pdf*= 1.f - p1;
+			u = std::min((u - p1) / (1.f - p1), 0.99999994f);
+		}
+	}
+
+	return nodes[n].sphereId;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Joint MIS Shading of a Sphere Light
+ *
+ * This evaluates the SHADING_MC_MIS_JOINT estimator of shade() over the
+ * samples [first, first + count) of a light of cap c (c_std once pivot
+ * transformed), and returns the sum of the weighted BRDF values. The
+ * samples are processed in batches: the pivot transforms and Jacobians go
+ * through the batched functions of pivot.h, which run 8 or 16 samples per
+ * instruction on CPUs with AVX2 or AVX-512 (see pivot::simd). As the pivot
+ * transform is an involution, the cap samples keep their untransformed
+ * direction to evaluate their density.
+ */
+inline float
+shadeJointMis(
+	const float samples[][4], int first, int count,
+	const vec3& wo, const vec2& alpha,
+	const pivot::cap& c, const pivot::cap& c_std, const vec3& p
+) {
+	using namespace pivot;
+	enum {BATCH_SIZE = 64};
+	float r_p[3][BATCH_SIZE], wi[3][BATCH_SIZE], wstd[3][BATCH_SIZE];
+	float J[BATCH_SIZE];
+	cvec3_soa pivots(r_p[0], r_p[1], r_p[2]);
+	vec3_soa wis = {wi[0], wi[1], wi[2]};
+	vec3_soa wstds = {wstd[0], wstd[1], wstd[2]};
+	float sum = 0.f;
+
+	for (int j = 0; j < BATCH_SIZE; ++j) {
+		r_p[0][j] = p.x; r_p[1][j] = p.y; r_p[2][j] = p.z;
+	}
+	for (int first2 = first; first2 < first + count; first2+= BATCH_SIZE) {
+		int n = std::min((int)BATCH_SIZE, first + count - first2);
+
+		// importance sample the BRDF
+		for (int j = 0; j < n; ++j) {
+			vec2 u2 = vec2(samples[first2 + j][0], samples[first2 + j][1]);
+			vec3 wm = ggx_sample(u2, wo, alpha.x, alpha.y);
+			vec3 w = 2.f * wm * dot(wo, wm) - wo;
+
+			wi[0][j] = w.x; wi[1][j] = w.y; wi[2][j] = w.z;
+		}
+		r3_to_pr3(n, wis, pivots, wstds);
+		pivot_jacobian(n, wis, pivots, J);
+		for (int j = 0; j < n; ++j) {
+			vec3 w = vec3(wi[0][j], wi[1][j], wi[2][j]);
+			float pdf1;
+			float frp = ggx_evalp(w, wo, alpha.x, alpha.y, &pdf1);
+
+			// raytrace the sphere light
+			if (pdf1 > 0.f && pdf_cap(w, c) > 0.f) {
+				vec3 ws = vec3(wstd[0][j], wstd[1][j], wstd[2][j]);
+				float pdf2 = pdf_cap(ws, c_std) * J[j];
+				float misWeight = pdf1 * pdf1;
+				float misNrm = pdf1 * pdf1 + pdf2 * pdf2;
+
+				sum+= frp / pdf1 * misWeight / misNrm;
+			}
+		}
+
+		// importance sample the pivot transformed spherical cap
+		for (int j = 0; j < n; ++j) {
+			vec2 u2 = vec2(samples[first2 + j][0], samples[first2 + j][1]);
+			vec3 ws = u2_to_cap(u2, c_std);
+
+			wstd[0][j] = ws.x; wstd[1][j] = ws.y; wstd[2][j] = ws.z;
+		}
+		r3_to_pr3(n, wstds, pivots, wis);
+		pivot_jacobian(n, wis, pivots, J);
+		for (int j = 0; j < n; ++j) {
+			vec3 w = vec3(wi[0][j], wi[1][j], wi[2][j]);
+			vec3 ws = vec3(wstd[0][j], wstd[1][j], wstd[2][j]);
+			float pdf1;
+			float frp = ggx_evalp(w, wo, alpha.x, alpha.y, &pdf1);
+			float pdf2 = pdf_cap(ws, c_std) * J[j];
+
+			if (pdf2 > 0.f) {
+				float misWeight = pdf2 * pdf2;
+				float misNrm = pdf1 * pdf1 + pdf2 * pdf2;
+
+				sum+= frp / pdf2 * misWeight / misNrm;
+			}
+		}
+	}
+
+	return sum;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Shade a Fragment
+ *
+ * This is a C++ port of the fragment shader of sphere.glsl; the rgb
+ * channels of the returned value hold the accumulated radiance, and
+ * the alpha channel the number of samples. The samples array holds the
+ * uniform samples of the pass (see sample4() in sphere.glsl).
+ */
+inline void
+shade(
+	const Settings& settings,
+	const Scene& scene,
+	const float samples[][4],
+	const Fragment& frag,
+	float out[4]
+) {
+	using namespace pivot;
+	const int mode = settings.shadingMode;
+	const int spp = settings.samplesPerPass;
+
+	// extract attributes
+	vec3 wx = normalize(frag.wx);
+	vec3 wy = normalize(frag.wy);
+	vec3 wn = normalize(cross(wx, wy));
+	vec3 wo = normalize(-frag.pos);
+	const SphereData *spheres = scene.spheres;
+	const SphereData& self = spheres[frag.sphereId];
+	vec2 alpha = anisotropicAlpha(
+		std::max(5e-3f, textureRepeat(*settings.roughness,
+		                              frag.texCoord.x,
+		                              frag.texCoord.y)),
+		self.brdf.y
+	);
+
+	// express data in tangent space
+	#define TG(v) vec3(dot(wx, v), dot(wy, v), dot(wn, v))
+	wo = TG(wo);
+
+	// initialize emitted and outgoing radiance
+	vec3 Le = vec3(self.light.x, self.light.y, self.light.z);
+	vec3 Lo = vec3(0);
+
+	// Debug Shading
+	if (mode == SHADING_DEBUG) {
+		out[0] = 0.f; out[1] = 1.f; out[2] = 0.f; out[3] = 1.f;
+		return;
+	}
+
+	// Area Light Shading
+	if (mode == SHADING_PIVOT) {
+		float brdfScale;
+		vec3 p = extractPivot(settings.pivotTable, settings.anisoPivotTable,
+		                      wo, alpha, &brdfScale);
+
+		for (int k = 0; k < scene.lightCount; ++k) {
+			int i = scene.lightIds[k];
+			if (frag.sphereId == i) continue;
+			const dja::vec4& g = spheres[i].geometry;
+			vec3 d = vec3(g.x, g.y, g.z) - frag.pos;
+			sphere s = sphere(TG(d), g.w);
+			if (dot(s.pos, s.pos) <= s.r * s.r) continue; // overlapping light
+
+			Lo+= GGXSphereLightingPivotApprox(s, wo, p)
+			   * vec3(spheres[i].light.x, spheres[i].light.y, spheres[i].light.z);
+		}
+		Lo*= brdfScale;
+		Lo+= Le;
+
+		out[0] = Lo.x; out[1] = Lo.y; out[2] = Lo.z; out[3] = 1.f;
+		return;
+	}
+
+	// Monte Carlo Shading
+	bool tree = scene.lightTree
+	         && (mode == SHADING_MC_MIS || mode == SHADING_MC_MIS_JOINT);
+	float brdfScale; // unused
+	vec3 p = mode == SHADING_MC_MIS_JOINT || tree
+	       ? extractPivot(settings.pivotTable, settings.anisoPivotTable,
+	                      wo, alpha, &brdfScale)
+	       : vec3(0);
+
+	// iterate over all spheres, or select one sphere per sample
+	for (int k = 0; k < (tree ? spp : scene.lightCount); ++k) {
+		int i, firstSample = 0, sampleCnt = spp;
+		float lightPdf = 1.f;
+
+		if (tree) {
+			float u1 = samples[k][2];
+
+			i = lightTreeSample(*scene.lightTree, frag, wx, wy, wn, wo, p,
+			                    u1, &lightPdf);
+			if (i < 0) continue;
+			firstSample = k;
+			sampleCnt = 1;
+		} else {
+			i = scene.lightIds[k];
+		}
+		if (frag.sphereId == i) continue;
+		const dja::vec4& g = spheres[i].geometry;
+		vec3 d = vec3(g.x, g.y, g.z) - frag.pos;
+		sphere s = sphere(TG(d), g.w);
+		if (dot(s.pos, s.pos) <= s.r * s.r) continue; // overlapping light
+		vec3 Li = vec3(spheres[i].light.x, spheres[i].light.y, spheres[i].light.z)
+		        / lightPdf;
+		float invSphereMagSqr = 1.f / dot(s.pos, s.pos);
+		vec3 capDir = s.pos * std::sqrt(invSphereMagSqr);
+		float capCos = std::sqrt(1.f - s.r * s.r * invSphereMagSqr);
+		cap c = cap(capDir, capCos);
+		cap c_std = mode == SHADING_MC_MIS_JOINT ? cap_to_pcap(c, p) : c;
+		bool joint = mode == SHADING_MC_MIS_JOINT && c.z < 0.99f;
+
+		// the joint estimator runs on batches of samples
+		if (joint) {
+			Lo+= Li * shadeJointMis(samples, firstSample, sampleCnt,
+			                        wo, alpha, c, c_std, p);
+			continue;
+		}
+
+		// loop over all samples
+		for (int j = firstSample; j < firstSample + sampleCnt; ++j) {
+			// compute a uniform sample
+			vec2 u2 = vec2(samples[j][0], samples[j][1]);
+
+			if (mode == SHADING_MC_MIS || mode == SHADING_MC_MIS_JOINT) {
+				// importance sample the BRDF
+				if (true) {
+					vec3 wm = ggx_sample(u2, wo, alpha.x, alpha.y);
+					vec3 wi = 2.f * wm * dot(wo, wm) - wo;
+					float pdf1;
+					float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, &pdf1);
+					float raySphereIntersection = pdf_cap(wi, c);
+
+					// raytrace the sphere light
+					if (pdf1 > 0.f && raySphereIntersection > 0.f) {
+						float pdf2 = raySphereIntersection;
+						float misWeight = pdf1 * pdf1;
+						float misNrm = pdf1 * pdf1 + pdf2 * pdf2;
+
+						Lo+= Li * (frp / pdf1 * misWeight / misNrm);
+					}
+				}
+
+				// importance sample the spherical cap
+				if (true) {
+					vec3 wi = u2_to_cap(u2, c);
+					float pdf1;
+					float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, &pdf1);
+					float pdf2 = pdf_cap(wi, c);
+
+					if (pdf2 > 0.f) {
+						float misWeight = pdf2 * pdf2;
+						float misNrm = pdf1 * pdf1 + pdf2 * pdf2;
+
+						Lo+= Li * (frp / pdf2 * misWeight / misNrm);
+					}
+				}
+			} else {
+				vec3 wi;
+				float pdf = 0.f;
+
+				switch (mode) {
+					case SHADING_MC_CAP:
+						wi = u2_to_cap(u2, c);
+						pdf = pdf_cap(wi, c);
+						break;
+					case SHADING_MC_COS:
+						wi = u2_to_cos(u2);
+						pdf = pdf_cos(wi);
+						break;
+					case SHADING_MC_H2:
+						wi = u2_to_h2(u2);
+						pdf = pdf_h2(wi);
+						break;
+					case SHADING_MC_S2:
+						wi = u2_to_s2(u2);
+						pdf = pdf_s2(wi);
+						break;
+					case SHADING_MC_GGX: {
+						vec3 wm = ggx_sample(u2, wo, alpha.x, alpha.y);
+						wi = 2.f * wm * dot(wo, wm) - wo;
+					} break;
+				}
+				float pdf_dummy;
+				float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, &pdf_dummy);
+				float raySphereIntersection = pdf_cap(wi, c);
+				if (mode == SHADING_MC_GGX)
+					pdf = pdf_dummy;
+
+				if (pdf > 0.f && raySphereIntersection > 0.f)
+					Lo+= Li * (frp / pdf);
+			}
+		}
+	}
+	#undef TG
+	Lo+= Le * (float)spp;
+
+	out[0] = Lo.x; out[1] = Lo.y; out[2] = Lo.z; out[3] = (float)spp;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Ray Casting
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+/**
+ * Intersect the Spheres
+ *
+ * Finds the closest sphere along a view-space ray that starts at the eye,
+ * among a list of candidate spheres. The visibility rules match those of
+ * the rasterizer: hits must lie within the [zNear, zFar] depth range, and
+ * back faces are culled.
+ */
+inline bool
+intersect(
+	const Scene& scene,
+	const int32_t *candidates,
+	int candidateCnt,
+	const vec3& dir,
+	float zNear, float zFar,
+	Fragment *frag
+) {
+	const SphereData *spheres = scene.spheres;
+	float depthMin = zFar;
+	int hitId = -1;
+
+	for (int k = 0; k < candidateCnt; ++k) {
+		int i = candidates[k];
+		vec3 c = vec3(spheres[i].geometry.x,
+		              spheres[i].geometry.y,
+		              spheres[i].geometry.z);
+		float r = spheres[i].geometry.w;
+		float a = pivot::dot(dir, dir);
+		float b = pivot::dot(dir, c);
+		float d = b * b - a * (pivot::dot(c, c) - r * r);
+
+		if (d < 0.f) continue;
+		float t = (b - std::sqrt(d)) / a; // front face
+		float depth = -t * dir.x;
+
+		if (depth >= zNear && depth <= depthMin) {
+			depthMin = depth;
+			hitId = i;
+			frag->pos = t * dir;
+		}
+	}
+
+	if (hitId < 0)
+		return false;
+
+	// compute the sphere parameterization and tangents in object space
+	const dja::mat4& mv = scene.transforms[hitId].modelView;
+	const dja::vec4& g = spheres[hitId].geometry;
+	vec3 nv = frag->pos - vec3(g.x, g.y, g.z);
+	vec3 no = pivot::normalize(vec3(
+		mv[0][0] * nv.x + mv[1][0] * nv.y + mv[2][0] * nv.z,
+		mv[0][1] * nv.x + mv[1][1] * nv.y + mv[2][1] * nv.z,
+		mv[0][2] * nv.x + mv[1][2] * nv.y + mv[2][2] * nv.z
+	));
+	float theta = std::acos(pivot::clamp(no.z, -1.f, 1.f));
+	float phi = std::atan2(no.y, no.x);
+	if (phi < 0.f) phi+= 2.f * (float)M_PI;
+	vec3 dpds = vec3(std::cos(theta) * std::cos(phi),
+	                 std::cos(theta) * std::sin(phi),
+	                 -std::sin(theta));
+	vec3 dpdt = vec3(-std::sin(phi), std::cos(phi), 0.f);
+
+	// transform the tangents to view space
+	#define MV(v) vec3(mv[0][0] * v.x + mv[0][1] * v.y + mv[0][2] * v.z, \
+	                   mv[1][0] * v.x + mv[1][1] * v.y + mv[1][2] * v.z, \
+	                   mv[2][0] * v.x + mv[2][1] * v.y + mv[2][2] * v.z)
+	frag->wx = MV(dpds);
+	frag->wy = MV(dpdt);
+	#undef MV
+	frag->texCoord = vec2(phi / (2.f * (float)M_PI), theta / (float)M_PI);
+	frag->sphereId = hitId;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tile Scheduling
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+/**
+ * Work-Stealing Tile Queue
+ *
+ * The framebuffer is cut into small square tiles, and each worker thread
+ * owns a deque of contiguous tile ranges. A worker pops tiles one at a time
+ * from the back of its own deque; once it runs dry, it steals the front
+ * half of the first range of another worker. Large ranges are thus split
+ * lazily, only when some thread runs out of work, which keeps scheduling
+ * overhead low while balancing the very uneven per-pixel shading costs.
+ */
+struct TileRange {
+	int begin, end;
+};
+
+struct alignas(64) TileQueue {
+	std::mutex mutex;
+	std::deque<TileRange> ranges;
+};
+
+// pop one tile from the back of the worker's own deque
+inline bool popTile(TileQueue *queue, int *tile)
+{
+	std::lock_guard<std::mutex> lock(queue->mutex);
+
+	if (queue->ranges.empty())
+		return false;
+	TileRange& r = queue->ranges.back();
+	*tile = --r.end;
+	if (r.begin == r.end)
+		queue->ranges.pop_back();
+
+	return true;
+}
+
+// steal the front half of the first range of a victim's deque
+inline bool stealTiles(TileQueue *victim, TileRange *stolen)
+{
+	std::lock_guard<std::mutex> lock(victim->mutex);
+
+	if (victim->ranges.empty())
+		return false;
+	TileRange& r = victim->ranges.front();
+	int mid = r.begin + (r.end - r.begin + 1) / 2;
+
+	stolen->begin = r.begin;
+	stolen->end = mid;
+	r.begin = mid;
+	if (r.begin == r.end)
+		victim->ranges.pop_front();
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Cull the Spheres against a Tile
+ *
+ * Lists the spheres that may be visible through the pixels [x0, x1) x
+ * [y0, y1). The test bounds the view frustum of the tile with a cone that
+ * passes through its corners, and keeps the spheres whose bounding cone
+ * overlaps it, so that the cost of ray casting grows with the number of
+ * spheres that cover each tile rather than with the size of the scene.
+ */
+inline void
+cullSpheres(
+	const Scene& scene,
+	int w, int h,
+	int x0, int y0, int x1, int y1,
+	std::vector<int32_t> *candidates
+) {
+	float aspect = (float)w / (float)h;
+	float f = 1.f / std::tan(radians(g_camera.fovy) / 2.f);
+	vec3 corners[4];
+	vec3 axis = vec3(0);
+	float cosMin = 1.f;
+
+	for (int i = 0; i < 4; ++i) {
+		float nx = 2.f * (float)(i & 1 ? x1 : x0) / (float)w - 1.f;
+		float ny = 2.f * (float)(i & 2 ? y1 : y0) / (float)h - 1.f;
+
+		corners[i] = pivot::normalize(vec3(-1.f, nx * aspect / f, ny / f));
+		axis+= corners[i];
+	}
+	axis = pivot::normalize(axis);
+	for (int i = 0; i < 4; ++i)
+		cosMin = std::min(cosMin, pivot::dot(axis, corners[i]));
+	float tileAngle = std::acos(pivot::clamp(cosMin, -1.f, 1.f));
+
+	candidates->resize(0);
+	for (int i = 0; i < scene.sphereCount; ++i) {
+		const dja::vec4& g = scene.spheres[i].geometry;
+		vec3 c = vec3(g.x, g.y, g.z);
+		float d = pivot::length(c);
+
+		if (d > g.w) {
+			float sphereAngle = std::asin(g.w / d);
+			float cosAxis = pivot::dot(axis, c) / d;
+			float angle = std::acos(pivot::clamp(cosAxis, -1.f, 1.f));
+
+			if (angle > tileAngle + sphereAngle)
+				continue;
+		}
+		candidates->push_back(i);
+	}
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Render a Pixel
+ *
+ * Casts one jittered primary ray per pass through the pixel and accumulates
+ * the shaded result into the framebuffer.
+ */
+struct PassData {
+	float rand[64][4]; // per-pass random numbers (same as the Random buffer)
+};
+
+// compute the uniform samples of a pixel for a pass (same as sample4() in
+// sphere.glsl)
+inline void
+generateSamples(
+	const Settings& settings,
+	const PassData& passData,
+	int pass,
+	const vec2& fragCoord,
+	float samples[][4]
+) {
+	uint32_t seed = sampler_seed((uint32_t)fragCoord.x, (uint32_t)fragCoord.y);
+	uint32_t offset = (uint32_t)(pass * settings.samplesPerPass);
+	float h1 = hash(fragCoord);
+	float h2 = hash(vec2(fragCoord.y, fragCoord.x));
+
+	for (int j = 0; j < settings.samplesPerPass; ++j) {
+		switch (settings.sampler) {
+			case SAMPLER_SOBOL:
+				sampler_sobol(offset + j, seed, samples[j]);
+				break;
+			case SAMPLER_LATTICE:
+				sampler_lattice(offset + j, seed, samples[j]);
+				break;
+			default:
+				samples[j][0] = fract(h1 + passData.rand[j][0]);
+				samples[j][1] = fract(h2 + passData.rand[j][1]);
+				samples[j][2] = fract(h1 + passData.rand[j][2]);
+				samples[j][3] = fract(h2 + passData.rand[j][3]);
+				break;
+		}
+	}
+}
+
+inline void
+renderPixel(
+	const Settings& settings,
+	const Scene& scene,
+	const int32_t *candidates,
+	int candidateCnt,
+	int x, int y,
+	int pass,
+	const PassData& passData,
+	Framebuffer *fb
+) {
+	float aspect = (float)fb->w / (float)fb->h;
+	float f = 1.f / std::tan(radians(g_camera.fovy) / 2.f);
+	uint32_t seed = hash32((uint32_t)(y * fb->w + x) ^ hash32(pass));
+	float jx = u01(seed), jy = u01(hash32(seed));
+	float nx = 2.f * ((float)x + jx) / (float)fb->w - 1.f;
+	float ny = 2.f * ((float)y + jy) / (float)fb->h - 1.f;
+	vec3 dir = vec3(-1.f, nx * aspect / f, ny / f);
+	float *rgba = &fb->rgba[4 * (y * fb->w + x)];
+	Fragment frag;
+	float c[4];
+
+	if (intersect(scene, candidates, candidateCnt, dir,
+	              g_camera.zNear, g_camera.zFar, &frag)) {
+		Scene lights = scene;
+
+		// fetch the lights of the cluster
+		if (scene.clusters) {
+			const LightClusters& clusters = *scene.clusters;
+			int cluster = lightClusterIndex(clusters, x, y, -frag.pos.x);
+			const int32_t *range = &clusters.ranges[2 * cluster];
+
+			lights.lightIds = clusters.lightIds.data() + range[0];
+			lights.lightCount = range[1];
+		}
+		float samples[64][4];
+
+		frag.fragCoord = vec2((float)x + 0.5f, (float)y + 0.5f);
+		generateSamples(settings, passData, pass, frag.fragCoord, samples);
+		shade(settings, lights, samples, frag, c);
+	} else {
+		c[0] = settings.clearColor.r;
+		c[1] = settings.clearColor.g;
+		c[2] = settings.clearColor.b;
+		c[3] = 1.f;
+	}
+	for (int i = 0; i < 4; ++i)
+		rgba[i]+= c[i];
+
+	// moments of the luminance of the pass estimate
+	float *moments = &fb->moments[3 * (y * fb->w + x)];
+	float Y = (0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2]) / c[3];
+
+	moments[0]+= Y;
+	moments[1]+= Y * Y;
+	moments[2]+= 1.f;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Check the Convergence of a Tile
+ *
+ * A pixel has converged once the standard error of its mean luminance falls
+ * below a fraction of the mean (clamped to an absolute floor so that dark
+ * pixels converge too); a tile has converged once all its pixels have.
+ * Same as variance.glsl.
+ */
+inline bool
+tileConverged(
+	const Settings& settings,
+	const Framebuffer& fb,
+	int x0, int y0, int x1, int y1
+) {
+	for (int y = y0; y < y1; ++y)
+	for (int x = x0; x < x1; ++x) {
+		const float *moments = &fb.moments[3 * (y * fb.w + x)];
+		float n = moments[2];
+
+		if (n < (float)settings.adaptive.minPassCount)
+			return false;
+
+		float mean = moments[0] / n;
+		float var = std::max(0.f, moments[1] / n - mean * mean);
+		float error = std::sqrt(var / n);
+
+		if (error > settings.adaptive.threshold * std::max(mean, 1e-2f))
+			return false;
+	}
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Render Passes
+ *
+ * Renders passCnt progressive passes of the scene, starting at pass
+ * firstPass, and accumulates them into the framebuffer. The pass index seeds
+ * the random numbers, so that consecutive passes produce independent
+ * samples. Each tile is rendered for all passes at once by a single thread,
+ * so that the threads only synchronize when they fetch new tiles. With
+ * adaptive sampling, a tile stops receiving passes once it has converged.
+ */
+inline void
+render(
+	const Settings& settings,
+	const Scene& scene,
+	int firstPass,
+	int passCnt,
+	Framebuffer *fb
+) {
+	int threadCount = settings.threadCount > 0 ? settings.threadCount : 1;
+	int tileSize = settings.tileSize > 0 ? settings.tileSize : 16;
+	int xTiles = (fb->w + tileSize - 1) / tileSize;
+	int yTiles = (fb->h + tileSize - 1) / tileSize;
+	int tileCnt = xTiles * yTiles;
+	std::vector<PassData> passData(passCnt);
+	std::vector<TileQueue> queues(threadCount);
+	std::vector<std::thread> threads;
+
+	// per-pass random numbers
+	for (int k = 0; k < passCnt; ++k) {
+		Random rng((uint32_t)(firstPass + k));
+
+		for (int i = 0; i < 64; ++i)
+		for (int j = 0; j < 4; ++j)
+			passData[k].rand[i][j] = rng.nextf();
+	}
+
+	// distribute contiguous tile ranges to the workers
+	for (int i = 0; i < threadCount; ++i) {
+		TileRange r = {
+			(int)((int64_t)tileCnt * i / threadCount),
+			(int)((int64_t)tileCnt * (i + 1) / threadCount)
+		};
+
+		if (r.begin < r.end)
+			queues[i].ranges.push_back(r);
+	}
+
+	// render
+	for (int tid = 0; tid < threadCount; ++tid) {
+		threads.push_back(std::thread([&, tid]() {
+			TileQueue *queue = &queues[tid];
+			std::vector<int32_t> candidates;
+			int tile;
+
+			for (;;) {
+				if (!popTile(queue, &tile)) {
+					TileRange stolen;
+					bool found = false;
+
+					for (int i = 1; i < threadCount && !found; ++i)
+						found = stealTiles(&queues[(tid + i) % threadCount],
+						                   &stolen);
+					if (!found)
+						break;
+					std::lock_guard<std::mutex> lock(queue->mutex);
+					queue->ranges.push_back(stolen);
+					continue;
+				}
+
+				int x0 = (tile % xTiles) * tileSize;
+				int y0 = (tile / xTiles) * tileSize;
+				int x1 = std::min(x0 + tileSize, fb->w);
+				int y1 = std::min(y0 + tileSize, fb->h);
+
+				cullSpheres(scene, fb->w, fb->h, x0, y0, x1, y1, &candidates);
+				for (int k = 0; k < passCnt; ++k) {
+					if (settings.adaptive.threshold > 0.f
+					    && tileConverged(settings, *fb, x0, y0, x1, y1))
+						break;
+
+					for (int y = y0; y < y1; ++y)
+					for (int x = x0; x < x1; ++x)
+						renderPixel(settings, scene,
+						            candidates.data(), (int)candidates.size(),
+						            x, y, firstPass + k, passData[k], fb);
+				}
+			}
+		}));
+	}
+	for (int i = 0; i < (int)threads.size(); ++i)
+		threads[i].join();
+}
+
+// -----------------------------------------------------------------------------
+// render a single pass
+inline void
+renderPass(
+	const Settings& settings,
+	const Scene& scene,
+	int pass,
+	Framebuffer *fb
+) {
+	render(settings, scene, pass, 1, fb);
+}
+
+// -----------------------------------------------------------------------------
+// clear the framebuffer
+inline void clear(Framebuffer *fb, int w, int h)
+{
+	fb->w = w;
+	fb->h = h;
+	fb->rgba.assign(4 * w * h, 0.f);
+	fb->moments.assign(3 * w * h, 0.f);
+}
+
+// -----------------------------------------------------------------------------
+// normalize the accumulated radiance by the number of samples
+inline void resolve(const Framebuffer& fb, std::vector<float> *rgb)
+{
+	rgb->resize(3 * fb.w * fb.h);
+	for (int i = 0; i < fb.w * fb.h; ++i) {
+		float a = fb.rgba[4 * i + 3];
+		float nrm = a > 0.f ? 1.f / a : 0.f;
+
+		for (int j = 0; j < 3; ++j)
+			(*rgb)[3 * i + j] = fb.rgba[4 * i + j] * nrm;
+	}
+}
+
+} // namespace cpu
+
+#endif // CPU_RENDERER_H
+
@@ -12,6 +12,13 @@
    define DJG_LOG(format, ...) to use your own logger (default prints in stdout)
    define DJG_MALLOC(x) to use your own memory allocator
    define DJG_FREE(x) to use your own memory deallocator
+   define DJG_IMAGE_LOAD(filename, x, y, comp, req_comp) to decode images
+   with your own loader, e.g., one backed by a faster inflate (default uses
+   stbi_load); the texels it returns are released with DJG_FREE
+   define DJG_THREAD_COUNT to set the number of threads that decode images
+   in djgt_push_images and build MIP chains in djgt_create_mipmaps (default
+   is 4, and 1 runs everything on the calling thread)
+   define DJG_NO_SIMD to filter MIP chains without SSE2
 
 */
 #ifndef DJG_INCLUDE_DJ_OPENGL_H
@@ -50,6 +57,37 @@ DJGDEF void djgc_start(djg_clock *clock);
 DJGDEF void djgc_stop(djg_clock *clock);
 DJGDEF void djgc_ticks(djg_clock *clock, double *cpu, double *gpu);
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// Profiler API - Time nested scopes of a frame on the CPU and GPU
+//    NOTE: GPU timings are read a few frames late, and never stall
+//
+
+typedef struct djg_profiler djg_profiler;
+
+typedef struct djgq_stats {
+	const char *name; // scope name
+	int depth;        // nesting depth of the scope
+	int cpu_cnt;      // number of frames in the CPU statistics
+	int gpu_cnt;      // number of frames in the GPU statistics
+	double cpu_min, cpu_mean, cpu_p99; // CPU time, in seconds
+	double gpu_min, gpu_mean, gpu_p99; // GPU time, in seconds
+} djgq_stats;
+
+DJGDEF djg_profiler *djgq_create(void);
+DJGDEF void djgq_release(djg_profiler *profiler);
+
+DJGDEF void djgq_begin_frame(djg_profiler *profiler);
+DJGDEF void djgq_end_frame(djg_profiler *profiler);
+DJGDEF void djgq_push(djg_profiler *profiler, const char *name);
+DJGDEF void djgq_pop(djg_profiler *profiler);
+
+DJGDEF int djgq_scope_count(const djg_profiler *profiler);
+DJGDEF void djgq_scope_stats(const djg_profiler *profiler,
+                             int scope,
+                             djgq_stats *stats);
+DJGDEF bool djgq_save_csv(const djg_profiler *profiler, const char *filename);
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Program API - Load OpenGL programs quickly
@@ -72,11 +110,16 @@ DJGDEF bool djgp_gl_upload(const djg_program *program,
 //////////////////////////////////////////////////////////////////////////////
 //
 // Stream Buffer API - Stream data into a buffer asynchronously
+//    NOTE: persistent buffers are mapped once and for all, and streamed
+//    into with plain writes; they require GL4.4 or ARB_buffer_storage
 //
 
 typedef struct djg_buffer djg_buffer;
 
 DJGDEF djg_buffer *djgb_create(int data_size);
+#ifdef GL_ARB_buffer_storage
+DJGDEF djg_buffer *djgb_create_persistent(int data_size);
+#endif // GL_ARB_buffer_storage
 DJGDEF void djgb_release(djg_buffer *buffer);
 
 DJGDEF bool djgb_gl_upload(djg_buffer *buffer, const void *data, int *offset);
@@ -102,6 +145,13 @@ DJGDEF void djgt_release(djg_texture *texture);
 DJGDEF bool djgt_push_image(djg_texture *texture,
                             const char *filename,
                             bool flipy);
+// decodes the images in parallel and pushes them in order; if not NULL,
+// seconds receives the time spent decoding each image
+DJGDEF bool djgt_push_images(djg_texture *texture,
+                             const char **filenames,
+                             int count,
+                             bool flipy,
+                             double *seconds);
 #ifndef STBI_NO_HDR
 DJGDEF bool djgt_push_hdrimage(djg_texture *texture,
                                const char *filename,
@@ -127,6 +177,40 @@ DJGDEF bool djgt_gl_upload(const djg_texture *texture,
                            bool mipmap,
                            GLuint *gl);
 
+// CPU MIP chain of the first image of a texture: the result holds one image
+// per level, starting with a copy of the base level, and is deterministic;
+// srgb filters the color components of 8-bit images in linear space
+DJGDEF djg_texture *djgt_create_mipmaps(const djg_texture *texture, bool srgb);
+DJGDEF bool djgt_gl_upload_mipmaps(const djg_texture *mipmaps,
+                                   GLint internalformat,
+                                   GLuint *gl);
+
+// texels of the i-th image of a texture (e.g., a MIP level), for CPU use;
+// they hold floats for HDR images and bytes otherwise
+DJGDEF const void *djgt_get_texels(const djg_texture *texture,
+                                   int i,
+                                   int *x, int *y, int *comp);
+
+// asynchronous 2D texture loading: the image is decoded and its MIP chain
+// built (see djgt_create_mipmaps; sRGB internal formats filter in linear
+// space) on a worker thread, and each call to djgt_stream_update uploads
+// about max_bytes of texels through a pixel unpack buffer; once the status
+// is DJGT_STREAM_READY, gl receives the complete texture, which the caller
+// then owns
+typedef struct djg_texture_stream djg_texture_stream;
+
+enum {DJGT_STREAM_LOADING, DJGT_STREAM_READY, DJGT_STREAM_FAILED};
+
+DJGDEF djg_texture_stream *djgt_stream_create(const char *filename,
+                                              int req_comp,
+                                              GLint internalformat,
+                                              bool flipy);
+DJGDEF void djgt_stream_release(djg_texture_stream *stream);
+
+DJGDEF int djgt_stream_update(djg_texture_stream *stream,
+                              int max_bytes,
+                              GLuint *gl);
+
 #endif // STBI_INCLUDE_STB_IMAGE_H
 
 //////////////////////////////////////////////////////////////////////////////
@@ -156,6 +240,8 @@ DJGDEF bool djgt_save_glcolorbuffer_png(GLenum glbuffer,
 //////////////////////////////////////////////////////////////////////////////
 //
 // Mesh API - Create meshed parametric surfaces
+//    NOTE: meshes store 16-bit indexes when they have fewer than 2^16
+//    vertices, and 32-bit indexes otherwise (see djgm_get_index_type)
 //
 
 typedef struct djg_mesh djg_mesh;
@@ -179,11 +265,18 @@ DJGDEF djg_mesh *djgm_load_cylinder(float radius, float height,
 DJGDEF djg_mesh *djgm_load_torus(float ring_radius, int ring_segments,
                                  float pipe_radius, int pipe_segments);
 
-// accessors
+// accessors (the 16-bit and 32-bit variants return NULL on a width mismatch)
+DJGDEF GLenum djgm_get_index_type(const djg_mesh *mesh);
 DJGDEF const uint16_t *djgm_get_triangles(const djg_mesh *mesh, GLint *count);
 DJGDEF const uint16_t *djgm_get_quads(const djg_mesh *mesh, GLint *count);
+DJGDEF const uint32_t *djgm_get_triangles32(const djg_mesh *mesh, GLint *count);
+DJGDEF const uint32_t *djgm_get_quads32(const djg_mesh *mesh, GLint *count);
 DJGDEF const djgm_vertex *djgm_get_vertices(const djg_mesh *mesh, GLint *count);
 
+// optimizations
+DJGDEF bool djgm_optimize(djg_mesh *mesh);
+DJGDEF float djgm_acmr(const djg_mesh *mesh, int cache_size);
+
 // exports
 DJGDEF bool djgm_export_obj_triangles(const djg_mesh *mesh, const char *filename);
 DJGDEF bool djgm_export_obj_quads(const djg_mesh *mesh, const char *filename);
@@ -234,6 +327,7 @@ DJGDEF bool djgf_print_fast(djg_font *font,
 #include <stdarg.h>     /* va_list, va_start, va_arg, va_end */
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>     /* qsort */
 #include <string.h>
 #include <math.h>
 
@@ -437,6 +531,296 @@ DJGDEF void djgc_ticks(djg_clock *clock, double *tcpu, double *tgpu)
 	if (tgpu) *tgpu = clock->gpu_ticks;
 }
 
+// *************************************************************************************************
+// Profiler API Implementation
+
+/*
+Each frame records its GPU timestamps in a slot of a ring of query pools.
+The results of a slot are read back once they are available, which takes
+a few frames; if the ring comes back to a slot that is not ready yet, the
+frame is not timed on the GPU, rather than waiting for the results. The
+timings of a scope that is entered several times in a frame are summed,
+and the statistics are computed over the last DJGQ__HISTORY frames.
+*/
+#define DJGQ__FRAME_CNT 4
+#define DJGQ__SCOPE_MAX 32
+#define DJGQ__DEPTH_MAX 16
+#define DJGQ__QUERY_MAX 256
+#define DJGQ__HISTORY 128
+
+enum {DJGQ__SLOT_FREE, DJGQ__SLOT_RECORDING, DJGQ__SLOT_PENDING};
+
+typedef struct djgq__slot {
+	GLuint queries[DJGQ__QUERY_MAX];      // start/stop timestamp pairs
+	int scopes[DJGQ__QUERY_MAX / 2];      // scope of each pair
+	int query_cnt;
+	int state;
+} djgq__slot;
+
+typedef struct djgq__scope {
+	char name[64];
+	int depth;
+	double cpu[DJGQ__HISTORY], gpu[DJGQ__HISTORY];
+	int cpu_cnt, gpu_cnt; // number of samples (they wrap around the history)
+	double cpu_frame;     // CPU time of the current frame
+	int is_active;        // entered during the current frame
+} djgq__scope;
+
+typedef struct djg_profiler {
+	djgq__slot slots[DJGQ__FRAME_CNT];
+	djgq__scope scopes[DJGQ__SCOPE_MAX];
+	int scope_cnt;
+	int slot;          // slot of the current frame
+	struct {
+		int scope, query;  // query is -1 if the scope is not timed on the GPU
+		GLint64 cpu_start;
+	} stack[DJGQ__DEPTH_MAX];
+	int depth;
+} djg_profiler;
+
+DJGDEF djg_profiler *djgq_create(void)
+{
+	djg_profiler *profiler = (djg_profiler *)DJG_MALLOC(sizeof(*profiler));
+	int i;
+
+	memset(profiler, 0, sizeof(*profiler));
+	for (i = 0; i < DJGQ__FRAME_CNT; ++i)
+		glGenQueries(DJGQ__QUERY_MAX, profiler->slots[i].queries);
+	profiler->slot = DJGQ__FRAME_CNT - 1;
+
+	return profiler;
+}
+
+DJGDEF void djgq_release(djg_profiler *profiler)
+{
+	int i;
+
+	DJG_ASSERT(profiler);
+	for (i = 0; i < DJGQ__FRAME_CNT; ++i)
+		glDeleteQueries(DJGQ__QUERY_MAX, profiler->slots[i].queries);
+	DJG_FREE(profiler);
+}
+
+static void djgq__record(double *history, int *cnt, double value)
+{
+	history[(*cnt) % DJGQ__HISTORY] = value;
+	++(*cnt);
+}
+
+// read back the timestamps of the pending slots whose results are available
+static void djgq__collect(djg_profiler *profiler)
+{
+	int i, j;
+
+	for (i = 0; i < DJGQ__FRAME_CNT; ++i) {
+		djgq__slot *slot = &profiler->slots[i];
+		double gpu[DJGQ__SCOPE_MAX];
+		int is_timed[DJGQ__SCOPE_MAX];
+		GLint is_ready = GL_TRUE;
+
+		if (slot->state != DJGQ__SLOT_PENDING)
+			continue;
+		// timestamps complete in order, so the last one tells for the slot
+		if (slot->query_cnt > 0)
+			glGetQueryObjectiv(slot->queries[slot->query_cnt - 1],
+			                   GL_QUERY_RESULT_AVAILABLE,
+			                   &is_ready);
+		if (!is_ready)
+			continue;
+
+		memset(gpu, 0, sizeof(gpu));
+		memset(is_timed, 0, sizeof(is_timed));
+		for (j = 0; j < slot->query_cnt; j+= 2) {
+			GLuint64 start, stop;
+			int scope = slot->scopes[j / 2];
+
+			glGetQueryObjectui64v(slot->queries[j], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(slot->queries[j + 1], GL_QUERY_RESULT, &stop);
+			gpu[scope]+= (stop - start) / 1e9;
+			is_timed[scope] = 1;
+		}
+		for (j = 0; j < profiler->scope_cnt; ++j) {
+			djgq__scope *scope = &profiler->scopes[j];
+
+			if (is_timed[j])
+				djgq__record(scope->gpu, &scope->gpu_cnt, gpu[j]);
+		}
+		slot->state = DJGQ__SLOT_FREE;
+	}
+}
+
+DJGDEF void djgq_begin_frame(djg_profiler *profiler)
+{
+	djgq__slot *slot;
+	int i;
+
+	DJG_ASSERT(profiler && profiler->depth == 0);
+	djgq__collect(profiler);
+	profiler->slot = (profiler->slot + 1) % DJGQ__FRAME_CNT;
+	slot = &profiler->slots[profiler->slot];
+	if (slot->state == DJGQ__SLOT_FREE) {
+		slot->state = DJGQ__SLOT_RECORDING;
+		slot->query_cnt = 0;
+	}
+	for (i = 0; i < profiler->scope_cnt; ++i) {
+		profiler->scopes[i].cpu_frame = 0.0;
+		profiler->scopes[i].is_active = 0;
+	}
+}
+
+DJGDEF void djgq_end_frame(djg_profiler *profiler)
+{
+	djgq__slot *slot = &profiler->slots[profiler->slot];
+	int i;
+
+	DJG_ASSERT(profiler->depth == 0);
+	if (slot->state == DJGQ__SLOT_RECORDING)
+		slot->state = DJGQ__SLOT_PENDING;
+	for (i = 0; i < profiler->scope_cnt; ++i) {
+		djgq__scope *scope = &profiler->scopes[i];
+
+		if (scope->is_active)
+			djgq__record(scope->cpu, &scope->cpu_cnt, scope->cpu_frame);
+	}
+}
+
+static int djgq__find_scope(djg_profiler *profiler, const char *name)
+{
+	djgq__scope *scope;
+	int i;
+
+	for (i = 0; i < profiler->scope_cnt; ++i)
+		if (!strcmp(profiler->scopes[i].name, name))
+			return i;
+	if (profiler->scope_cnt == DJGQ__SCOPE_MAX) {
+		DJG_LOG("djg_error: Too many profiler scopes\n");
+		return -1;
+	}
+	scope = &profiler->scopes[profiler->scope_cnt];
+	strncpy(scope->name, name, sizeof(scope->name) - 1);
+	scope->depth = profiler->depth;
+
+	return profiler->scope_cnt++;
+}
+
+DJGDEF void djgq_push(djg_profiler *profiler, const char *name)
+{
+	djgq__slot *slot = &profiler->slots[profiler->slot];
+	int scope, query = -1;
+
+	DJG_ASSERT(profiler->depth < DJGQ__DEPTH_MAX);
+	scope = djgq__find_scope(profiler, name);
+	if (scope >= 0 && slot->state == DJGQ__SLOT_RECORDING
+	&& slot->query_cnt + 2 <= DJGQ__QUERY_MAX) {
+		query = slot->query_cnt;
+		slot->scopes[query / 2] = scope;
+		slot->query_cnt+= 2;
+		glQueryCounter(slot->queries[query], GL_TIMESTAMP);
+	}
+	profiler->stack[profiler->depth].scope = scope;
+	profiler->stack[profiler->depth].query = query;
+	glGetInteger64v(GL_TIMESTAMP, &profiler->stack[profiler->depth].cpu_start);
+	++profiler->depth;
+}
+
+DJGDEF void djgq_pop(djg_profiler *profiler)
+{
+	djgq__slot *slot = &profiler->slots[profiler->slot];
+	GLint64 now = 0;
+	int scope, query;
+
+	DJG_ASSERT(profiler->depth > 0);
+	--profiler->depth;
+	scope = profiler->stack[profiler->depth].scope;
+	query = profiler->stack[profiler->depth].query;
+	glGetInteger64v(GL_TIMESTAMP, &now);
+	if (scope >= 0) {
+		profiler->scopes[scope].cpu_frame+=
+			(now - profiler->stack[profiler->depth].cpu_start) / 1e9;
+		profiler->scopes[scope].is_active = 1;
+	}
+	if (query >= 0)
+		glQueryCounter(slot->queries[query + 1], GL_TIMESTAMP);
+}
+
+DJGDEF int djgq_scope_count(const djg_profiler *profiler)
+{
+	return profiler->scope_cnt;
+}
+
+static int djgq__cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+// min, mean and 99th percentile of the last samples of a history
+static void
+djgq__stats(
+	const double *history, int cnt,
+	double *min, double *mean, double *p99
+) {
+	double sorted[DJGQ__HISTORY], sum = 0.0;
+	int i, n = cnt < DJGQ__HISTORY ? cnt : DJGQ__HISTORY;
+
+	if (n == 0) {
+		(*min) = (*mean) = (*p99) = 0.0;
+		return;
+	}
+	memcpy(sorted, history, sizeof(double) * n);
+	qsort(sorted, n, sizeof(double), &djgq__cmp);
+	for (i = 0; i < n; ++i)
+		sum+= sorted[i];
+	(*min) = sorted[0];
+	(*mean) = sum / n;
+	(*p99) = sorted[(int)ceil(0.99 * n) - 1];
+}
+
+DJGDEF void djgq_scope_stats(const djg_profiler *profiler,
+                             int scope,
+                             djgq_stats *stats)
+{
+	const djgq__scope *s;
+
+	DJG_ASSERT(scope >= 0 && scope < profiler->scope_cnt);
+	s = &profiler->scopes[scope];
+	stats->name = s->name;
+	stats->depth = s->depth;
+	stats->cpu_cnt = s->cpu_cnt < DJGQ__HISTORY ? s->cpu_cnt : DJGQ__HISTORY;
+	stats->gpu_cnt = s->gpu_cnt < DJGQ__HISTORY ? s->gpu_cnt : DJGQ__HISTORY;
+	djgq__stats(s->cpu, s->cpu_cnt,
+	            &stats->cpu_min, &stats->cpu_mean, &stats->cpu_p99);
+	djgq__stats(s->gpu, s->gpu_cnt,
+	            &stats->gpu_min, &stats->gpu_mean, &stats->gpu_p99);
+}
+
+DJGDEF bool djgq_save_csv(const djg_profiler *profiler, const char *filename)
+{
+	FILE *pf = fopen(filename, "w");
+	int i;
+
+	if (!pf) {
+		DJG_LOG("djg_error: fopen failed\n");
+		return false;
+	}
+	fprintf(pf, "scope,depth,cpu_samples,gpu_samples,"
+	            "cpu_min_ms,cpu_mean_ms,cpu_p99_ms,"
+	            "gpu_min_ms,gpu_mean_ms,gpu_p99_ms\n");
+	for (i = 0; i < profiler->scope_cnt; ++i) {
+		djgq_stats stats;
+
+		djgq_scope_stats(profiler, i, &stats);
+		fprintf(pf, "%s,%i,%i,%i,%f,%f,%f,%f,%f,%f\n",
+		        stats.name, stats.depth, stats.cpu_cnt, stats.gpu_cnt,
+		        stats.cpu_min * 1e3, stats.cpu_mean * 1e3, stats.cpu_p99 * 1e3,
+		        stats.gpu_min * 1e3, stats.gpu_mean * 1e3, stats.gpu_p99 * 1e3);
+	}
+	fclose(pf);
+
+	return true;
+}
+
 // *************************************************************************************************
 // Program API Implementation
 
@@ -724,34 +1108,141 @@ typedef struct djg_buffer {
 	int capacity; // total buffer capacity
 	int size;     // size of streamed data
 	int offset;   // current offset inside the buffer
+	char *ptr;       // persistent mapping (NULL if the buffer is orphaned)
+	GLsync *fences;  // one fence per region of the persistent mapping
+	int region;      // last region written to the persistent mapping
 } djg_buffer;
 
+// offsets must satisfy the largest GL_*_BUFFER_OFFSET_ALIGNMENT allowed by GL
+#define DJGB__ALIGNMENT 256
+#define DJGB__ALIGN(x) (((x) + DJGB__ALIGNMENT - 1) & ~(DJGB__ALIGNMENT - 1))
+
 DJGDEF djg_buffer *djgb_create(int data_size)
 {
-	const int buf_capacity = (1 << 20); // capacity in Bytes
+	int buf_capacity = (1 << 20); // capacity in Bytes
 	djg_buffer *buffer = (djg_buffer*)DJG_MALLOC(sizeof(*buffer));
 
-	DJG_ASSERT(data_size > 0 && buf_capacity > 8 * data_size);
+	DJG_ASSERT(data_size > 0);
+	// grow the capacity to hold at least 8 aligned chunks of data
+	while (buf_capacity < 8 * DJGB__ALIGN(data_size))
+		buf_capacity*= 2;
 	glGenBuffers(1, &buffer->gl);
 	buffer->capacity = buf_capacity;
 	buffer->size = data_size;
 	buffer->offset = buffer->capacity;
+	buffer->ptr = NULL;
+	buffer->fences = NULL;
+	buffer->region = -1;
+
+	return buffer;
+}
+
+#ifdef GL_ARB_buffer_storage
+DJGDEF djg_buffer *djgb_create_persistent(int data_size)
+{
+	djg_buffer *buffer = djgb_create(data_size);
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+	                 | GL_MAP_COHERENT_BIT;
+	int region_cnt = buffer->capacity / DJGB__ALIGN(data_size);
+	GLint buf = 0;
+
+	// allocate immutable GL memory and map it once and for all
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &buf);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer->gl);
+	glBufferStorage(GL_ARRAY_BUFFER, buffer->capacity, NULL, flags);
+	buffer->ptr = (char *)glMapBufferRange(GL_ARRAY_BUFFER,
+	                                       0, buffer->capacity,
+	                                       flags);
+	glBindBuffer(GL_ARRAY_BUFFER, buf);
+	if (!buffer->ptr) {
+		DJG_LOG("djg_error: Persistent buffer mapping failed\n");
+		djgb_release(buffer);
+
+		return NULL;
+	}
+	buffer->fences = (GLsync *)DJG_MALLOC(sizeof(GLsync) * region_cnt);
+	memset(buffer->fences, 0, sizeof(GLsync) * region_cnt);
 
 	return buffer;
 }
+#endif // GL_ARB_buffer_storage
 
 DJGDEF void djgb_release(djg_buffer *buffer)
 {
 	DJG_ASSERT(buffer);
-	glDeleteBuffers(1, &buffer->gl);
+	if (buffer->fences) {
+		int i, region_cnt = buffer->capacity / DJGB__ALIGN(buffer->size);
+
+		for (i = 0; i < region_cnt; ++i)
+			if (buffer->fences[i]) glDeleteSync(buffer->fences[i]);
+		DJG_FREE(buffer->fences);
+	}
+	glDeleteBuffers(1, &buffer->gl); // also unmaps the buffer
 	DJG_FREE(buffer);
 }
 
+/*
+Persistent buffers are split into regions of one aligned chunk of data,
+which are written in a ring. The GL may still read a region when the ring
+comes back to it, so each region gets a fence, which is inserted once the
+next region is written (at which point the commands that read the region
+have been issued), and waited on before the region gets overwritten. The
+ring holds at least 8 regions, so the wait is usually a no-op.
+*/
+static bool djgb__upload_persistent(djg_buffer *buffer, const void *data, int *offset)
+{
+	int region_size = DJGB__ALIGN(buffer->size);
+	int region;
+
+	if (buffer->offset + buffer->size > buffer->capacity)
+		buffer->offset = 0;
+	region = buffer->offset / region_size;
+
+	// fence the previous region
+	if (buffer->region >= 0)
+		buffer->fences[buffer->region] =
+			glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// wait until the GL is done reading the current region
+	if (buffer->fences[region]) {
+		GLenum status = glClientWaitSync(buffer->fences[region],
+		                                 GL_SYNC_FLUSH_COMMANDS_BIT,
+		                                 0);
+
+		while (status == GL_TIMEOUT_EXPIRED) {
+#ifndef NDEBUG
+			DJG_LOG("djg_debug: Waiting for a persistent buffer region\n");
+#endif
+			status = glClientWaitSync(buffer->fences[region], 0, 1000000);
+		}
+		glDeleteSync(buffer->fences[region]);
+		buffer->fences[region] = 0;
+		if (status == GL_WAIT_FAILED) {
+			DJG_LOG("djg_error: Buffer synchronization failed\n");
+
+			return false;
+		}
+	}
+
+	// stream data with a plain write (the mapping is coherent)
+	memcpy(buffer->ptr + buffer->offset, data, buffer->size);
+
+	// update buffer offset
+	if (offset) (*offset) = buffer->offset;
+	buffer->region = region;
+	buffer->offset+= region_size;
+
+	return true;
+}
+
 DJGDEF bool djgb_gl_upload(djg_buffer *buffer, const void *data, int *offset)
 {
 	GLint buf = 0;
 	void *ptr = NULL;
 
+	if (buffer->ptr)
+		return djgb__upload_persistent(buffer, data, offset);
+
 	// save GL state
 	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &buf);
 
@@ -785,14 +1276,14 @@ DJGDEF bool djgb_gl_upload(djg_buffer *buffer, const void *data, int *offset)
 
 	// update buffer offset
 	if (offset) (*offset) = buffer->offset;
-	buffer->offset+= buffer->size;
+	buffer->offset+= DJGB__ALIGN(buffer->size);
 
 	return true;
 }
 
-DJGDEF void djgb_glbindrange(djg_buffer *buffer, GLenum target, GLuint index)
+DJGDEF void djgb_glbindrange(const djg_buffer *buffer, GLenum target, GLuint index)
 {
-	int offset = buffer->offset - buffer->size;
+	int offset = buffer->offset - DJGB__ALIGN(buffer->size);
 	glBindBufferRange(target, index, buffer->gl, offset, buffer->size);
 }
 
@@ -806,6 +1297,26 @@ DJGDEF void djgb_glbind(const djg_buffer *buffer, GLenum target)
 
 #ifdef STBI_INCLUDE_STB_IMAGE_H
 
+#ifndef DJG_IMAGE_LOAD
+#	define DJG_IMAGE_LOAD(filename, x, y, comp, req_comp) \
+		stbi_load(filename, x, y, comp, req_comp)
+#endif
+
+#ifndef DJG_THREAD_COUNT
+#	define DJG_THREAD_COUNT 4
+#endif
+
+#if DJG_THREAD_COUNT > 1
+#	ifdef _WIN32
+#		include <windows.h>
+#	else
+#		include <pthread.h>
+#	endif
+#endif
+#ifndef _WIN32
+#	include <time.h>
+#endif
+
 typedef struct djg_texture {
 	struct djg_texture *next;
 	char *texels;   // pixel data
@@ -814,18 +1325,18 @@ typedef struct djg_texture {
 
 static void djgt__flipy(djg_texture *texture)
 {
-	int x, y, bpp = texture->comp * (texture->hdr ? 4 : 1);
+	int y, stride = texture->x * texture->comp * (texture->hdr ? 4 : 1);
+	char *tmp = (char *)DJG_MALLOC(stride);
 
-	for (x = 0; x < texture->x; ++x)
 	for (y = 0; y < texture->y / 2; ++y) {
-		char *tx1 = &texture->texels[bpp * (texture->x * y + x)];
-		char *tx2 = &texture->texels[bpp * (texture->x * (texture->y - 1 - y) + x)];
-		char tmp[64];
+		char *row1 = &texture->texels[stride * y];
+		char *row2 = &texture->texels[stride * (texture->y - 1 - y)];
 
-		memcpy(tmp, tx1, bpp);
-		memcpy(tx1, tx2, bpp);
-		memcpy(tx2, tmp, bpp);
+		memcpy(tmp, row1, stride);
+		memcpy(row1, row2, stride);
+		memcpy(row2, tmp, stride);
 	}
+	DJG_FREE(tmp);
 }
 
 static bool
@@ -888,7 +1399,7 @@ djgt_push_image(djg_texture *texture, const char *filename, bool flipy)
 	djg_texture *tail = djgt_create(texture->comp);
 
 	tail->hdr = false;
-	tail->texels = (char *)stbi_load(
+	tail->texels = (char *)DJG_IMAGE_LOAD(
 		filename, &tail->x, &tail->y, &tail->comp, texture->comp
 	);
 	if (!tail->texels) {
@@ -902,11 +1413,242 @@ djgt_push_image(djg_texture *texture, const char *filename, bool flipy)
 
 		return false;
 	}
+	if (texture->comp) tail->comp = texture->comp; // stbi returns the file's
 	djgt__push_texture(texture, tail, flipy);
 
 	return true;
 }
 
+/**
+ * Parallel Image Decoding
+ *
+ * Each thread decodes every DJG_THREAD_COUNT-th image and flips it right
+ * after decoding, while its rows are still in cache. Note that stbi reports
+ * failures through a global string, so the logged reason may belong to
+ * another image if several fail at once.
+ */
+typedef struct djgt__decoder {
+	const char **filenames;
+	djg_texture **textures;
+	double *seconds;
+	int first, count;
+	bool flipy;
+} djgt__decoder;
+
+static double djgt__seconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER ticks, frequency;
+
+	QueryPerformanceCounter(&ticks);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)ticks.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#endif
+}
+
+static void djgt__decode(void *arg)
+{
+	djgt__decoder *decoder = (djgt__decoder *)arg;
+	int i;
+
+	for (i = decoder->first; i < decoder->count; i+= DJG_THREAD_COUNT) {
+		djg_texture *texture = decoder->textures[i];
+		int req_comp = texture->comp;
+		double start = djgt__seconds();
+
+		texture->texels = (char *)DJG_IMAGE_LOAD(
+			decoder->filenames[i], &texture->x, &texture->y,
+			&texture->comp, req_comp
+		);
+		if (req_comp) texture->comp = req_comp; // stbi returns the file's
+		if (texture->texels && decoder->flipy)
+			djgt__flipy(texture);
+		if (decoder->seconds)
+			decoder->seconds[i] = djgt__seconds() - start;
+	}
+}
+
+/**
+ * Worker Threads
+ *
+ * A thread runs a task; when no thread can be created (or threads are
+ * disabled), the task runs on the calling thread, in djgt__thread_start.
+ */
+typedef struct djgt__thread {
+#if DJG_THREAD_COUNT > 1
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+	pthread_mutex_t mutex;
+#endif
+#endif // DJG_THREAD_COUNT > 1
+	void (*task)(void *);
+	void *arg;
+	bool started, done;
+} djgt__thread;
+
+#if DJG_THREAD_COUNT > 1
+#ifdef _WIN32
+static DWORD WINAPI djgt__thread_main(LPVOID thread)
+{
+	djgt__thread *t = (djgt__thread *)thread;
+
+	(*t->task)(t->arg);
+
+	return 0;
+}
+#else
+static void *djgt__thread_main(void *thread)
+{
+	djgt__thread *t = (djgt__thread *)thread;
+
+	(*t->task)(t->arg);
+	pthread_mutex_lock(&t->mutex);
+	t->done = true;
+	pthread_mutex_unlock(&t->mutex);
+
+	return NULL;
+}
+#endif
+#endif // DJG_THREAD_COUNT > 1
+
+static void
+djgt__thread_start(djgt__thread *thread, void (*task)(void *), void *arg)
+{
+	thread->task = task;
+	thread->arg = arg;
+	thread->started = false;
+	thread->done = false;
+#if DJG_THREAD_COUNT > 1
+#ifdef _WIN32
+	thread->handle = CreateThread(NULL, 0, &djgt__thread_main, thread, 0, NULL);
+	thread->started = (thread->handle != NULL);
+#else
+	pthread_mutex_init(&thread->mutex, NULL);
+	thread->started = !pthread_create(&thread->handle, NULL,
+	                                  &djgt__thread_main, thread);
+	if (!thread->started) pthread_mutex_destroy(&thread->mutex);
+#endif
+#endif // DJG_THREAD_COUNT > 1
+	if (!thread->started) {
+		(*task)(arg);
+		thread->done = true;
+	}
+}
+
+// non-blocking
+static bool djgt__thread_done(djgt__thread *thread)
+{
+#if DJG_THREAD_COUNT > 1
+	// done belongs to the worker while it runs: on POSIX, it is written
+	// under the mutex, so it is only read under the mutex as well
+	if (thread->started) {
+#ifdef _WIN32
+		return (WaitForSingleObject(thread->handle, 0) == WAIT_OBJECT_0);
+#else
+		bool done;
+
+		pthread_mutex_lock(&thread->mutex);
+		done = thread->done;
+		pthread_mutex_unlock(&thread->mutex);
+
+		return done;
+#endif
+	}
+#endif // DJG_THREAD_COUNT > 1
+	return thread->done;
+}
+
+static void djgt__thread_join(djgt__thread *thread)
+{
+#if DJG_THREAD_COUNT > 1
+	if (thread->started) {
+#ifdef _WIN32
+		WaitForSingleObject(thread->handle, INFINITE);
+		CloseHandle(thread->handle);
+#else
+		pthread_join(thread->handle, NULL);
+		pthread_mutex_destroy(&thread->mutex);
+#endif
+		thread->started = false;
+	}
+#endif // DJG_THREAD_COUNT > 1
+	thread->done = true;
+}
+
+// runs a task over count arguments of size bytes each, the first one on the
+// calling thread
+static void
+djgt__run_tasks(void (*task)(void *), void *args, size_t size, int count)
+{
+	djgt__thread threads[DJG_THREAD_COUNT];
+	int i;
+
+	DJG_ASSERT(count <= DJG_THREAD_COUNT);
+	for (i = 1; i < count; ++i)
+		djgt__thread_start(&threads[i], task, (char *)args + size * i);
+	(*task)(args);
+	for (i = 1; i < count; ++i)
+		djgt__thread_join(&threads[i]);
+}
+
+DJGDEF bool
+djgt_push_images(
+	djg_texture *texture,
+	const char **filenames,
+	int count,
+	bool flipy,
+	double *seconds
+) {
+	djgt__decoder decoders[DJG_THREAD_COUNT];
+	djg_texture **tails;
+	int i, decoder_count = count < DJG_THREAD_COUNT ? count : DJG_THREAD_COUNT;
+	bool v = true;
+
+	DJG_ASSERT(count >= 0);
+	if (count == 0) return true;
+	tails = (djg_texture **)DJG_MALLOC(sizeof(*tails) * count);
+	for (i = 0; i < count; ++i)
+		tails[i] = djgt_create(texture->comp);
+	for (i = 0; i < decoder_count; ++i) {
+		decoders[i].filenames = filenames;
+		decoders[i].textures = tails;
+		decoders[i].seconds = seconds;
+		decoders[i].first = i;
+		decoders[i].count = count;
+		decoders[i].flipy = flipy;
+	}
+	djgt__run_tasks(&djgt__decode, decoders, sizeof(*decoders), decoder_count);
+
+	// push the images only if they all decoded
+	for (i = 0; i < count; ++i) {
+		if (!tails[i]->texels) {
+			DJG_LOG("djg_error: Image loading failed (%s)\n", filenames[i]);
+#ifndef STBI_NO_FAILURE_STRINGS
+			DJG_LOG("-- Begin -- STBI Log\n");
+			DJG_LOG("%s\n", stbi_failure_reason());
+			DJG_LOG("-- End -- STBI Log\n");
+#endif // STBI_NO_FAILURE_STRINGS
+			v = false;
+		}
+	}
+	for (i = 0; i < count; ++i) {
+		if (v) djgt__push_texture(texture, tails[i], /*already flipped*/false);
+		else djgt_release(tails[i]);
+	}
+	DJG_FREE(tails);
+
+	return v;
+}
+
 #ifndef STBI_NO_HDR
 DJGDEF bool
 djgt_push_hdrimage(djg_texture *texture, const char *filename, bool flipy)
@@ -928,6 +1670,7 @@ djgt_push_hdrimage(djg_texture *texture, const char *filename, bool flipy)
 
 		return false;
 	}
+	if (texture->comp) tail->comp = texture->comp; // stbi returns the file's
 	djgt__push_texture(texture, tail, flipy);
 
 	return true;
@@ -1467,6 +2210,520 @@ djgt_push_glcolorbuffer(
 	return true;
 }
 
+// *************************************************************************************************
+// Texture Mipmap API Implementation
+
+/**
+ * CPU MIP Generation
+ *
+ * Each level is a 2x2 box filtering of the previous one, whose size is
+ * max(1, size / 2) as in OpenGL; the last row or column of odd sizes is
+ * repeated. The rows of a level are split among the worker threads, and
+ * linear 8-bit images with 1 or 4 components are filtered with SSE2 when
+ * available. The last component of 2 and 4 component images is alpha, and
+ * is always filtered linearly.
+ */
+#if !defined(DJG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#	define DJGT__SSE2 1
+#	include <emmintrin.h>
+#endif
+
+typedef struct djgt__mipmapper {
+	const djg_texture *src;
+	djg_texture *dst;
+	const float *srgb; // sRGB to linear table, NULL for linear filtering
+	int first, last;   // rows of dst
+} djgt__mipmapper;
+
+static unsigned char djgt__srgb_encode(float c)
+{
+	c = c <= 0.0031308f ? 12.92f * c : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+
+	return (unsigned char)(c <= 0.f ? 0 : c >= 1.f ? 255 : (int)(255.f * c + 0.5f));
+}
+
+#ifdef DJGT__SSE2
+// filters the leading texels of a row and returns their count
+static int
+djgt__mipmap_row_sse2(
+	const unsigned char *r0,
+	const unsigned char *r1,
+	unsigned char *dst,
+	int sx,
+	int comp
+) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	int x = 0;
+
+	if (comp == 1) {
+		// even and odd texels are the low and high bytes of 16-bit lanes
+		const __m128i mask = _mm_set1_epi16(0x00FF);
+
+		for (; 2 * (x + 8) <= sx; x+= 8) {
+			__m128i a = _mm_loadu_si128((const __m128i *)&r0[2 * x]);
+			__m128i b = _mm_loadu_si128((const __m128i *)&r1[2 * x]);
+			__m128i sum = _mm_add_epi16(
+				_mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8)),
+				_mm_add_epi16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8))
+			);
+
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			_mm_storel_epi64((__m128i *)&dst[x], _mm_packus_epi16(sum, zero));
+		}
+	} else if (comp == 4) {
+		// each 64-bit half of a register holds a texel in 16-bit lanes
+		for (; 2 * (x + 2) <= sx; x+= 2) {
+			__m128i a = _mm_loadu_si128((const __m128i *)&r0[8 * x]);
+			__m128i b = _mm_loadu_si128((const __m128i *)&r1[8 * x]);
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+			                           _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+			                           _mm_unpackhi_epi8(b, zero));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+			                            _mm_unpackhi_epi64(lo, hi));
+
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			_mm_storel_epi64((__m128i *)&dst[4 * x], _mm_packus_epi16(sum, zero));
+		}
+	}
+
+	return x;
+}
+#endif // DJGT__SSE2
+
+static void djgt__mipmap_rows(void *arg)
+{
+	const djgt__mipmapper *m = (const djgt__mipmapper *)arg;
+	const djg_texture *src = m->src;
+	const djg_texture *dst = m->dst;
+	int comp = src->comp, alpha = (comp == 2 || comp == 4) ? comp - 1 : comp;
+	int x, y, c;
+
+	for (y = m->first; y < m->last; ++y) {
+		size_t y0 = (size_t)2 * y;
+		size_t y1 = 2 * y + 1 < src->y ? y0 + 1 : (size_t)src->y - 1;
+
+		if (src->hdr) {
+			const float *r0 = (const float *)src->texels + y0 * src->x * comp;
+			const float *r1 = (const float *)src->texels + y1 * src->x * comp;
+			float *d = (float *)dst->texels + (size_t)y * dst->x * comp;
+
+			for (x = 0; x < dst->x; ++x) {
+				int x0 = 2 * x * comp;
+				int x1 = (2 * x + 1 < src->x ? 2 * x + 1 : src->x - 1) * comp;
+
+				for (c = 0; c < comp; ++c)
+					d[x * comp + c] = 0.25f * (r0[x0 + c] + r0[x1 + c]
+					                         + r1[x0 + c] + r1[x1 + c]);
+			}
+		} else {
+			const unsigned char *r0 = (const unsigned char *)src->texels + y0 * src->x * comp;
+			const unsigned char *r1 = (const unsigned char *)src->texels + y1 * src->x * comp;
+			unsigned char *d = (unsigned char *)dst->texels + (size_t)y * dst->x * comp;
+
+			x = 0;
+#ifdef DJGT__SSE2
+			if (!m->srgb) x = djgt__mipmap_row_sse2(r0, r1, d, src->x, comp);
+#endif
+			for (; x < dst->x; ++x) {
+				int x0 = 2 * x * comp;
+				int x1 = (2 * x + 1 < src->x ? 2 * x + 1 : src->x - 1) * comp;
+
+				for (c = 0; c < comp; ++c) {
+					if (m->srgb && c < alpha) {
+						const float *lut = m->srgb;
+
+						d[x * comp + c] = djgt__srgb_encode(
+							0.25f * (lut[r0[x0 + c]] + lut[r0[x1 + c]]
+							       + lut[r1[x0 + c]] + lut[r1[x1 + c]])
+						);
+					} else {
+						d[x * comp + c] = (unsigned char)
+							((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+					}
+				}
+			}
+		}
+	}
+}
+
+DJGDEF djg_texture *djgt_create_mipmaps(const djg_texture *texture, bool srgb)
+{
+	const djg_texture *base;
+	djg_texture *head, *level;
+	float lut[256];
+	size_t bpp;
+	int i;
+
+	DJG_ASSERT(texture && texture->next);
+	base = texture->next;
+	bpp = (size_t)base->comp * (base->hdr ? 4 : 1);
+	for (i = 0; i < 256; ++i) {
+		float c = (float)i / 255.f;
+
+		lut[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	// base level
+	head = djgt_create(base->comp);
+	level = djgt_create(base->comp);
+	level->x = base->x;
+	level->y = base->y;
+	level->hdr = base->hdr;
+	level->texels = (char *)DJG_MALLOC(bpp * base->x * base->y);
+	memcpy(level->texels, base->texels, bpp * base->x * base->y);
+	head->next = level;
+
+	// remaining levels
+	while (level->x > 1 || level->y > 1) {
+		djgt__mipmapper mippers[DJG_THREAD_COUNT];
+		djg_texture *next = djgt_create(base->comp);
+		int count;
+
+		next->x = level->x > 1 ? level->x / 2 : 1;
+		next->y = level->y > 1 ? level->y / 2 : 1;
+		next->hdr = level->hdr;
+		next->texels = (char *)DJG_MALLOC(bpp * next->x * next->y);
+
+		// small levels are not worth a thread
+		count = next->x * next->y < 16384 ? 1 : DJG_THREAD_COUNT;
+		if (count > next->y) count = next->y;
+		for (i = 0; i < count; ++i) {
+			mippers[i].src = level;
+			mippers[i].dst = next;
+			mippers[i].srgb = (srgb && !base->hdr) ? lut : NULL;
+			mippers[i].first = next->y * i / count;
+			mippers[i].last = next->y * (i + 1) / count;
+		}
+		djgt__run_tasks(&djgt__mipmap_rows, mippers, sizeof(*mippers), count);
+
+		level->next = next;
+		level = next;
+	}
+
+	return head;
+}
+
+DJGDEF bool
+djgt_gl_upload_mipmaps(
+	const djg_texture *mipmaps,
+	GLint internalformat,
+	GLuint *gl
+) {
+	djgt__glpss pus = {0, 0, 0, 0, 0, 0 ,0, 0, 1};
+	djgt__glpss backup;
+	const djg_texture *it;
+	int level = 0, levels = djgt__count(mipmaps);
+	GLuint glt;
+
+	DJG_ASSERT(mipmaps && gl);
+	djgt__validate(); // flush previous OpenGL errors
+
+	if (!levels) return false;
+	glGenTextures(1, &glt);
+	glBindTexture(GL_TEXTURE_2D, glt);
+#ifndef NGL_ARB_texture_storage
+	glTexStorage2D(GL_TEXTURE_2D,
+	               levels,
+	               internalformat,
+	               mipmaps->next->x,
+	               mipmaps->next->y);
+#else
+	for (it = mipmaps->next; it; it = it->next, ++level)
+		glTexImage2D(GL_TEXTURE_2D,
+		             level,
+		             internalformat,
+		             it->x,
+		             it->y,
+		   /*border*/0,
+		    /*dummy*/GL_RED, GL_UNSIGNED_BYTE, NULL);
+	level = 0;
+#endif // NGL_ARB_texture_storage
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+	djgt__get_glpus(backup);
+	djgt__set_glpus(pus);
+	for (it = mipmaps->next; it; it = it->next, ++level)
+		glTexSubImage2D(GL_TEXTURE_2D,
+		                level,
+		    /*offsets*/ 0, 0,
+		                it->x,
+		                it->y,
+		                djgt__glformat(it),
+		                djgt__gltype(it),
+		                it->texels);
+	djgt__set_glpus(backup);
+
+	if (!djgt__validate()) {
+		DJG_LOG("djg_error: Caught OpenGL error\n");
+		glDeleteTextures(1, &glt);
+
+		return false;
+	}
+	if (glIsTexture(*gl))
+		glDeleteTextures(1, gl);
+	*gl = glt;
+
+	return true;
+}
+
+DJGDEF const void *
+djgt_get_texels(const djg_texture *texture, int i, int *x, int *y, int *comp)
+{
+	const djg_texture *it = texture->next;
+
+	DJG_ASSERT(i >= 0 && i < djgt__count(texture));
+	while (i--) it = it->next;
+	if (x) *x = it->x;
+	if (y) *y = it->y;
+	if (comp) *comp = it->comp;
+
+	return it->texels;
+}
+
+// *************************************************************************************************
+// Texture Streaming API Implementation
+
+typedef struct djg_texture_stream {
+	djg_texture *texture;   // decoded image (texture->next)
+	djg_texture *mipmaps;   // its MIP chain, built on the worker thread
+	djgt__decoder decoder;
+	djgt__thread thread;
+	const char *filename;
+	GLint internalformat;
+	GLuint pbo, gl;
+	const djg_texture *level; // level being uploaded
+	GLintptr offset;          // offset of the level in the pbo
+	int level_id, row, status;
+	bool srgb;
+} djg_texture_stream;
+
+// decodes the image and builds its MIP chain
+static void djgt__stream_decode(void *arg)
+{
+	djg_texture_stream *stream = (djg_texture_stream *)arg;
+	djg_texture *image = stream->texture->next;
+
+	djgt__decode(&stream->decoder);
+	if (image->texels) {
+		stream->mipmaps = djgt_create_mipmaps(stream->texture, stream->srgb);
+		DJG_FREE(image->texels); // the chain holds a copy
+		image->texels = NULL;
+	}
+}
+
+DJGDEF djg_texture_stream *
+djgt_stream_create(
+	const char *filename,
+	int req_comp,
+	GLint internalformat,
+	bool flipy
+) {
+	djg_texture_stream *stream =
+		(djg_texture_stream *)DJG_MALLOC(sizeof(*stream));
+	size_t len = strlen(filename) + 1;
+
+	stream->texture = djgt_create(req_comp);
+	stream->texture->next = djgt_create(req_comp);
+	stream->mipmaps = NULL;
+	stream->filename = (const char *)memcpy(DJG_MALLOC(len), filename, len);
+	stream->internalformat = internalformat;
+	stream->pbo = 0;
+	stream->gl = 0;
+	stream->level = NULL;
+	stream->offset = 0;
+	stream->level_id = 0;
+	stream->row = 0;
+	stream->status = DJGT_STREAM_LOADING;
+	stream->srgb = (internalformat == GL_SRGB8
+	             || internalformat == GL_SRGB8_ALPHA8);
+	stream->decoder.filenames = &stream->filename;
+	stream->decoder.textures = &stream->texture->next;
+	stream->decoder.seconds = NULL;
+	stream->decoder.first = 0;
+	stream->decoder.count = 1;
+	stream->decoder.flipy = flipy;
+	djgt__thread_start(&stream->thread, &djgt__stream_decode, stream);
+
+	return stream;
+}
+
+DJGDEF void djgt_stream_release(djg_texture_stream *stream)
+{
+	DJG_ASSERT(stream);
+	djgt__thread_join(&stream->thread);
+	if (glIsBuffer(stream->pbo))
+		glDeleteBuffers(1, &stream->pbo);
+	if (glIsTexture(stream->gl))
+		glDeleteTextures(1, &stream->gl);
+	if (stream->mipmaps)
+		djgt_release(stream->mipmaps);
+	djgt_release(stream->texture);
+	DJG_FREE((void *)stream->filename);
+	DJG_FREE(stream);
+}
+
+static size_t djgt__stride(const djg_texture *texture)
+{
+	return (size_t)texture->x * texture->comp * (texture->hdr ? 4 : 1);
+}
+
+// allocates the texture and the pixel unpack buffer of the MIP chain
+static bool djgt__stream_begin(djg_texture_stream *stream)
+{
+	const djg_texture *base = stream->mipmaps->next;
+	const djg_texture *it;
+	int levels = djgt__count(stream->mipmaps);
+	size_t size = 0;
+	GLint binding;
+
+	for (it = base; it; it = it->next)
+		size+= djgt__stride(it) * it->y;
+	glGenBuffers(1, &stream->pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream->pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &binding);
+	glGenTextures(1, &stream->gl);
+	glBindTexture(GL_TEXTURE_2D, stream->gl);
+#ifndef NGL_ARB_texture_storage
+	glTexStorage2D(GL_TEXTURE_2D,
+	               levels,
+	               stream->internalformat,
+	               base->x,
+	               base->y);
+#else
+	{
+		int level = 0;
+
+		for (it = base; it; it = it->next, ++level)
+			glTexImage2D(GL_TEXTURE_2D,
+			             level,
+			             stream->internalformat,
+			             it->x,
+			             it->y,
+			   /*border*/0,
+			    /*dummy*/GL_RED, GL_UNSIGNED_BYTE, NULL);
+	}
+#endif // NGL_ARB_texture_storage
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glBindTexture(GL_TEXTURE_2D, binding);
+	stream->level = base;
+
+	return djgt__validate();
+}
+
+// stages rows of texels in the pixel unpack buffer and uploads them, level
+// after level, until max_bytes are consumed; the ranges of the buffer are
+// written once, so the mapping is unsynchronized
+static bool djgt__stream_rows(djg_texture_stream *stream, int max_bytes)
+{
+	djgt__glpss pus = {0, 0, 0, 0, 0, 0 ,0, 0, 1};
+	djgt__glpss backup;
+	GLint binding;
+	bool v = true;
+
+	djgt__get_glpus(backup);
+	pus[DJGT__GLPSS_BUFFER] = stream->pbo;
+	djgt__set_glpus(pus);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &binding);
+	glBindTexture(GL_TEXTURE_2D, stream->gl);
+
+	while (v && stream->level && max_bytes > 0) {
+		const djg_texture *level = stream->level;
+		size_t stride = djgt__stride(level);
+		int count = (int)((size_t)max_bytes / stride);
+		GLintptr offset = stream->offset + (GLintptr)stride * stream->row;
+		void *ptr;
+
+		if (count < 1) count = 1;
+		if (count > level->y - stream->row) count = level->y - stream->row;
+
+		ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+		                       offset,
+		                       (GLsizeiptr)stride * count,
+		                       GL_MAP_WRITE_BIT
+		                       | GL_MAP_INVALIDATE_RANGE_BIT
+		                       | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!ptr) {
+			v = false;
+			break;
+		}
+		memcpy(ptr, &level->texels[stride * stream->row], stride * count);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glTexSubImage2D(GL_TEXTURE_2D,
+		                stream->level_id,
+		                0,
+		                stream->row,
+		                level->x,
+		                count,
+		                djgt__glformat(level),
+		                djgt__gltype(level),
+		                (const GLvoid *)offset);
+		max_bytes-= (int)(stride * count);
+		stream->row+= count;
+
+		// next level
+		if (stream->row == level->y) {
+			stream->offset+= (GLintptr)stride * level->y;
+			stream->level = level->next;
+			++stream->level_id;
+			stream->row = 0;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, binding);
+	djgt__set_glpus(backup);
+
+	return v && djgt__validate();
+}
+
+// hands the texture over
+static void djgt__stream_end(djg_texture_stream *stream, GLuint *gl)
+{
+	glDeleteBuffers(1, &stream->pbo);
+	stream->pbo = 0;
+	djgt_release(stream->mipmaps);
+	stream->mipmaps = NULL;
+	*gl = stream->gl;
+	stream->gl = 0;
+}
+
+DJGDEF int
+djgt_stream_update(djg_texture_stream *stream, int max_bytes, GLuint *gl)
+{
+	DJG_ASSERT(stream && gl && max_bytes > 0);
+	if (stream->status != DJGT_STREAM_LOADING
+	|| !djgt__thread_done(&stream->thread))
+		return stream->status;
+
+	djgt__validate(); // flush previous OpenGL errors
+	if (!stream->pbo) {
+		djgt__thread_join(&stream->thread);
+		if (!stream->mipmaps) {
+			DJG_LOG("djg_error: Image loading failed (%s)\n", stream->filename);
+#ifndef STBI_NO_FAILURE_STRINGS
+			DJG_LOG("-- Begin -- STBI Log\n");
+			DJG_LOG("%s\n", stbi_failure_reason());
+			DJG_LOG("-- End -- STBI Log\n");
+#endif // STBI_NO_FAILURE_STRINGS
+			return (stream->status = DJGT_STREAM_FAILED);
+		}
+		if (!djgt__stream_begin(stream))
+			return (stream->status = DJGT_STREAM_FAILED);
+	}
+	if (!djgt__stream_rows(stream, max_bytes))
+		return (stream->status = DJGT_STREAM_FAILED);
+	if (!stream->level) {
+		djgt__stream_end(stream, gl);
+		stream->status = DJGT_STREAM_READY;
+	}
+
+	return stream->status;
+}
+
 #endif // STBI_INCLUDE_STB_IMAGE_H
 
 // *************************************************************************************************
@@ -1559,9 +2816,10 @@ DJGDEF bool djgt_save_png(const djg_texture *texture, const char *filename)
 
 typedef struct djg_mesh {
 	djgm_vertex *vertexv;
-	uint16_t *poly3v; // triangles
-	uint16_t *poly4v; // quads
+	void *poly3v; // triangles
+	void *poly4v; // quads
 	int32_t vertexc, poly3c, poly4c;
+	GLenum index_type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
 } djg_mesh;
 
 static djg_mesh *djgm__create(void)
@@ -1575,6 +2833,7 @@ static djg_mesh *djgm__create(void)
 	mesh->vertexc = 0;
 	mesh->poly3c = 0;
 	mesh->poly4c = 0;
+	mesh->index_type = GL_UNSIGNED_SHORT;
 
 	return mesh;
 }
@@ -1590,13 +2849,14 @@ djgm__load_plane_vertices(
 
 	slices+= 2;
 	stacks+= 2;
-	vc = slices * stacks;
 
-	if (vc > 0xFFFF) {
+	// the index count of the polygons must fit in 32 bits
+	if ((int64_t)slices * stacks * 6 > 0x7FFFFFFF) {
 		DJG_LOG("djg_error: Too many vertices\n");
 
 		return false;
 	}
+	vc = slices * stacks;
 
 	vv = (djgm_vertex *)DJG_MALLOC(sizeof(*vv) * vc);
 
@@ -1631,10 +2891,54 @@ djgm__load_plane_vertices(
 	return true;
 }
 
+/*
+The polygons are built once per index width; the macro expands to a
+function that writes indexes of type T.
+*/
+#define DJGM__LOAD_PLANE_POLYGONS(name, T)                                   \
+static void name(djg_mesh *mesh, int slices, int stacks)                     \
+{                                                                            \
+	T *p3v = (T *)mesh->poly3v, *p4v = (T *)mesh->poly4v;                    \
+	int32_t i, j;                                                            \
+                                                                             \
+	/* build triangles */                                                    \
+	for (j = 0; j < stacks; ++j)                                             \
+	for (i = 0; i < slices; ++i) {                                           \
+		T *p3 = &p3v[2 * 3 * (j * slices + i)];                              \
+                                                                             \
+		/* upper triangle */                                                 \
+		p3[0] = j     + (stacks + 1) *  i;                                   \
+		p3[1] = j     + (stacks + 1) * (i + 1);                              \
+		p3[2] = j + 1 + (stacks + 1) *  i;                                   \
+                                                                             \
+		p3+= 3;                                                              \
+                                                                             \
+		/* lower triangle */                                                 \
+		p3[0] = j + 1 + (stacks + 1) *  i;                                   \
+		p3[1] = j     + (stacks + 1) * (i + 1);                              \
+		p3[2] = j + 1 + (stacks + 1) * (i + 1);                              \
+	}                                                                        \
+                                                                             \
+	/* build quads */                                                        \
+	for (j = 0; j < stacks; ++j)                                             \
+	for (i = 0; i < slices; ++i) {                                           \
+		T *p4 = &p4v[4 * (j * slices + i)];                                  \
+                                                                             \
+		p4[0] = j     + (stacks + 1) *  i;                                   \
+		p4[1] = j     + (stacks + 1) * (i + 1);                              \
+		p4[2] = j + 1 + (stacks + 1) * (i + 1);                              \
+		p4[3] = j + 1 + (stacks + 1) *  i;                                   \
+	}                                                                        \
+}
+
+DJGM__LOAD_PLANE_POLYGONS(djgm__load_plane_polygons16, uint16_t)
+DJGM__LOAD_PLANE_POLYGONS(djgm__load_plane_polygons32, uint32_t)
+#undef DJGM__LOAD_PLANE_POLYGONS
+
+// 16-bit indexes are used whenever they can address all the vertices
 static bool djgm__load_plane_polygons(djg_mesh *mesh, int slices, int stacks)
 {
-	uint16_t *p3v, *p4v;
-	int32_t i, j, p3c, p4c;
+	int32_t p3c, p4c, index_size;
 
 	++slices;
 	++stacks;
@@ -1644,42 +2948,28 @@ static bool djgm__load_plane_polygons(djg_mesh *mesh, int slices, int stacks)
 	    * /* indexes per triangle*/3;
 	p4c = /* quad count */slices * stacks 
 	    * /* indexes per quad */4;
-	p3v = (uint16_t *)DJG_MALLOC(sizeof(*p3v) * p3c);
-	p4v = (uint16_t *)DJG_MALLOC(sizeof(*p4v) * p4c);
+	mesh->index_type = mesh->vertexc > 0xFFFF ? GL_UNSIGNED_INT
+	                                          : GL_UNSIGNED_SHORT;
+	index_size = mesh->index_type == GL_UNSIGNED_INT ? sizeof(uint32_t)
+	                                                 : sizeof(uint16_t);
+	mesh->poly3v = DJG_MALLOC((size_t)index_size * p3c);
+	mesh->poly4v = DJG_MALLOC((size_t)index_size * p4c);
+	if (!mesh->poly3v || !mesh->poly4v) {
+		DJG_LOG("djg_error: Mesh allocation failed\n");
+		DJG_FREE(mesh->poly3v);
+		DJG_FREE(mesh->poly4v);
+		mesh->poly3v = mesh->poly4v = NULL;
 
-	// build triangles
-	for (j = 0; j < stacks; ++j)
-	for (i = 0; i < slices; ++i) {
-		uint16_t *p3 = &p3v[2 * 3 * (j * slices + i)];
-
-		// upper triangle
-		p3[0] = j     + (stacks + 1) *  i;
-		p3[1] = j     + (stacks + 1) * (i + 1);
-		p3[2] = j + 1 + (stacks + 1) *  i;
-
-		p3+= 3;
-
-		// lower triangle
-		p3[0] = j + 1 + (stacks + 1) *  i;
-		p3[1] = j     + (stacks + 1) * (i + 1);
-		p3[2] = j + 1 + (stacks + 1) * (i + 1);
+		return false;
 	}
-	
-	// build quads
-	for (j = 0; j < stacks; ++j)
-	for (i = 0; i < slices; ++i) {
-		uint16_t *p4 = &p4v[4 * (j * slices + i)];
 
-		p4[0] = j     + (stacks + 1) *  i;
-		p4[1] = j     + (stacks + 1) * (i + 1);
-		p4[2] = j + 1 + (stacks + 1) * (i + 1);
-		p4[3] = j + 1 + (stacks + 1) *  i;
-	}
+	if (mesh->index_type == GL_UNSIGNED_INT)
+		djgm__load_plane_polygons32(mesh, slices, stacks);
+	else
+		djgm__load_plane_polygons16(mesh, slices, stacks);
 
 	mesh->poly3c = p3c;
 	mesh->poly4c = p4c;
-	mesh->poly3v = p3v;
-	mesh->poly4v = p4v;
 
 	return true;
 }
@@ -1868,20 +3158,67 @@ DJGDEF void djgm_release(djg_mesh *mesh)
 	DJG_FREE(mesh);
 }
 
-DJGDEF const uint16_t *djgm_get_triangles(const djg_mesh *mesh, GLint *count)
+DJGDEF GLenum djgm_get_index_type(const djg_mesh *mesh)
 {
 	DJG_ASSERT(mesh);
-	if (count) *count = mesh->poly3c;
 
-	return mesh->poly3v;
+	return mesh->index_type;
+}
+
+static const void *
+djgm__get_indexes(
+	const djg_mesh *mesh,
+	const void *indexv, GLint indexc,
+	GLenum index_type,
+	GLint *count
+) {
+	DJG_ASSERT(mesh);
+	if (mesh->index_type != index_type) {
+		DJG_LOG("djg_error: Mismatching mesh index type\n");
+		if (count) *count = 0;
+
+		return NULL;
+	}
+	if (count) *count = indexc;
+
+	return indexv;
+}
+
+DJGDEF const uint16_t *djgm_get_triangles(const djg_mesh *mesh, GLint *count)
+{
+	return (const uint16_t *)djgm__get_indexes(mesh,
+	                                           mesh->poly3v, mesh->poly3c,
+	                                           GL_UNSIGNED_SHORT, count);
 }
 
 DJGDEF const uint16_t *djgm_get_quads(const djg_mesh *mesh, GLint *count)
 {
-	DJG_ASSERT(mesh);
-	if (count) *count = mesh->poly4c;
+	return (const uint16_t *)djgm__get_indexes(mesh,
+	                                           mesh->poly4v, mesh->poly4c,
+	                                           GL_UNSIGNED_SHORT, count);
+}
 
-	return mesh->poly4v;
+DJGDEF const uint32_t *djgm_get_triangles32(const djg_mesh *mesh, GLint *count)
+{
+	return (const uint32_t *)djgm__get_indexes(mesh,
+	                                           mesh->poly3v, mesh->poly3c,
+	                                           GL_UNSIGNED_INT, count);
+}
+
+DJGDEF const uint32_t *djgm_get_quads32(const djg_mesh *mesh, GLint *count)
+{
+	return (const uint32_t *)djgm__get_indexes(mesh,
+	                                           mesh->poly4v, mesh->poly4c,
+	                                           GL_UNSIGNED_INT, count);
+}
+
+// reads the i-th index of an index array of the mesh, whatever its width
+static int32_t djgm__index(const djg_mesh *mesh, const void *indexv, int32_t i)
+{
+	if (mesh->index_type == GL_UNSIGNED_INT)
+		return (int32_t)((const uint32_t *)indexv)[i];
+
+	return (int32_t)((const uint16_t *)indexv)[i];
 }
 
 DJGDEF const djgm_vertex *djgm_get_vertices(const djg_mesh *mesh, GLint *count)
@@ -1892,6 +3229,263 @@ DJGDEF const djgm_vertex *djgm_get_vertices(const djg_mesh *mesh, GLint *count)
 	return mesh->vertexv;
 }
 
+/*
+Vertex Cache Optimization
+
+The triangles are reordered with Tom Forsyth's linear-speed vertex cache
+optimization: triangles are emitted greedily, picking the one whose
+vertices score best, where a vertex scores higher if it lies in the most
+recently used entries of a simulated LRU cache, and if few triangles
+remain to be emitted that use it. The vertices are then renumbered in the
+order in which the triangles fetch them, which improves the locality of
+vertex fetches. The quads keep their order, but are renumbered as well.
+*/
+#define DJGM__CACHE_SIZE 32
+
+static float djgm__vertex_score(int cache_pos, int remaining_tri_cnt)
+{
+	float score = 0.f;
+
+	if (remaining_tri_cnt == 0)
+		return -1.f;
+	if (cache_pos >= 0) {
+		if (cache_pos < 3) {
+			// the vertices of the last triangle get a fixed score, so as
+			// not to favor any of them
+			score = 0.75f;
+		} else {
+			float scale = 1.f / (DJGM__CACHE_SIZE - 3);
+
+			score = powf(1.f - (cache_pos - 3) * scale, 1.5f);
+		}
+	}
+
+	// boost the vertices that only have a few triangles left
+	return score + 2.f * powf((float)remaining_tri_cnt, -0.5f);
+}
+
+static void
+djgm__optimize_triangles(
+	const int32_t *indexv, int32_t tri_cnt, int32_t vertex_cnt,
+	int32_t *out
+) {
+	int32_t *tri_offsets = (int32_t *)DJG_MALLOC(sizeof(int32_t) * (vertex_cnt + 1));
+	int32_t *remaining = (int32_t *)DJG_MALLOC(sizeof(int32_t) * vertex_cnt);
+	int32_t *cache_pos = (int32_t *)DJG_MALLOC(sizeof(int32_t) * vertex_cnt);
+	float *vertex_scores = (float *)DJG_MALLOC(sizeof(float) * vertex_cnt);
+	int32_t *vertex_tris = (int32_t *)DJG_MALLOC(sizeof(int32_t) * 3 * tri_cnt);
+	float *tri_scores = (float *)DJG_MALLOC(sizeof(float) * tri_cnt);
+	char *is_emitted = (char *)DJG_MALLOC(tri_cnt);
+	int32_t cache[DJGM__CACHE_SIZE + 3];
+	int32_t i, j, k, cache_cnt = 0, cursor = 0, best_tri = -1;
+
+	// build the triangle lists of the vertices
+	memset(remaining, 0, sizeof(int32_t) * vertex_cnt);
+	for (i = 0; i < 3 * tri_cnt; ++i)
+		++remaining[indexv[i]];
+	tri_offsets[0] = 0;
+	for (i = 0; i < vertex_cnt; ++i)
+		tri_offsets[i + 1] = tri_offsets[i] + remaining[i];
+	memset(remaining, 0, sizeof(int32_t) * vertex_cnt);
+	for (i = 0; i < 3 * tri_cnt; ++i) {
+		int32_t v = indexv[i];
+
+		vertex_tris[tri_offsets[v] + remaining[v]++] = i / 3;
+	}
+
+	// initial scores
+	for (i = 0; i < vertex_cnt; ++i) {
+		cache_pos[i] = -1;
+		vertex_scores[i] = djgm__vertex_score(-1, remaining[i]);
+	}
+	for (i = 0; i < tri_cnt; ++i) {
+		tri_scores[i] = vertex_scores[indexv[3 * i    ]]
+		              + vertex_scores[indexv[3 * i + 1]]
+		              + vertex_scores[indexv[3 * i + 2]];
+		is_emitted[i] = 0;
+	}
+
+	for (k = 0; k < tri_cnt; ++k) {
+		int32_t new_cache[DJGM__CACHE_SIZE + 3], new_cache_cnt = 0;
+		float best_score = -1.f;
+
+		// when the cache holds no candidate, resume the scan of the input
+		if (best_tri < 0) {
+			while (is_emitted[cursor]) ++cursor;
+			best_tri = cursor;
+		}
+
+		// emit the triangle and remove it from the lists of its vertices
+		is_emitted[best_tri] = 1;
+		for (i = 0; i < 3; ++i) {
+			int32_t v = indexv[3 * best_tri + i];
+			int32_t *tris = &vertex_tris[tri_offsets[v]];
+
+			out[3 * k + i] = v;
+			for (j = 0; j < remaining[v]; ++j) {
+				if (tris[j] == best_tri) {
+					tris[j] = tris[remaining[v] - 1];
+					break;
+				}
+			}
+			--remaining[v];
+			new_cache[new_cache_cnt++] = v;
+		}
+
+		// move its vertices to the front of the cache
+		for (i = 0; i < cache_cnt; ++i) {
+			int32_t v = cache[i];
+
+			if (v != new_cache[0] && v != new_cache[1] && v != new_cache[2])
+				new_cache[new_cache_cnt++] = v;
+		}
+		for (i = 0; i < new_cache_cnt; ++i) {
+			int32_t v = new_cache[i];
+
+			cache_pos[v] = i < DJGM__CACHE_SIZE ? i : -1;
+			vertex_scores[v] = djgm__vertex_score(cache_pos[v], remaining[v]);
+		}
+		cache_cnt = new_cache_cnt < DJGM__CACHE_SIZE ? new_cache_cnt
+		                                             : DJGM__CACHE_SIZE;
+		memcpy(cache, new_cache, sizeof(int32_t) * cache_cnt);
+
+		// rescore the triangles of the cached vertices and pick the best
+		best_tri = -1;
+		for (i = 0; i < new_cache_cnt; ++i) {
+			int32_t v = new_cache[i];
+
+			for (j = 0; j < remaining[v]; ++j) {
+				int32_t t = vertex_tris[tri_offsets[v] + j];
+
+				tri_scores[t] = vertex_scores[indexv[3 * t    ]]
+				              + vertex_scores[indexv[3 * t + 1]]
+				              + vertex_scores[indexv[3 * t + 2]];
+				if (tri_scores[t] > best_score) {
+					best_score = tri_scores[t];
+					best_tri = t;
+				}
+			}
+		}
+	}
+
+	DJG_FREE(tri_offsets);
+	DJG_FREE(remaining);
+	DJG_FREE(cache_pos);
+	DJG_FREE(vertex_scores);
+	DJG_FREE(vertex_tris);
+	DJG_FREE(tri_scores);
+	DJG_FREE(is_emitted);
+}
+
+// copies the indexes of the mesh to 32-bit integers, and back
+static void djgm__get_indexes32(const djg_mesh *mesh, const void *indexv,
+                                int32_t indexc, int32_t *out)
+{
+	int32_t i;
+
+	for (i = 0; i < indexc; ++i)
+		out[i] = djgm__index(mesh, indexv, i);
+}
+
+static void djgm__set_indexes32(djg_mesh *mesh, void *indexv,
+                                int32_t indexc, const int32_t *in)
+{
+	int32_t i;
+
+	for (i = 0; i < indexc; ++i) {
+		if (mesh->index_type == GL_UNSIGNED_INT)
+			((uint32_t *)indexv)[i] = (uint32_t)in[i];
+		else
+			((uint16_t *)indexv)[i] = (uint16_t)in[i];
+	}
+}
+
+DJGDEF bool djgm_optimize(djg_mesh *mesh)
+{
+	int32_t *p3v, *p4v, *opt3v, *remap;
+	djgm_vertex *vertexv;
+	int32_t i, vertex_cnt = 0;
+
+	DJG_ASSERT(mesh);
+	p3v = (int32_t *)DJG_MALLOC(sizeof(int32_t) * mesh->poly3c);
+	opt3v = (int32_t *)DJG_MALLOC(sizeof(int32_t) * mesh->poly3c);
+	p4v = (int32_t *)DJG_MALLOC(sizeof(int32_t) * mesh->poly4c);
+	remap = (int32_t *)DJG_MALLOC(sizeof(int32_t) * mesh->vertexc);
+	vertexv = (djgm_vertex *)DJG_MALLOC(sizeof(djgm_vertex) * mesh->vertexc);
+	if (!p3v || !opt3v || !p4v || !remap || !vertexv) {
+		DJG_LOG("djg_error: Mesh optimization allocation failed\n");
+		DJG_FREE(p3v); DJG_FREE(opt3v); DJG_FREE(p4v);
+		DJG_FREE(remap); DJG_FREE(vertexv);
+
+		return false;
+	}
+
+	// reorder the triangles
+	djgm__get_indexes32(mesh, mesh->poly3v, mesh->poly3c, p3v);
+	djgm__optimize_triangles(p3v, mesh->poly3c / 3, mesh->vertexc, opt3v);
+
+	// renumber the vertices in fetch order; unreferenced vertices go last
+	for (i = 0; i < mesh->vertexc; ++i)
+		remap[i] = -1;
+	for (i = 0; i < mesh->poly3c; ++i)
+		if (remap[opt3v[i]] < 0)
+			remap[opt3v[i]] = vertex_cnt++;
+	for (i = 0; i < mesh->vertexc; ++i)
+		if (remap[i] < 0)
+			remap[i] = vertex_cnt++;
+	for (i = 0; i < mesh->vertexc; ++i)
+		vertexv[remap[i]] = mesh->vertexv[i];
+	for (i = 0; i < mesh->poly3c; ++i)
+		opt3v[i] = remap[opt3v[i]];
+	djgm__get_indexes32(mesh, mesh->poly4v, mesh->poly4c, p4v);
+	for (i = 0; i < mesh->poly4c; ++i)
+		p4v[i] = remap[p4v[i]];
+
+	// update the mesh
+	djgm__set_indexes32(mesh, mesh->poly3v, mesh->poly3c, opt3v);
+	djgm__set_indexes32(mesh, mesh->poly4v, mesh->poly4c, p4v);
+	DJG_FREE(mesh->vertexv);
+	mesh->vertexv = vertexv;
+
+	DJG_FREE(p3v);
+	DJG_FREE(opt3v);
+	DJG_FREE(p4v);
+	DJG_FREE(remap);
+
+	return true;
+}
+
+/*
+Average Cache Miss Ratio
+
+Number of vertices that miss a FIFO post-transform cache of cache_size
+entries, per triangle; it ranges from 0.5 (ideal, for large meshes) to 3.
+*/
+DJGDEF float djgm_acmr(const djg_mesh *mesh, int cache_size)
+{
+	int32_t *timestamps, i, miss_cnt = 0;
+
+	DJG_ASSERT(mesh && cache_size > 0);
+	if (mesh->poly3c == 0)
+		return 0.f;
+
+	// a vertex is cached if it was fetched less than cache_size misses ago
+	timestamps = (int32_t *)DJG_MALLOC(sizeof(int32_t) * mesh->vertexc);
+	for (i = 0; i < mesh->vertexc; ++i)
+		timestamps[i] = -cache_size - 1;
+	for (i = 0; i < mesh->poly3c; ++i) {
+		int32_t v = djgm__index(mesh, mesh->poly3v, i);
+
+		if (miss_cnt - timestamps[v] > cache_size) {
+			timestamps[v] = miss_cnt;
+			++miss_cnt;
+		}
+	}
+	DJG_FREE(timestamps);
+
+	return (float)miss_cnt / (mesh->poly3c / 3);
+}
+
 DJGDEF bool
 djgm_export_obj_triangles(const djg_mesh *mesh, const char *filename)
 {
@@ -1927,15 +3521,13 @@ djgm_export_obj_triangles(const djg_mesh *mesh, const char *filename)
 	// write topology
 	fprintf(pf, "# Topology\n");
 	for (i = 0; i < mesh->poly3c / 3; ++i) {
-		fprintf(pf, "f %i/%i/%i ", (int32_t)mesh->poly3v[3*i  ] + 1,
-		                           (int32_t)mesh->poly3v[3*i  ] + 1,
-		                           (int32_t)mesh->poly3v[3*i  ] + 1);
-		fprintf(pf, "%i/%i/%i ", (int32_t)mesh->poly3v[3*i+1] + 1,
-		                         (int32_t)mesh->poly3v[3*i+1] + 1,
-		                         (int32_t)mesh->poly3v[3*i+1] + 1);
-		fprintf(pf, "%i/%i/%i\n", (int32_t)mesh->poly3v[3*i+2] + 1,
-		                          (int32_t)mesh->poly3v[3*i+2] + 1,
-		                          (int32_t)mesh->poly3v[3*i+2] + 1);
+		int32_t i0 = djgm__index(mesh, mesh->poly3v, 3*i  ) + 1;
+		int32_t i1 = djgm__index(mesh, mesh->poly3v, 3*i+1) + 1;
+		int32_t i2 = djgm__index(mesh, mesh->poly3v, 3*i+2) + 1;
+
+		fprintf(pf, "f %i/%i/%i ", i0, i0, i0);
+		fprintf(pf, "%i/%i/%i ", i1, i1, i1);
+		fprintf(pf, "%i/%i/%i\n", i2, i2, i2);
 	}
 
 	fclose(pf);
@@ -0,0 +1,819 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Complete program (this compiles):
+// Sphere Light Shading Demo - Pivot Fitter
+//
+// g++ -O3 -pthread fit.cpp -o fit
+//
+// Generates the table of fit.inl, which maps a GGX BRDF to the pivot of a
+// Pivot-Transformed Spherical Distribution (PTSD) that approximates it.
+// Texel (i, j) of a table of resolution N stores the fit for the roughness
+// alpha = (i / (N - 1))^2 and the view elevation theta = j / (N - 1) * pi / 2,
+// which matches the lookup of extractPivot() in sphere.glsl. Each texel holds
+//   r: the norm of the pivot
+//   g: the elevation of the pivot, in the plane spanned by wo and the normal
+//   b: the albedo of the BRDF, estimated with the fitted PTSD as proposal
+//   a: the albedo of the BRDF, estimated with the BRDF as proposal
+// The pivot minimizes the L2 distance between the PTSD and the normalized
+// BRDF (times cosine), which we estimate with MIS over both distributions.
+//
+// With --anisotropic, the program fits the four-dimensional table of
+// fit_aniso.inl instead, which adds the roughness alpha_y of anisotropic
+// GGX and the azimuth of the view direction (see fitRowAnisotropic()).
+// The table starts with its resolution along each of its four dimensions,
+// followed by its texels in half precision (as uint16_t initializers), so
+// that it ships at half the size and uploads directly to an RGBA16F
+// texture.
+//
+// With --analytic, the program instead fits polynomials to an existing
+// table (see pivot_fit.h), reports their error against the table and
+// prints their coefficients.
+// Run with --help for the list of options.
+//
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+#include "ggx.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Application Manager
+struct AppManager {
+	struct {
+		int resolution;  // table width and height
+		int sampleCount; // samples per distribution and per texel
+		int threadCount;
+		int anisotropic; // resolution of the anisotropic table, 0 disables it
+	} fit;
+	struct {
+		int degree; // total degree of the polynomials, 0 disables the mode
+	} analytic;
+	struct {
+		const char *input;
+		const char *output;
+	} files;
+} g_app = {
+	/*fit*/      {64, 4096, 0, 0},
+	/*analytic*/ {0},
+	/*files*/    {"fit.inl", NULL}
+};
+
+#define FIT_PI          3.141592654f
+#define FIT_MIN_ALPHA   1e-3f   // GGX is a Dirac below this roughness
+#define FIT_MAX_THETA   1.5608f // GGX vanishes at grazing angles
+#define FIT_MAX_NORM    0.999f  // PTSDs degenerate as the pivot norm tends to 1
+
+////////////////////////////////////////////////////////////////////////////////
+// Fitting
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Hammersley point set
+pivot::vec2 hammersley(int i, int n)
+{
+	uint32_t b = (uint32_t)i;
+
+	b = (b << 16u) | (b >> 16u);
+	b = ((b & 0x55555555u) << 1u) | ((b & 0xAAAAAAAAu) >> 1u);
+	b = ((b & 0x33333333u) << 2u) | ((b & 0xCCCCCCCCu) >> 2u);
+	b = ((b & 0x0F0F0F0Fu) << 4u) | ((b & 0xF0F0F0F0u) >> 4u);
+	b = ((b & 0x00FF00FFu) << 8u) | ((b & 0xFF00FF00u) >> 8u);
+
+	return pivot::vec2(((float)i + 0.5f) / (float)n, (float)b * 2.3283064e-10f);
+}
+
+// -----------------------------------------------------------------------------
+// pivot in the tangent frame where wo = (sin(theta), 0, cos(theta))
+pivot::vec3 pivotFromParams(float norm, float elevation)
+{
+	return pivot::vec3(norm * std::sin(elevation), 0, norm * std::cos(elevation));
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Fitting Problem
+ *
+ * This structure holds the BRDF of a single texel of the table, along with
+ * the samples we use to evaluate the fitting error. The BRDF samples do not
+ * depend on the pivot, so we store their directions and BRDF values once.
+ */
+struct FitProblem {
+	pivot::vec3 wo;
+	float alphaX, alphaY;
+	float albedo;
+	std::vector<pivot::vec3> brdfDirs; // BRDF samples
+	std::vector<float> brdfValues;     // normalized BRDF at the BRDF samples
+	std::vector<float> brdfPdfs;       // PDF of the BRDF samples
+	std::vector<pivot::vec3> sphereDirs; // uniform samples, warped by the pivot
+};
+
+void
+initFitProblem(
+	float alphaX, float alphaY,
+	const pivot::vec3& wo,
+	int sampleCount,
+	FitProblem *fp
+) {
+	double albedo = 0.0;
+
+	fp->wo = wo;
+	fp->alphaX = alphaX;
+	fp->alphaY = alphaY;
+	fp->brdfDirs.resize(0);
+	fp->brdfValues.resize(0);
+	fp->brdfPdfs.resize(0);
+	fp->sphereDirs.resize(sampleCount);
+
+	for (int i = 0; i < sampleCount; ++i) {
+		pivot::vec2 u = hammersley(i, sampleCount);
+		pivot::vec3 wm = pivot::ggx_sample(u, wo, alphaX, alphaY);
+		pivot::vec3 wi = 2.f * pivot::dot(wo, wm) * wm - wo;
+		float pdf, frp = pivot::ggx_evalp(wi, wo, alphaX, alphaY, &pdf);
+
+		if (pdf > 0.f) {
+			fp->brdfDirs.push_back(wi);
+			fp->brdfValues.push_back(frp);
+			fp->brdfPdfs.push_back(pdf);
+			albedo+= frp / pdf;
+		}
+		fp->sphereDirs[i] = pivot::u2_to_s2(u);
+	}
+	fp->albedo = (float)(albedo / sampleCount);
+
+	for (int i = 0; i < (int)fp->brdfValues.size(); ++i)
+		fp->brdfValues[i]/= fp->albedo;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Fitting Error
+ *
+ * Returns the L2 distance between the normalized BRDF and the PTSD of the
+ * pivot, estimated with the balance heuristic over the samples of both
+ * distributions.
+ */
+double fitError(const FitProblem& fp, const pivot::vec3& r_p)
+{
+	int sampleCount = (int)fp.sphereDirs.size();
+	double error = 0.0;
+
+	for (int i = 0; i < (int)fp.brdfDirs.size(); ++i) {
+		float f = fp.brdfValues[i];
+		float g = pivot::pdf_ps2(fp.brdfDirs[i], r_p);
+		float d = f - g;
+
+		error+= d * d / (fp.brdfPdfs[i] + g);
+	}
+	for (int i = 0; i < sampleCount; ++i) {
+		pivot::vec3 wi = pivot::s2_to_ps2(fp.sphereDirs[i], r_p);
+		float pdf, f = pivot::ggx_evalp(wi, fp.wo, fp.alphaX, fp.alphaY, &pdf)
+		             / fp.albedo;
+		float g = pivot::pdf_ps2(wi, r_p);
+		float d = f - g;
+
+		error+= d * d / (pdf + g);
+	}
+
+	return error / sampleCount;
+}
+
+// -----------------------------------------------------------------------------
+// albedo of the BRDF, estimated with the PTSD of the pivot as proposal
+float ptsdAlbedo(const FitProblem& fp, const pivot::vec3& r_p)
+{
+	int sampleCount = (int)fp.sphereDirs.size();
+	double albedo = 0.0;
+
+	for (int i = 0; i < sampleCount; ++i) {
+		pivot::vec3 wi = pivot::s2_to_ps2(fp.sphereDirs[i], r_p);
+		float pdf, frp = pivot::ggx_evalp(wi, fp.wo, fp.alphaX, fp.alphaY, &pdf);
+
+		albedo+= frp / pivot::pdf_ps2(wi, r_p);
+	}
+
+	return (float)(albedo / sampleCount);
+}
+
+// -----------------------------------------------------------------------------
+// fitting error of the (norm, elevation) parameters of isotropic tables
+struct PolarObjective {
+	const FitProblem& fp;
+	double operator()(const float *x) const {
+		if (x[0] < 0.f || x[0] > FIT_MAX_NORM || std::fabs(x[1]) > FIT_PI / 2.f)
+			return 1e30;
+
+		return fitError(fp, pivotFromParams(x[0], x[1]));
+	}
+};
+
+// fitting error of the tangent space pivot of anisotropic tables
+struct CartesianObjective {
+	const FitProblem& fp;
+	double operator()(const float *x) const {
+		pivot::vec3 r_p = pivot::vec3(x[0], x[1], x[2]);
+
+		if (pivot::dot(r_p, r_p) > FIT_MAX_NORM * FIT_MAX_NORM)
+			return 1e30;
+
+		return fitError(fp, r_p);
+	}
+};
+
+// -----------------------------------------------------------------------------
+/**
+ * Nelder-Mead Minimization
+ *
+ * Minimizes the objective f over N <= 3 parameters, starting from x with a
+ * simplex of size step; x receives the minimum.
+ */
+template <int N, typename F>
+void minimize(const F& f, float x[N], float step)
+{
+	float p[N + 1][N];
+	double v[N + 1];
+
+	for (int i = 0; i <= N; ++i) {
+		for (int k = 0; k < N; ++k)
+			p[i][k] = x[k] + (i == k + 1 ? step : 0.f);
+		v[i] = f(p[i]);
+	}
+
+	for (int it = 0; it < 256 * (N - 1); ++it) {
+		int h = 0, l = 0, s = -1;
+
+		// sort the vertices: worst (h), second worst (s) and best (l)
+		for (int i = 1; i <= N; ++i) {
+			if (v[i] > v[h]) h = i;
+			if (v[i] < v[l]) l = i;
+		}
+		if (h == l) break; // flat simplex
+		for (int i = 0; i <= N; ++i)
+			if (i != h && (s < 0 || v[i] > v[s])) s = i;
+
+		// convergence test
+		float size = 0.f;
+		for (int j = 0; j < N; ++j)
+			size = std::max(size, std::fabs(p[h][j] - p[l][j]));
+		if (size < 1e-6f || v[h] - v[l] <= 1e-9 * v[l])
+			break;
+
+		// reflect the worst vertex through the centroid of the others
+		float c[N], r[N], e[N], k[N];
+		for (int j = 0; j < N; ++j) {
+			c[j] = 0.f;
+			for (int i = 0; i <= N; ++i)
+				if (i != h) c[j]+= p[i][j];
+			c[j]/= N;
+			r[j] = 2.f * c[j] - p[h][j];
+			e[j] = 3.f * c[j] - 2.f * p[h][j];
+			k[j] = 0.5f * (c[j] + p[h][j]);
+		}
+		double vr = f(r);
+
+		if (vr < v[l]) {
+			double ve = f(e);
+
+			if (ve < vr) {
+				std::copy(e, e + N, p[h]); v[h] = ve;
+			} else {
+				std::copy(r, r + N, p[h]); v[h] = vr;
+			}
+		} else if (vr < v[s]) {
+			std::copy(r, r + N, p[h]); v[h] = vr;
+		} else {
+			double vk = f(k);
+
+			if (vk < v[h]) {
+				std::copy(k, k + N, p[h]); v[h] = vk;
+			} else {
+				// shrink towards the best vertex
+				for (int i = 0; i <= N; ++i) if (i != l) {
+					for (int j = 0; j < N; ++j)
+						p[i][j] = 0.5f * (p[i][j] + p[l][j]);
+					v[i] = f(p[i]);
+				}
+			}
+		}
+	}
+
+	int l = 0;
+	for (int i = 1; i <= N; ++i)
+		if (v[i] < v[l]) l = i;
+	std::copy(p[l], p[l] + N, x);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Fit a Row of the Table
+ *
+ * This procedure fits the texels of a given view elevation, from the
+ * smoothest to the roughest BRDF. Each fit starts from the previous one,
+ * and the first one starts from the mirror direction.
+ */
+void fitRow(int j, int res, int sampleCount, float *texels)
+{
+	float theta = std::min(FIT_MAX_THETA, (float)j / (res - 1) * FIT_PI / 2.f);
+	pivot::vec3 wo = pivot::vec3(std::sin(theta), 0, std::cos(theta));
+	float x[2] = {FIT_MAX_NORM, -theta};
+	FitProblem fp;
+
+	for (int i = 0; i < res; ++i) {
+		float roughness = (float)i / (res - 1);
+		float alpha = std::max(FIT_MIN_ALPHA, roughness * roughness);
+		float *texel = &texels[4 * (j * res + i)];
+
+		initFitProblem(alpha, alpha, wo, sampleCount, &fp);
+		minimize<2>(PolarObjective {fp}, x, 0.05f);
+
+		texel[0] = x[0];
+		texel[1] = x[1];
+		texel[2] = ptsdAlbedo(fp, pivotFromParams(x[0], x[1]));
+		texel[3] = fp.albedo;
+	}
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Fit a Row of the Anisotropic Table
+ *
+ * The anisotropic table is indexed by sqrt(alpha_x), theta, phi and
+ * sqrt(alpha_y), where phi in [0, pi/2] is the azimuth of wo (the other
+ * quadrants follow by symmetry). Each texel stores
+ *   rgb: the pivot, in the frame of wo (x points along the azimuth of wo)
+ *   a: the albedo of the BRDF
+ * We fit and store the pivot in Cartesian coordinates: polar coordinates
+ * have a branch cut where the pivot crosses the plane orthogonal to the
+ * azimuth of wo, across which they do not filter. Filtering pivots of the
+ * unit ball linearly keeps them inside it.
+ * A row holds the texels that only differ by alpha_x; it is fitted like
+ * the rows of the isotropic table.
+ */
+void fitRowAnisotropic(int row, const int res[4], int sampleCount, float *texels)
+{
+	int j = row % res[1], k = (row / res[1]) % res[2], l = row / (res[1] * res[2]);
+	float theta = std::min(FIT_MAX_THETA, (float)j / (res[1] - 1) * FIT_PI / 2.f);
+	float phi = (float)k / (res[2] - 1) * FIT_PI / 2.f;
+	float roughnessY = (float)l / (res[3] - 1);
+	float alphaY = std::max(FIT_MIN_ALPHA, roughnessY * roughnessY);
+	pivot::vec3 wo = pivot::vec3(std::sin(theta) * std::cos(phi),
+	                             std::sin(theta) * std::sin(phi),
+	                             std::cos(theta));
+	float x[3] = {-FIT_MAX_NORM * wo.x, -FIT_MAX_NORM * wo.y, FIT_MAX_NORM * wo.z};
+	FitProblem fp;
+
+	for (int i = 0; i < res[0]; ++i) {
+		float roughnessX = (float)i / (res[0] - 1);
+		float alphaX = std::max(FIT_MIN_ALPHA, roughnessX * roughnessX);
+		float *texel = &texels[4 * (row * res[0] + i)];
+
+		initFitProblem(alphaX, alphaY, wo, sampleCount, &fp);
+		minimize<3>(CartesianObjective {fp}, x, 0.05f);
+
+		// express the pivot in the frame of wo
+		texel[0] = x[0] * std::cos(phi) + x[1] * std::sin(phi);
+		texel[1] = x[1] * std::cos(phi) - x[0] * std::sin(phi);
+		texel[2] = x[2];
+		texel[3] = fp.albedo;
+	}
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Fit the Table
+ *
+ * The rows are independent, so the worker threads pull them from a shared
+ * counter; the result does not depend on the thread count. The resolution
+ * of an anisotropic table is given along each of its four dimensions; that
+ * of an isotropic table along its two dimensions.
+ */
+void
+fitTable(
+	bool anisotropic,
+	const int res[4],
+	int sampleCount,
+	int threadCount,
+	std::vector<float> *texels
+) {
+	int rowCount = anisotropic ? res[1] * res[2] * res[3] : res[1];
+	int texelCount = rowCount * res[0];
+	std::atomic<int> nextRow(0), rowsDone(0);
+	std::vector<std::thread> threads;
+
+	texels->resize(4 * texelCount);
+	for (int i = 0; i < threadCount; ++i) {
+		threads.push_back(std::thread([&]() {
+			int j;
+
+			while ((j = nextRow++) < rowCount) {
+				if (anisotropic)
+					fitRowAnisotropic(j, res, sampleCount, texels->data());
+				else
+					fitRow(j, res[0], sampleCount, texels->data());
+				LOG("\rFitting: %3i%%", 100 * ++rowsDone / rowCount);
+			}
+		}));
+	}
+	for (int i = 0; i < threadCount; ++i)
+		threads[i].join();
+	LOG("\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Analytic Fitting
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+/**
+ * Linear Least Squares
+ *
+ * Solves min |A x - b| for an m x n row-major matrix A (m >= n) with
+ * Householder reflections; A and b are overwritten.
+ */
+std::vector<double>
+leastSquares(std::vector<double>& A, std::vector<double>& b, int m, int n)
+{
+	std::vector<double> v(m), x(n);
+
+	for (int k = 0; k < n; ++k) {
+		double norm = 0.0, vv = 0.0;
+
+		for (int i = k; i < m; ++i)
+			norm+= A[i * n + k] * A[i * n + k];
+		norm = std::sqrt(norm);
+		for (int i = k; i < m; ++i)
+			v[i] = A[i * n + k];
+		v[k]+= A[k * n + k] > 0.0 ? norm : -norm;
+		for (int i = k; i < m; ++i)
+			vv+= v[i] * v[i];
+		if (vv == 0.0) continue;
+
+		for (int j = k; j < n; ++j) {
+			double d = 0.0;
+
+			for (int i = k; i < m; ++i) d+= v[i] * A[i * n + j];
+			d*= 2.0 / vv;
+			for (int i = k; i < m; ++i) A[i * n + j]-= d * v[i];
+		}
+		double d = 0.0;
+
+		for (int i = k; i < m; ++i) d+= v[i] * b[i];
+		d*= 2.0 / vv;
+		for (int i = k; i < m; ++i) b[i]-= d * v[i];
+	}
+	for (int k = n - 1; k >= 0; --k) {
+		double s = b[k];
+
+		for (int j = k + 1; j < n; ++j)
+			s-= A[k * n + j] * x[j];
+		x[k] = s / A[k * n + k];
+	}
+
+	return x;
+}
+
+// -----------------------------------------------------------------------------
+// monomials x^i c^j with i + j <= degree, in the order of pivot_fit.h
+void monomials(int degree, double x, double c, double *out)
+{
+	for (int i = 0, k = 0; i <= degree; ++i)
+		for (int j = 0; j <= degree - i; ++j)
+			out[k++] = std::pow(x, i) * std::pow(c, j);
+}
+
+double polynomial(int degree, const std::vector<double>& coeffs, double x, double c)
+{
+	std::vector<double> m(coeffs.size());
+	double p = 0.0;
+
+	monomials(degree, x, c, m.data());
+	for (int i = 0; i < (int)m.size(); ++i)
+		p+= coeffs[i] * m[i];
+
+	return p;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Fit Polynomials to the Table
+ *
+ * The pivot is fitted in Cartesian form, as the pair (t, n) such that
+ * pivot = n * normal - t * (wo - dot(wo, normal) * normal), i.e.,
+ * t = -norm * sin(elevation) / sin(theta) and n = norm * cos(elevation).
+ * Both are even functions of theta and are thus smooth in cos(theta),
+ * which, along with x = sqrt(alpha), is the variable of the polynomials.
+ * The BRDF scale is fitted directly. The mean and maximum errors against
+ * the table are reported for each fitted quantity.
+ */
+bool fitAnalytic(const std::vector<float>& texels, int degree)
+{
+	int res = (int)std::sqrt((double)(texels.size() / 4));
+	int n = (degree + 1) * (degree + 2) / 2;
+	std::vector<double> A[3], b[3], coeffs[3];
+	std::vector<double> m(n);
+	const char *names[] = {"tangent", "normal", "brdfScale"};
+
+	if (4 * res * res != (int)texels.size() || res < 2) {
+		LOG("=> The table is not square <=\n");
+		return false;
+	}
+
+	// build the least squares systems
+	for (int j = 0; j < res; ++j)
+	for (int i = 0; i < res; ++i) {
+		const float *texel = &texels[4 * (j * res + i)];
+		double x = (double)i / (res - 1);
+		double theta = (double)j / (res - 1) * FIT_PI / 2.0;
+		double norm = texel[0], elevation = texel[1];
+		double target[3] = {
+			-norm * std::sin(elevation) / std::sin(theta),
+			norm * std::cos(elevation),
+			texel[3]
+		};
+
+		monomials(degree, x, std::cos(theta), m.data());
+		for (int k = 0; k < 3; ++k) {
+			if (k == 0 && j == 0) continue; // undefined at normal incidence
+			A[k].insert(A[k].end(), m.begin(), m.end());
+			b[k].push_back(target[k]);
+		}
+	}
+	for (int k = 0; k < 3; ++k) {
+		if ((int)b[k].size() < n) {
+			LOG("=> The table is too small for degree %i <=\n", degree);
+			return false;
+		}
+		coeffs[k] = leastSquares(A[k], b[k], (int)b[k].size(), n);
+	}
+
+	// report the errors against the table
+	double errSum[4] = {0, 0, 0, 0}, errMax[4] = {0, 0, 0, 0};
+	const char *errNames[] = {"norm", "elevation", "brdfScale", "pivot"};
+
+	for (int j = 0; j < res; ++j)
+	for (int i = 0; i < res; ++i) {
+		const float *texel = &texels[4 * (j * res + i)];
+		double x = (double)i / (res - 1);
+		double theta = (double)j / (res - 1) * FIT_PI / 2.0;
+		double t = polynomial(degree, coeffs[0], x, std::cos(theta));
+		double nz = polynomial(degree, coeffs[1], x, std::cos(theta));
+		double px = -t * std::sin(theta);
+		double dx = px - texel[0] * std::sin(texel[1]);
+		double dz = nz - texel[0] * std::cos(texel[1]);
+		double err[4] = {
+			std::fabs(std::sqrt(px * px + nz * nz) - texel[0]),
+			std::fabs(std::atan2(px, nz) - texel[1]),
+			std::fabs(polynomial(degree, coeffs[2], x, std::cos(theta)) - texel[3]),
+			std::sqrt(dx * dx + dz * dz)
+		};
+
+		for (int k = 0; k < 4; ++k) {
+			errSum[k]+= err[k];
+			errMax[k] = std::max(errMax[k], err[k]);
+		}
+	}
+	LOG("Errors against %s (%ix%i texels):\n", g_app.files.input, res, res);
+	for (int k = 0; k < 4; ++k) {
+		LOG("  %-10s mean %.5f max %.5f\n",
+		    errNames[k], errSum[k] / (res * res), errMax[k]);
+	}
+
+	// print the coefficients
+	LOG("Coefficients (degree %i, %i per polynomial):\n", degree, n);
+	for (int k = 0; k < 3; ++k) {
+		LOG("\t// %s\n", names[k]);
+		for (int i = 0; i < n; ++i) {
+			LOG("%s% .8ef%s", i % 4 == 0 ? "\t" : " ",
+			    coeffs[k][i], i + 1 < n || k < 2 ? "," : "");
+			if (i % 4 == 3 || i + 1 == n) {
+				LOG("\n");
+			}
+		}
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Utility functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// reads a table in the format of fit.inl
+bool loadTable(std::vector<float> *texels)
+{
+	FILE *pf = fopen(g_app.files.input, "r");
+	float texel[4];
+
+	if (!pf) {
+		LOG("=> Failed to open %s <=\n", g_app.files.input);
+		return false;
+	}
+	texels->resize(0);
+	while (fscanf(pf, " %f , %f , %f , %f ,",
+	              &texel[0], &texel[1], &texel[2], &texel[3]) == 4)
+		texels->insert(texels->end(), texel, texel + 4);
+	fclose(pf);
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// rounds a float to the nearest half precision float (ties to even); NaNs
+// are not supported
+uint16_t floatToHalf(float f)
+{
+	uint32_t x, sign, mantissa, h, rem, tie;
+	int exponent;
+
+	memcpy(&x, &f, sizeof(x));
+	sign = (x >> 16) & 0x8000u;
+	exponent = (int)((x >> 23) & 0xFFu) - 127 + 15;
+	mantissa = x & 0x7FFFFFu;
+	if (exponent >= 31) // overflow
+		return (uint16_t)(sign | 0x7C00u);
+	if (exponent <= 0) { // subnormal
+		if (exponent < -10)
+			return (uint16_t)sign;
+		mantissa|= 0x800000u;
+		h = mantissa >> (14 - exponent);
+		rem = mantissa & ((1u << (14 - exponent)) - 1u);
+		tie = 1u << (13 - exponent);
+	} else {
+		h = ((uint32_t)exponent << 10) | (mantissa >> 13);
+		rem = mantissa & 0x1FFFu;
+		tie = 0x1000u;
+	}
+	if (rem > tie || (rem == tie && (h & 1u)))
+		++h; // may carry into the exponent, which rounds up correctly
+
+	return (uint16_t)(sign | h);
+}
+
+// -----------------------------------------------------------------------------
+// writes the table in the format of fit.inl, i.e., one texel per line;
+// anisotropic tables start with their resolution, followed by half
+// precision texels, two per line
+bool saveTable(bool anisotropic, const int res[4], const std::vector<float>& texels)
+{
+	FILE *pf = fopen(g_app.files.output, "w");
+	int texelCount = (int)texels.size() / 4;
+
+	if (!pf) {
+		LOG("=> Failed to open %s <=\n", g_app.files.output);
+		return false;
+	}
+	if (anisotropic) {
+		fprintf(pf, "\t%i, %i, %i, %i,\n", res[0], res[1], res[2], res[3]);
+		for (int i = 0; i < 4 * texelCount; ++i) {
+			fprintf(pf, "%s0x%04x%s",
+			        i % 8 == 0 ? "\t" : " ",
+			        floatToHalf(texels[i]),
+			        i + 1 < 4 * texelCount ? "," : "");
+			if (i % 8 == 7 || i + 1 == 4 * texelCount)
+				fprintf(pf, "\n");
+		}
+		fclose(pf);
+		LOG("Table written to %s\n", g_app.files.output);
+
+		return true;
+	}
+	for (int i = 0; i < texelCount; ++i) {
+		fprintf(pf, "\t%f, %f, %f, %f%s\n",
+		        texels[4 * i], texels[4 * i + 1],
+		        texels[4 * i + 2], texels[4 * i + 3],
+		        i + 1 < texelCount ? "," : "");
+	}
+	fclose(pf);
+	LOG("Table written to %s\n", g_app.files.output);
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+void usage(const char *app)
+{
+	LOG("usage: %s [options]\n"\
+	    "  --resolution <int>       table width and height, e.g., 64, 128, 256 (default %i)\n"\
+	    "  --samples <int>          samples per texel (default %i)\n"\
+	    "  --threads <int>          worker threads (default: all cores)\n"\
+	    "  --anisotropic <int>      fit the anisotropic table at this resolution\n"\
+	    "  --output <file>          output file (default fit.inl or fit_aniso.inl)\n"\
+	    "  --analytic <degree>      fit polynomials to the input table instead\n"\
+	    "  --input <file>           input table of --analytic (default %s)\n",
+	    app,
+	    g_app.fit.resolution, g_app.fit.sampleCount, g_app.files.input);
+}
+
+bool parseArgs(int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		}
+		if (!val) {
+			LOG("error: missing value for %s\n", arg);
+			return false;
+		}
+		++i;
+		if      (!strcmp(arg, "--resolution")) g_app.fit.resolution = atoi(val);
+		else if (!strcmp(arg, "--samples"))    g_app.fit.sampleCount = atoi(val);
+		else if (!strcmp(arg, "--threads"))    g_app.fit.threadCount = atoi(val);
+		else if (!strcmp(arg, "--anisotropic"))g_app.fit.anisotropic = atoi(val);
+		else if (!strcmp(arg, "--output"))     g_app.files.output = val;
+		else if (!strcmp(arg, "--analytic"))   g_app.analytic.degree = atoi(val);
+		else if (!strcmp(arg, "--input"))      g_app.files.input = val;
+		else {
+			LOG("error: unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (g_app.fit.resolution < 2) {
+		LOG("error: the resolution must be at least 2\n");
+		return false;
+	}
+	if (g_app.fit.anisotropic == 1 || g_app.fit.anisotropic < 0) {
+		LOG("error: the anisotropic resolution must be at least 2\n");
+		return false;
+	}
+	if (g_app.analytic.degree < 0) {
+		LOG("error: invalid polynomial degree\n");
+		return false;
+	}
+	if (g_app.fit.sampleCount < 1) {
+		LOG("error: invalid sample count\n");
+		return false;
+	}
+	if (g_app.fit.threadCount <= 0)
+		g_app.fit.threadCount = std::max(1u, std::thread::hardware_concurrency());
+	if (!g_app.files.output)
+		g_app.files.output = g_app.fit.anisotropic ? "fit_aniso.inl" : "fit.inl";
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+	std::vector<float> texels;
+
+	if (!parseArgs(argc, argv)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (g_app.analytic.degree > 0) {
+		if (!loadTable(&texels) || !fitAnalytic(texels, g_app.analytic.degree))
+			return EXIT_FAILURE;
+
+		return EXIT_SUCCESS;
+	}
+
+	// the azimuth varies less than the other parameters, so we sample it
+	// at half the resolution
+	bool anisotropic = g_app.fit.anisotropic > 0;
+	int n = anisotropic ? g_app.fit.anisotropic : g_app.fit.resolution;
+	int res[4] = {n, n, anisotropic ? std::max(2, n / 2) : 1, anisotropic ? n : 1};
+
+	LOG("-- Begin -- Fitting (%ix%ix%ix%i, %i samples, %i threads)\n",
+	    res[0], res[1], res[2], res[3],
+	    g_app.fit.sampleCount, g_app.fit.threadCount);
+	std::chrono::high_resolution_clock::time_point t0 =
+		std::chrono::high_resolution_clock::now();
+	fitTable(anisotropic, res, g_app.fit.sampleCount,
+	         g_app.fit.threadCount, &texels);
+	std::chrono::duration<double> dt =
+		std::chrono::high_resolution_clock::now() - t0;
+	LOG("-- End -- Fitting (%.3f s)\n", dt.count());
+
+	if (!saveTable(anisotropic, res, texels))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+//
+//
+////////////////////////////////////////////////////////////////////////////////
@@ -153,9 +153,18 @@ typedef unsigned int GLhandleARB;
 extern "C" {
 #endif /*__cplusplus*/
 
+extern int ogl_ext_ARB_buffer_storage;
 extern int ogl_ext_ARB_debug_output;
 extern int ogl_ext_EXT_texture_filter_anisotropic;
 
+#define GL_BUFFER_IMMUTABLE_STORAGE 0x821F
+#define GL_BUFFER_STORAGE_FLAGS 0x8220
+#define GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT 0x00004000
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_MAP_PERSISTENT_BIT 0x0040
+
 #define GL_DEBUG_CALLBACK_FUNCTION_ARB 0x8244
 #define GL_DEBUG_CALLBACK_USER_PARAM_ARB 0x8245
 #define GL_DEBUG_LOGGED_MESSAGES_ARB 0x9145
@@ -1462,6 +1471,12 @@ extern int ogl_ext_EXT_texture_filter_anisotropic;
 #define GL_VIEW_CLASS_S3TC_DXT5_RGBA 0x82CF
 #define GL_VIEW_COMPATIBILITY_CLASS 0x82B6
 
+#ifndef GL_ARB_buffer_storage
+#define GL_ARB_buffer_storage 1
+extern void (CODEGEN_FUNCPTR *_ptrc_glBufferStorage)(GLenum, GLsizeiptr, const void *, GLbitfield);
+#define glBufferStorage _ptrc_glBufferStorage
+#endif /*GL_ARB_buffer_storage*/ 
+
 #ifndef GL_ARB_debug_output
 #define GL_ARB_debug_output 1
 extern void (CODEGEN_FUNCPTR *_ptrc_glDebugMessageCallbackARB)(GLDEBUGPROCARB, const void *);
@@ -0,0 +1,565 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Complete program (this compiles):
+// Sphere Light Shading Demo - Headless CPU Renderer
+//
+// g++ -O3 -pthread headless.cpp -o headless
+//
+// Renders the planets scene on the CPU and writes the framebuffer to disk,
+// without requiring a window or an OpenGL context. Run with --help for
+// the list of options.
+//
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#define DJA_LOG(fmt, ...) LOG(fmt, ##__VA_ARGS__)
+#define DJ_ALGEBRA_IMPLEMENTATION 1
+#include "dj_algebra.h"
+
+#include "scene.h"
+#include "cpu_renderer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Application Manager
+struct AppManager {
+	struct {
+		int w, h;
+		int samplesPerPass, samplesPerPixel;
+		int sampler;
+		float adaptiveThreshold;
+		int adaptiveMinPassCount;
+		int threadCount, tileSize;
+		int extraLights;
+		float anisotropy;
+		float time;
+	} render;
+	struct {
+		float gamma, exposure;
+	} viewer;
+	struct {
+		const char *output;
+		const char *reference;
+		const char *roughness;
+		float tolerance;
+	} files;
+	struct {
+		int simdSamples; // batched kernel benchmark, 0 disables
+	} benchmark;
+} g_app = {
+	/*render*/ {1280, 720, 8, 1024, SAMPLER_SOBOL, 0.f, 4, 0, 16, 0, 0.f, 0.f},
+	/*viewer*/ {2.2f, -1.0f},
+	/*files*/  {"headless", NULL, "./textures/moon.png", 1e-2f},
+	/*benchmark*/ {0}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Utility functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+char *strcat2(char *dst, const char *src1, const char *src2)
+{
+	strcpy(dst, src1);
+
+	return strcat(dst, src2);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Roughness Texture
+ *
+ * This loads an 8-bit image as a single channel texture, as done for
+ * the R8 roughness texture of the OpenGL demo.
+ */
+bool loadRoughnessTexture(cpu::Texture *texture)
+{
+	int x, y, comp;
+
+	LOG("Loading {Roughness-Texture}\n");
+	stbi_uc *texels = stbi_load(g_app.files.roughness, &x, &y, &comp, 1);
+	if (!texels) {
+		LOG("=> Failure <=\n");
+		return false;
+	}
+	texture->w = x;
+	texture->h = y;
+	texture->texels.resize(x * y);
+	for (int i = 0; i < x * y; ++i)
+		texture->texels[i] = texels[i] / 255.f;
+	stbi_image_free(texels);
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Save the Framebuffer
+ *
+ * The resolved radiance is written as an HDR image; the tone mapped
+ * radiance (same operator as viewer.glsl) is written as a PNG image.
+ */
+bool saveFramebuffer(const std::vector<float>& rgb, int w, int h)
+{
+	std::vector<float> hdr(3 * w * h);
+	std::vector<unsigned char> png(3 * w * h);
+	float exposure = exp2f(g_app.viewer.exposure);
+	char buf[1024];
+	bool v = true;
+
+	for (int y = 0; y < h; ++y)
+	for (int x = 0; x < w; ++x) {
+		const float *src = &rgb[3 * ((h - 1 - y) * w + x)]; // flip rows
+		float *dst1 = &hdr[3 * (y * w + x)];
+		unsigned char *dst2 = &png[3 * (y * w + x)];
+		bool invalid = false;
+
+		for (int i = 0; i < 3; ++i) {
+			dst1[i] = src[i];
+			invalid|= !(src[i] >= 0.f); // negative or NaN
+		}
+		for (int i = 0; i < 3; ++i) {
+			float c = invalid ? (i == 0 ? 1.f : 0.f)
+			        : powf(src[i] * exposure, 1.f / g_app.viewer.gamma);
+
+			dst2[i] = (unsigned char)(std::min(std::max(c, 0.f), 1.f) * 255.f + 0.5f);
+		}
+	}
+
+	LOG("Writing {%s.hdr}\n", g_app.files.output);
+	v&= stbi_write_hdr(strcat2(buf, g_app.files.output, ".hdr"),
+	                   w, h, 3, &hdr[0]) != 0;
+	LOG("Writing {%s.png}\n", g_app.files.output);
+	v&= stbi_write_png(strcat2(buf, g_app.files.output, ".png"),
+	                   w, h, 3, &png[0], 3 * w) != 0;
+	if (!v) {
+		LOG("=> Failure <=\n");
+	}
+
+	return v;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Compare against a Reference
+ *
+ * Computes the RMSE between the resolved radiance and an HDR reference
+ * image written by a previous run; returns false if the RMSE exceeds the
+ * tolerance.
+ */
+bool compareReference(const std::vector<float>& rgb, int w, int h)
+{
+	int x, y, comp;
+	double sum = 0.0;
+
+	LOG("Loading {Reference-Image}\n");
+	float *ref = stbi_loadf(g_app.files.reference, &x, &y, &comp, 3);
+	if (!ref) {
+		LOG("=> Failure <=\n");
+		return false;
+	}
+	if (x != w || y != h) {
+		LOG("=> Failure: reference is %ix%i, rendering is %ix%i <=\n", x, y, w, h);
+		stbi_image_free(ref);
+		return false;
+	}
+	for (int j = 0; j < h; ++j)
+	for (int i = 0; i < w * 3; ++i) {
+		double d = rgb[(h - 1 - j) * w * 3 + i] - ref[j * w * 3 + i];
+
+		sum+= d * d;
+	}
+	stbi_image_free(ref);
+
+	double rmse = sqrt(sum / (3.0 * w * h));
+	bool v = rmse <= g_app.files.tolerance && rmse == rmse;
+	LOG("RMSE: %g (tolerance: %g) => %s\n",
+	    rmse, g_app.files.tolerance, v ? "PASS" : "FAIL");
+
+	return v;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Benchmark the Batched Pivot Kernels
+ *
+ * Times the batched r3_to_pr3 and pivot_jacobian functions of pivot.h at
+ * each instruction set supported by the CPU (see pivot::simd), and reports
+ * their largest relative deviation from the scalar kernels.
+ */
+void benchmarkSimd(int count)
+{
+	const char *names[] = {"scalar", "avx2", "avx512"};
+	const int runCnt = 16;
+	std::vector<float> r(3 * count), p(3 * count), wk(3 * count);
+	std::vector<float> ref(4 * count), out(4 * count);
+	pivot::cvec3_soa rs(&r[0], &r[count], &r[2 * count]);
+	pivot::cvec3_soa ps(&p[0], &p[count], &p[2 * count]);
+	pivot::cvec3_soa wks(&wk[0], &wk[count], &wk[2 * count]);
+	pivot::vec3_soa refs = {&ref[0], &ref[count], &ref[2 * count]};
+	pivot::vec3_soa outs = {&out[0], &out[count], &out[2 * count]};
+	int level = pivot::simd::level();
+
+	// points in [-2, 2]^3, pivots inside the unit ball, unit directions
+	for (int i = 0; i < count; ++i) {
+		float u[6];
+
+		for (int j = 0; j < 6; ++j)
+			u[j] = sampler_tofloat(sampler_hash(6 * i + j));
+		pivot::vec3 pv = (0.99f * u[5]) * pivot::u2_to_s2(pivot::vec2(u[3], u[4]));
+		pivot::vec3 wv = pivot::u2_to_s2(pivot::vec2(u[4], u[0]));
+
+		for (int j = 0; j < 3; ++j)
+			r[j * count + i] = 4.f * u[j] - 2.f;
+		p[i] = pv.x; p[count + i] = pv.y; p[2 * count + i] = pv.z;
+		wk[i] = wv.x; wk[count + i] = wv.y; wk[2 * count + i] = wv.z;
+	}
+	pivot::simd::set_level(pivot::simd::SCALAR);
+	pivot::r3_to_pr3(count, rs, ps, refs);
+	pivot::pivot_jacobian(count, wks, ps, &ref[3 * count]);
+
+	LOG("-- Begin -- SIMD Benchmark (%i samples)\n", count);
+	for (int i = pivot::simd::SCALAR; i <= pivot::simd::detect(); ++i) {
+		std::chrono::high_resolution_clock::time_point t0, t1, t2;
+		double error = 0.0;
+
+		pivot::simd::set_level(i);
+		t0 = std::chrono::high_resolution_clock::now();
+		for (int j = 0; j < runCnt; ++j)
+			pivot::r3_to_pr3(count, rs, ps, outs);
+		t1 = std::chrono::high_resolution_clock::now();
+		for (int j = 0; j < runCnt; ++j)
+			pivot::pivot_jacobian(count, wks, ps, &out[3 * count]);
+		t2 = std::chrono::high_resolution_clock::now();
+		for (int j = 0; j < 4 * count; ++j) {
+			double d = std::fabs(out[j] - ref[j]) / std::max(1.f, std::fabs(ref[j]));
+
+			error = std::max(error, d);
+		}
+
+		std::chrono::duration<double> dt1 = t1 - t0, dt2 = t2 - t1;
+		LOG("%-6s r3_to_pr3: %7.1f MSamples/s, pivot_jacobian: %7.1f MSamples/s (error: %g)\n",
+		    names[i],
+		    1e-6 * runCnt * count / dt1.count(),
+		    1e-6 * runCnt * count / dt2.count(),
+		    error);
+	}
+	LOG("-- End -- SIMD Benchmark\n");
+	pivot::simd::set_level(level);
+}
+
+// -----------------------------------------------------------------------------
+void usage(const char *app)
+{
+	LOG("usage: %s [options]\n"\
+	    "  --width <int>            framebuffer width (default %i)\n"\
+	    "  --height <int>           framebuffer height (default %i)\n"\
+	    "  --shading <mode>         pivot, mis, mis_joint, cap, ggx, cos, h2, s2, debug\n"\
+	    "  --spp <int>              samples per pixel (default %i)\n"\
+	    "  --spp-per-pass <int>     samples per pass, at most 64 (default %i)\n"\
+	    "  --sampler <name>         random, sobol, lattice (default sobol)\n"\
+	    "  --pivot-fit <name>       table, analytic (default table)\n"\
+	    "  --adaptive <float>       relative error target, 0 disables adaptive sampling (default %g)\n"\
+	    "  --adaptive-passes <int>  passes before estimating the variance (default %i)\n"\
+	    "  --threads <int>          worker threads (default: all cores)\n"\
+	    "  --tile-size <int>        tile size, in pixels (default %i)\n"\
+	    "  --lights <int>           number of extra lights (default %i)\n"\
+	    "  --anisotropy <float>     anisotropy of the planets, in [0, 1] (default %g)\n"\
+	    "  --clusters <0|1>         clustered light culling, biased for distant lights (default %i)\n"\
+	    "  --cluster-cutoff <float> light culling cutoff (default %g)\n"\
+	    "  --cluster-tile <int>     light cluster tile size, in pixels (default %i)\n"\
+	    "  --cluster-slices <int>   light cluster depth slices (default %i)\n"\
+	    "  --light-tree <0|1>       sample one light per sample in the mis modes (default %i)\n"\
+	    "  --time <float>           animation time (default %g)\n"\
+	    "  --exposure <float>       tone mapping exposure (default %g)\n"\
+	    "  --gamma <float>          tone mapping gamma (default %g)\n"\
+	    "  --roughness <file>       roughness texture (default %s)\n"\
+	    "  --output <prefix>        writes <prefix>.hdr and <prefix>.png (default %s)\n"\
+	    "  --reference <file.hdr>   compare the rendering against a reference\n"\
+	    "  --tolerance <float>      maximum RMSE against the reference (default %g)\n"\
+	    "  --simd-benchmark <int>   times the batched pivot kernels on <int> samples, then exits\n",
+	    app,
+	    g_app.render.w, g_app.render.h,
+	    g_app.render.samplesPerPixel, g_app.render.samplesPerPass,
+	    g_app.render.adaptiveThreshold, g_app.render.adaptiveMinPassCount,
+	    g_app.render.tileSize, g_app.render.extraLights, g_app.render.anisotropy,
+	    (int)g_lightClusters.enabled,
+	    g_lightClusters.cutoff, g_lightClusters.tileSize, g_lightClusters.zSlices,
+	    (int)g_lightTree.enabled,
+	    g_app.render.time,
+	    g_app.viewer.exposure, g_app.viewer.gamma,
+	    g_app.files.roughness, g_app.files.output, g_app.files.tolerance);
+}
+
+bool parseShadingMode(const char *str)
+{
+	const char *modes[] = {
+		"pivot", "mis", "mis_joint", "cap", "ggx", "cos", "h2", "s2", "debug"
+	};
+	const int ids[] = {
+		SHADING_PIVOT, SHADING_MC_MIS, SHADING_MC_MIS_JOINT, SHADING_MC_CAP,
+		SHADING_MC_GGX, SHADING_MC_COS, SHADING_MC_H2, SHADING_MC_S2,
+		SHADING_DEBUG
+	};
+
+	for (int i = 0; i < (int)(sizeof(ids) / sizeof(ids[0])); ++i) {
+		if (!strcmp(str, modes[i])) {
+			g_planets.shadingMode = ids[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool parseSampler(const char *str)
+{
+	const char *samplers[] = {"random", "sobol", "lattice"};
+	const int ids[] = {SAMPLER_RANDOM, SAMPLER_SOBOL, SAMPLER_LATTICE};
+
+	for (int i = 0; i < (int)(sizeof(ids) / sizeof(ids[0])); ++i) {
+		if (!strcmp(str, samplers[i])) {
+			g_app.render.sampler = ids[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool parseArgs(int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		}
+		if (!val) {
+			LOG("error: missing value for %s\n", arg);
+			return false;
+		}
+		++i;
+		if      (!strcmp(arg, "--width"))        g_app.render.w = atoi(val);
+		else if (!strcmp(arg, "--height"))       g_app.render.h = atoi(val);
+		else if (!strcmp(arg, "--spp"))          g_app.render.samplesPerPixel = atoi(val);
+		else if (!strcmp(arg, "--spp-per-pass")) g_app.render.samplesPerPass = atoi(val);
+		else if (!strcmp(arg, "--adaptive"))     g_app.render.adaptiveThreshold = atof(val);
+		else if (!strcmp(arg, "--adaptive-passes")) g_app.render.adaptiveMinPassCount = atoi(val);
+		else if (!strcmp(arg, "--threads"))      g_app.render.threadCount = atoi(val);
+		else if (!strcmp(arg, "--tile-size"))    g_app.render.tileSize = atoi(val);
+		else if (!strcmp(arg, "--lights"))       g_app.render.extraLights = atoi(val);
+		else if (!strcmp(arg, "--anisotropy"))   g_app.render.anisotropy = atof(val);
+		else if (!strcmp(arg, "--clusters"))       g_lightClusters.enabled = atoi(val) != 0;
+		else if (!strcmp(arg, "--cluster-cutoff")) g_lightClusters.cutoff = atof(val);
+		else if (!strcmp(arg, "--cluster-tile"))   g_lightClusters.tileSize = atoi(val);
+		else if (!strcmp(arg, "--cluster-slices")) g_lightClusters.zSlices = atoi(val);
+		else if (!strcmp(arg, "--light-tree"))     g_lightTree.enabled = atoi(val) != 0;
+		else if (!strcmp(arg, "--time"))         g_app.render.time = atof(val);
+		else if (!strcmp(arg, "--exposure"))     g_app.viewer.exposure = atof(val);
+		else if (!strcmp(arg, "--gamma"))        g_app.viewer.gamma = atof(val);
+		else if (!strcmp(arg, "--roughness"))    g_app.files.roughness = val;
+		else if (!strcmp(arg, "--output"))       g_app.files.output = val;
+		else if (!strcmp(arg, "--reference"))    g_app.files.reference = val;
+		else if (!strcmp(arg, "--tolerance"))    g_app.files.tolerance = atof(val);
+		else if (!strcmp(arg, "--simd-benchmark")) g_app.benchmark.simdSamples = atoi(val);
+		else if (!strcmp(arg, "--shading")) {
+			if (!parseShadingMode(val)) {
+				LOG("error: unknown shading mode %s\n", val);
+				return false;
+			}
+		} else if (!strcmp(arg, "--pivot-fit")) {
+			if (!strcmp(val, "table") || !strcmp(val, "analytic")) {
+				g_planets.flags.analyticPivotFit = !strcmp(val, "analytic");
+			} else {
+				LOG("error: unknown pivot fit %s\n", val);
+				return false;
+			}
+		} else if (!strcmp(arg, "--sampler")) {
+			if (!parseSampler(val)) {
+				LOG("error: unknown sampler %s\n", val);
+				return false;
+			}
+		} else {
+			LOG("error: unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (g_app.render.w <= 0 || g_app.render.h <= 0) {
+		LOG("error: invalid framebuffer size\n");
+		return false;
+	}
+	if (g_app.render.samplesPerPass < 1 || g_app.render.samplesPerPass > 64) {
+		LOG("error: samples per pass must be in [1, 64]\n");
+		return false;
+	}
+	if (g_app.render.anisotropy < 0.f || g_app.render.anisotropy > 1.f) {
+		LOG("error: the anisotropy must be in [0, 1]\n");
+		return false;
+	}
+	if (g_app.render.extraLights < 0) {
+		LOG("error: invalid light count\n");
+		return false;
+	}
+	if (g_lightClusters.enabled && !(g_lightClusters.cutoff > 0.f)) {
+		LOG("error: the light culling cutoff must be positive\n");
+		return false;
+	}
+	if (g_app.render.tileSize <= 0) {
+		LOG("error: invalid tile size\n");
+		return false;
+	}
+	if (g_app.benchmark.simdSamples < 0) {
+		LOG("error: invalid benchmark sample count\n");
+		return false;
+	}
+	if (g_app.render.threadCount <= 0)
+		g_app.render.threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+	const float pivotData[] = {
+	#include "fit.inl"
+	};
+	const int pivotRes = (int)std::sqrt((double)(sizeof(pivotData) / sizeof(float) / 4));
+	const cpu::PivotTable pivotTable = {pivotRes, pivotRes, pivotData};
+	static const uint16_t pivotAnisoData[] = {
+	#include "fit_aniso.inl"
+	};
+	const int pivotAnisoCount = (int)(sizeof(pivotAnisoData) / sizeof(uint16_t)) - 4;
+	std::vector<float> pivotAnisoTexels(pivotAnisoCount);
+	for (int i = 0; i < pivotAnisoCount; ++i)
+		pivotAnisoTexels[i] = cpu::halfToFloat(pivotAnisoData[4 + i]);
+	const cpu::AnisoPivotTable anisoPivotTable = {
+		{(int)pivotAnisoData[0], (int)pivotAnisoData[1],
+		 (int)pivotAnisoData[2], (int)pivotAnisoData[3]},
+		pivotAnisoTexels.data()
+	};
+	cpu::Texture roughness;
+	cpu::Framebuffer fb;
+	cpu::Settings settings;
+	std::vector<SphereTransform> transforms;
+	std::vector<SphereData> spheres;
+	std::vector<int32_t> lightIds;
+	LightClusters clusters;
+	LightTree lightTree;
+	cpu::Scene scene;
+	std::vector<float> rgb;
+
+	if (!parseArgs(argc, argv)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (g_app.benchmark.simdSamples > 0) {
+		benchmarkSimd(g_app.benchmark.simdSamples);
+		return EXIT_SUCCESS;
+	}
+	if (!loadRoughnessTexture(&roughness))
+		return EXIT_FAILURE;
+
+	settings.shadingMode = g_planets.shadingMode;
+	settings.sampler = g_app.render.sampler;
+	settings.adaptive.threshold = g_app.render.adaptiveThreshold;
+	settings.adaptive.minPassCount = g_app.render.adaptiveMinPassCount;
+	settings.samplesPerPass = g_app.render.samplesPerPass;
+	settings.threadCount = g_app.render.threadCount;
+	settings.tileSize = g_app.render.tileSize;
+	settings.clearColor.r = 61./255.;
+	settings.clearColor.g = 119./255.;
+	settings.clearColor.b = 192./225;
+	settings.roughness = &roughness;
+	settings.pivotTable = g_planets.flags.analyticPivotFit ? NULL : &pivotTable;
+	settings.anisoPivotTable = &anisoPivotTable;
+
+	// setup the scene
+	setExtraLights(g_app.render.extraLights, 1);
+	for (int i = 0; i < (int)g_planets.planets.size(); ++i)
+		g_planets.planets[i].anisotropy = g_app.render.anisotropy;
+	advancePlanets(g_app.render.time);
+	computeSphereData((float)g_app.render.w / (float)g_app.render.h,
+	                  &transforms, &spheres, &lightIds);
+	scene.transforms = transforms.data();
+	scene.spheres = spheres.data();
+	scene.sphereCount = (int)spheres.size();
+	scene.lightIds = lightIds.data();
+	scene.lightCount = (int)lightIds.size();
+	scene.clusters = NULL;
+	if (g_lightClusters.enabled) {
+		buildLightClusters(g_app.render.w, g_app.render.h,
+		                   spheres, lightIds, &clusters);
+		scene.clusters = &clusters;
+		LOG("Light clusters: %ix%ix%i, %i light references\n",
+		    clusters.xTiles, clusters.yTiles, clusters.zSlices,
+		    (int)clusters.lightIds.size());
+	}
+	scene.lightTree = NULL;
+	if (g_lightTree.enabled) {
+		buildLightTree(spheres, lightIds, &lightTree);
+		scene.lightTree = &lightTree;
+		LOG("Light tree: %i nodes\n", (int)lightTree.nodes.size());
+	}
+
+	// render
+	int passCnt = g_app.render.samplesPerPixel / g_app.render.samplesPerPass;
+	if (!passCnt) passCnt = 1;
+
+	LOG("-- Begin -- Rendering (%ix%i, %i spheres, %i lights, %i passes, %i threads)\n",
+	    g_app.render.w, g_app.render.h, scene.sphereCount, scene.lightCount,
+	    passCnt, settings.threadCount);
+	std::chrono::high_resolution_clock::time_point t0 =
+		std::chrono::high_resolution_clock::now();
+	cpu::clear(&fb, g_app.render.w, g_app.render.h);
+	cpu::render(settings, scene, 0, passCnt, &fb);
+	std::chrono::duration<double> dt =
+		std::chrono::high_resolution_clock::now() - t0;
+	LOG("-- End -- Rendering (%.3f s)\n", dt.count());
+	if (settings.adaptive.threshold > 0.f) {
+		double sampleCnt = 0.0;
+
+		for (int i = 0; i < fb.w * fb.h; ++i)
+			sampleCnt+= fb.rgba[4 * i + 3];
+		LOG("Adaptive sampling: %.1f samples per pixel on average\n",
+		    sampleCnt / (fb.w * fb.h));
+	}
+
+	// output
+	cpu::resolve(fb, &rgb);
+	if (!saveFramebuffer(rgb, fb.w, fb.h))
+		return EXIT_FAILURE;
+	if (g_app.files.reference && !compareReference(rgb, fb.w, fb.h))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+
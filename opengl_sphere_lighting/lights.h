@@ -0,0 +1,347 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Sphere Light Shading Demo - Light Culling
+//
+// This file implements clustered light culling for the spherical lights of
+// the planets scene. The view frustum is cut into froxels: screen tiles that
+// are sliced exponentially in depth. Each light is bounded by an influence
+// sphere, beyond which its contribution falls below a cutoff, and is
+// assigned to the froxels that this sphere overlaps. Shading then only
+// loops over the lights of the froxel that contains the shading point.
+// It also implements a light tree, i.e., a bounding volume hierarchy over
+// the lights that the Monte Carlo MIS modes traverse stochastically to
+// select a single light per sample, in O(log N).
+// The clusters and the tree are built on the CPU each frame and consumed
+// both by sphere.glsl and the CPU renderer.
+// It must be included after scene.h.
+//
+
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Light Cluster Manager (disabled by default: the influence radius of the
+// lights ignores the BRDF, so culling biases glossy highlights, including
+// those of the Monte Carlo modes)
+struct LightClusterManager {
+	bool enabled;
+	int tileSize;  // width and height of the froxels, in pixels
+	int zSlices;   // number of depth slices
+	float cutoff;  // radiance below which a light is ignored
+} g_lightClusters = {
+	false, 64, 32, 1e-3f
+};
+
+// -----------------------------------------------------------------------------
+// Light Tree Manager
+struct LightTreeManager {
+	bool enabled; // sample one light per sample in the MC MIS modes
+} g_lightTree = {
+	false
+};
+
+// -----------------------------------------------------------------------------
+// Light Clusters
+struct LightClusters {
+	int xTiles, yTiles, zSlices;
+	int tileSize;
+	float zNear, depthScale;       // slice = log(depth / zNear) * depthScale
+	std::vector<int32_t> ranges;   // per froxel (offset, count) pairs
+	std::vector<int32_t> lightIds; // concatenated per froxel light lists
+};
+
+// -----------------------------------------------------------------------------
+// Light Tree (the memory layout of the nodes matches that of the GLSL code)
+struct LightNode {
+	dja::vec4 bounds;    // xyz: view-space center; w: radius
+	float energy;        // sum of the lights' radiance times their radius^2
+	int32_t children[2]; // node indexes, {-1, -1} for leaves
+	int32_t sphereId;    // sphere index of leaves, -1 otherwise
+};
+struct LightTree {
+	std::vector<LightNode> nodes; // the root is the first node
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Light Culling
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+/**
+ * Compute the Influence Radius of a Light
+ *
+ * A sphere of radius r and radiance L subtends a solid angle smaller than
+ * pi r^2 / d^2 at distance d, so that the irradiance it produces is bounded
+ * by L pi r^2 / d^2. The influence radius is the distance at which this
+ * bound reaches the cutoff. Note that the bound ignores the BRDF, so that
+ * the highlights of very distant lights on very glossy surfaces are lost.
+ */
+inline float lightInfluenceRadius(const SphereData& light, float cutoff)
+{
+	float L = std::max(light.light.x, std::max(light.light.y, light.light.z));
+	float r = light.geometry.w;
+
+	return std::max(r, r * std::sqrt((float)M_PI * L / cutoff));
+}
+
+// -----------------------------------------------------------------------------
+// range of tiles [min, max] covered by a view-space sphere along an axis of
+// the screen; f is the focal length along that axis, and tilesPerNdc the
+// number of tiles that cover the [0, 1] half of the NDC range
+inline void
+lightClusters__tileRange(
+	float c, float depth, float radius, float f, float tilesPerNdc, int tileCnt,
+	int *tileMin, int *tileMax
+) {
+	float d2 = c * c + depth * depth;
+
+	*tileMin = 0;
+	*tileMax = tileCnt - 1;
+	if (d2 > radius * radius && depth > 0.f) {
+		float angle = std::atan2(c, depth);
+		float delta = std::asin(radius / std::sqrt(d2));
+		float halfPi = (float)M_PI / 2.f;
+
+		if (angle - delta > -halfPi) {
+			float ndc = std::tan(angle - delta) * f;
+			float x = std::floor((ndc + 1.f) * tilesPerNdc);
+			*tileMin = (int)std::max(0.f, std::min(x, (float)tileCnt));
+		}
+		if (angle + delta < halfPi) {
+			float ndc = std::tan(angle + delta) * f;
+			float x = std::floor((ndc + 1.f) * tilesPerNdc);
+			*tileMax = (int)std::max(-1.f, std::min(x, (float)tileCnt - 1));
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Build the Light Clusters
+ *
+ * This procedure assigns the lights to the froxels of a w x h framebuffer
+ * using the camera of the scene. The froxel bounds of each light are
+ * computed from the screen-space bounding rectangle and the depth range of
+ * its influence sphere; the per-froxel lists are then filled with a
+ * counting sort.
+ */
+inline void
+buildLightClusters(
+	int w, int h,
+	const std::vector<SphereData>& spheres,
+	const std::vector<int32_t>& lightIds,
+	LightClusters *clusters
+) {
+	int tileSize = std::max(1, g_lightClusters.tileSize);
+	int xTiles = (w + tileSize - 1) / tileSize;
+	int yTiles = (h + tileSize - 1) / tileSize;
+	int zSlices = std::max(1, g_lightClusters.zSlices);
+	int clusterCnt = xTiles * yTiles * zSlices;
+	float f = 1.f / std::tan(radians(g_camera.fovy) / 2.f);
+	float aspect = (float)w / (float)h;
+	float zNear = g_camera.zNear, zFar = g_camera.zFar;
+	float depthScale = (float)zSlices / std::log(zFar / zNear);
+	std::vector<int32_t> bounds(6 * lightIds.size());
+
+	clusters->xTiles = xTiles;
+	clusters->yTiles = yTiles;
+	clusters->zSlices = zSlices;
+	clusters->tileSize = tileSize;
+	clusters->zNear = zNear;
+	clusters->depthScale = depthScale;
+	clusters->ranges.assign(2 * clusterCnt, 0);
+
+	// compute froxel bounds and count the lights of each froxel
+	for (int k = 0; k < (int)lightIds.size(); ++k) {
+		const SphereData& light = spheres[lightIds[k]];
+		float radius = lightInfluenceRadius(light, g_lightClusters.cutoff);
+		float depth = -light.geometry.x;
+		float depthMin = std::max(zNear, depth - radius);
+		float depthMax = std::min(zFar, depth + radius);
+		int32_t *b = &bounds[6 * k];
+
+		if (depthMin > depthMax) {
+			b[0] = b[2] = b[4] = 0;
+			b[1] = b[3] = b[5] = -1;
+			continue;
+		}
+		lightClusters__tileRange(light.geometry.y, depth, radius,
+		                         f / aspect, 0.5f * w / tileSize, xTiles,
+		                         &b[0], &b[1]);
+		lightClusters__tileRange(light.geometry.z, depth, radius,
+		                         f, 0.5f * h / tileSize, yTiles,
+		                         &b[2], &b[3]);
+		b[4] = std::min(zSlices - 1, (int)(std::log(depthMin / zNear) * depthScale));
+		b[5] = std::min(zSlices - 1, (int)(std::log(depthMax / zNear) * depthScale));
+
+		for (int z = b[4]; z <= b[5]; ++z)
+		for (int y = b[2]; y <= b[3]; ++y)
+		for (int x = b[0]; x <= b[1]; ++x)
+			++clusters->ranges[2 * ((z * yTiles + y) * xTiles + x) + 1];
+	}
+
+	// compute the offsets of the lists
+	int offset = 0;
+	for (int i = 0; i < clusterCnt; ++i) {
+		clusters->ranges[2 * i] = offset;
+		offset+= clusters->ranges[2 * i + 1];
+		clusters->ranges[2 * i + 1] = 0;
+	}
+	clusters->lightIds.resize(offset);
+
+	// fill the lists
+	for (int k = 0; k < (int)lightIds.size(); ++k) {
+		const int32_t *b = &bounds[6 * k];
+
+		for (int z = b[4]; z <= b[5]; ++z)
+		for (int y = b[2]; y <= b[3]; ++y)
+		for (int x = b[0]; x <= b[1]; ++x) {
+			int32_t *range = &clusters->ranges[2 * ((z * yTiles + y) * xTiles + x)];
+
+			clusters->lightIds[range[0] + range[1]++] = lightIds[k];
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Find the Cluster of a Fragment
+ *
+ * Returns the index of the froxel that contains a fragment, given its
+ * window coordinates and view-space depth; same as lightRange() in
+ * sphere.glsl.
+ */
+inline int lightClusterIndex(const LightClusters& clusters, int x, int y, float depth)
+{
+	int tx = std::min(x / clusters.tileSize, clusters.xTiles - 1);
+	int ty = std::min(y / clusters.tileSize, clusters.yTiles - 1);
+	int tz = (int)(std::log(depth / clusters.zNear) * clusters.depthScale);
+
+	tz = std::max(0, std::min(tz, clusters.zSlices - 1));
+
+	return (tz * clusters.yTiles + ty) * clusters.xTiles + tx;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Light Tree
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// recursively build the subtree of the lights [begin, end) and return the
+// index of its root; leaves hold a single light
+inline int
+lightTree__build(
+	const std::vector<SphereData>& spheres,
+	int32_t *begin, int32_t *end,
+	std::vector<LightNode> *nodes
+) {
+	int nodeId = (int)nodes->size();
+	LightNode node;
+
+	nodes->push_back(node);
+	if (end - begin == 1) {
+		const SphereData& light = spheres[*begin];
+		float L = (light.light.x + light.light.y + light.light.z) / 3.f;
+		float r = light.geometry.w;
+
+		node.bounds = light.geometry;
+		node.energy = L * r * r;
+		node.children[0] = node.children[1] = -1;
+		node.sphereId = *begin;
+	} else {
+		// split the lights at the median of the widest centroid axis
+		float bmin[3] = {+1e30f, +1e30f, +1e30f};
+		float bmax[3] = {-1e30f, -1e30f, -1e30f};
+		int axis = 0;
+
+		for (const int32_t *it = begin; it != end; ++it) {
+			const dja::vec4& g = spheres[*it].geometry;
+			const float c[3] = {g.x, g.y, g.z};
+
+			for (int i = 0; i < 3; ++i) {
+				bmin[i] = std::min(bmin[i], c[i]);
+				bmax[i] = std::max(bmax[i], c[i]);
+			}
+		}
+		for (int i = 1; i < 3; ++i)
+			if (bmax[i] - bmin[i] > bmax[axis] - bmin[axis])
+				axis = i;
+		int32_t *mid = begin + (end - begin) / 2;
+		std::nth_element(begin, mid, end, [&](int32_t a, int32_t b) {
+			const dja::vec4& ga = spheres[a].geometry;
+			const dja::vec4& gb = spheres[b].geometry;
+			const float ca[3] = {ga.x, ga.y, ga.z};
+			const float cb[3] = {gb.x, gb.y, gb.z};
+
+			return ca[axis] < cb[axis];
+		});
+		node.children[0] = lightTree__build(spheres, begin, mid, nodes);
+		node.children[1] = lightTree__build(spheres, mid, end, nodes);
+		node.sphereId = -1;
+
+		// bound the bounding spheres of the children
+		const LightNode& n1 = (*nodes)[node.children[0]];
+		const LightNode& n2 = (*nodes)[node.children[1]];
+		dja::vec3 c1 = dja::vec3(n1.bounds.x, n1.bounds.y, n1.bounds.z);
+		dja::vec3 c2 = dja::vec3(n2.bounds.x, n2.bounds.y, n2.bounds.z);
+		float r1 = n1.bounds.w, r2 = n2.bounds.w;
+		float d = dja::norm(c2 - c1);
+
+		if (d + r2 <= r1) {
+			node.bounds = n1.bounds;
+		} else if (d + r1 <= r2) {
+			node.bounds = n2.bounds;
+		} else {
+			float r = (d + r1 + r2) / 2.f;
+			dja::vec3 c = c1 + ((r - r1) / d) * (c2 - c1);
+
+			node.bounds = dja::vec4(c.x, c.y, c.z, r);
+		}
+		node.energy = n1.energy + n2.energy;
+	}
+	(*nodes)[nodeId] = node;
+
+	return nodeId;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Build the Light Tree
+ *
+ * This procedure builds a binary bounding volume hierarchy over the lights,
+ * splitting them at the median of their widest axis. Each node stores a
+ * bounding sphere and the energy of its lights, from which the importance
+ * of the node is estimated during traversal: the energy divided by the
+ * squared radius of the bounding sphere gives the radiance of a sphere with
+ * the same power, which is integrated against the pivot approximation of
+ * the BRDF over the cap subtended by the bounding sphere (see
+ * lightTreeSample() in sphere.glsl).
+ */
+inline void
+buildLightTree(
+	const std::vector<SphereData>& spheres,
+	const std::vector<int32_t>& lightIds,
+	LightTree *tree
+) {
+	std::vector<int32_t> ids = lightIds;
+
+	tree->nodes.resize(0);
+	tree->nodes.reserve(2 * ids.size());
+	if (!ids.empty())
+		lightTree__build(spheres, &ids[0], &ids[0] + ids.size(), &tree->nodes);
+}
+
+#endif // LIGHTS_H
+
@@ -0,0 +1,833 @@
+/* pivot.h - public domain C++ library
+by Jonathan Dupuy
+
+	This file is a CPU port of pivot.glsl. It provides utility functions
+	for the sphere light shading technique described in my paper
+	"A Spherical Cap Preserving Parameterization for Spherical Distributions".
+
+	The scalar API mirrors the GLSL library one-to-one, so that shader code
+	can be ported to C++ verbatim. In addition, the library provides batched
+	entry points that operate on structures of arrays (SoA), e.g., N
+	directions and N pivots, which the compiler can vectorize.
+
+	USAGE
+
+	The library is header-only: simply include this file. All functions
+	live in the pivot namespace.
+
+	INTERFACING
+
+	define PIVOT_ASSERT(x) to avoid using assert.h.
+
+	define PIVOT_NO_SIMD to disable the AVX2 and AVX-512 kernels.
+
+	NOTES
+
+	The batched entry points assume that output arrays do not alias
+	input arrays. The batched r3_to_pr3 and pivot_jacobian functions
+	select an AVX-512, AVX2 or scalar kernel at runtime, depending on
+	the host CPU; use pivot::simd::set_level() to override the choice.
+*/
+
+#ifndef PIVOT_INCLUDE_PIVOT_H
+#define PIVOT_INCLUDE_PIVOT_H
+
+#include <cmath>
+
+#ifndef PIVOT_ASSERT
+#	include <assert.h>
+#	define PIVOT_ASSERT(x) assert(x)
+#endif
+
+#if defined(_MSC_VER)
+#	define PIVOT_RESTRICT __restrict
+#else
+#	define PIVOT_RESTRICT __restrict__
+#endif
+
+// x86 SIMD kernels (define PIVOT_NO_SIMD to disable them)
+#if !defined(PIVOT_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#	define PIVOT_SIMD_X86 1
+#	include <immintrin.h>
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#		define PIVOT__TARGET_AVX2
+#		define PIVOT__TARGET_AVX512
+#	else
+#		define PIVOT__TARGET_AVX2 __attribute__((target("avx2,fma")))
+#		define PIVOT__TARGET_AVX512 __attribute__((target("avx512f")))
+#	endif
+#else
+#	define PIVOT_SIMD_X86 0
+#endif
+
+namespace pivot {
+
+// *****************************************************************************
+/* Vectors (GLSL-like) */
+struct vec2 {
+	vec2(float x, float y): x(x), y(y) {}
+	explicit vec2(float x = 0.f): x(x), y(x) {}
+	float x, y;
+};
+struct vec3 {
+	vec3(float x, float y, float z): x(x), y(y), z(z) {}
+	vec3(const vec2& xy, float z): x(xy.x), y(xy.y), z(z) {}
+	explicit vec3(float x = 0.f): x(x), y(x), z(x) {}
+	float x, y, z;
+};
+
+// Spherical Cap
+struct cap {
+	cap(const vec3& dir, float z): dir(dir), z(z) {}
+	cap(): dir(0, 0, 1), z(1) {}
+	vec3 dir; // direction
+	float z;  // cos of the aperture angle
+};
+
+// Sphere
+struct sphere {
+	sphere(const vec3& pos, float r): pos(pos), r(r) {}
+	sphere(): pos(0), r(0) {}
+	vec3 pos; // center
+	float r;  // radius
+};
+
+// Mappings
+inline vec3 u2_to_cap(const vec2& u, const cap& c);
+inline vec3 u2_to_cos(const vec2& u);
+inline vec3 u2_to_s2(const vec2& u);
+inline vec3 u2_to_h2(const vec2& u);
+inline vec3 u2_to_ps2(const vec2& u, const vec3& r_p);
+inline vec3 u2_to_ph2(const vec2& u, const vec3& r_p);
+inline vec3 u2_to_pcap(const vec2& u, const cap& c, const vec3& r_p);
+inline vec3 r3_to_pr3(const vec3& r, const vec3& r_p);
+inline vec3 s2_to_ps2(const vec3& r, const vec3& r_p);
+inline cap cap_to_pcap(const cap& c, const vec3& r_p);
+
+// PDFs
+inline float pdf_cap(const vec3& wk, const cap& c);
+inline float pdf_cos(const vec3& wk);
+inline float pdf_s2(const vec3& wk);
+inline float pdf_h2(const vec3& wk);
+inline float pdf_ps2(const vec3& wk, const vec3& r_p);
+inline float pdf_pcap(const vec3& wk, const cap& c, const vec3& r_p);
+inline float pdf_pcap_fast(const vec3& wk, const cap& c_std, const vec3& r_p);
+inline float pivot_jacobian(const vec3& wk, const vec3& r_p);
+
+// solid angles
+inline float cap_solidangle(const cap& c);
+inline float cap_solidangle(const cap& c1, const cap& c2);
+
+// Approximate BRDF shading
+inline float GGXSphereLightingPivotApprox(const sphere& s, const vec3& wo, const vec3& pivot);
+
+// *****************************************************************************
+/* Batched API (structures of arrays) */
+struct vec2_soa {float *x, *y;};
+struct vec3_soa {float *x, *y, *z;};
+struct cap_soa {float *x, *y, *z, *c;}; // xyz: direction; c: cos of aperture
+
+struct cvec2_soa {
+	cvec2_soa(const float *x, const float *y): x(x), y(y) {}
+	cvec2_soa(const vec2_soa& v): x(v.x), y(v.y) {}
+	const float *x, *y;
+};
+struct cvec3_soa {
+	cvec3_soa(const float *x, const float *y, const float *z): x(x), y(y), z(z) {}
+	cvec3_soa(const vec3_soa& v): x(v.x), y(v.y), z(v.z) {}
+	const float *x, *y, *z;
+};
+struct ccap_soa {
+	ccap_soa(const float *x, const float *y, const float *z, const float *c):
+		x(x), y(y), z(z), c(c) {}
+	ccap_soa(const cap_soa& v): x(v.x), y(v.y), z(v.z), c(v.c) {}
+	const float *x, *y, *z, *c;
+};
+
+inline void u2_to_pcap(int count, cvec2_soa u, ccap_soa c, cvec3_soa r_p, vec3_soa out);
+inline void r3_to_pr3(int count, cvec3_soa r, cvec3_soa r_p, vec3_soa out);
+inline void cap_to_pcap(int count, ccap_soa c, cvec3_soa r_p, cap_soa out);
+inline void pdf_pcap_fast(int count, cvec3_soa wk, ccap_soa c_std, cvec3_soa r_p, float *out);
+inline void pivot_jacobian(int count, cvec3_soa wk, cvec3_soa r_p, float *out);
+
+// *****************************************************************************
+/* SIMD API - explicit AVX2 / AVX-512 kernels */
+// The batched r3_to_pr3 and pivot_jacobian functions dispatch to the widest
+// instruction set supported by the CPU; the kernels can also be called
+// directly (the AVX kernels are only available on x86 targets).
+namespace simd {
+
+enum {SCALAR, AVX2, AVX512};
+
+inline int detect(void);         // widest instruction set supported by the CPU
+inline int level(void);          // instruction set used by the batched API
+inline void set_level(int level); // clamped to detect()
+
+inline void r3_to_pr3_scalar(int count, cvec3_soa r, cvec3_soa r_p, vec3_soa out);
+inline void pivot_jacobian_scalar(int count, cvec3_soa wk, cvec3_soa r_p, float *out);
+#if PIVOT_SIMD_X86
+inline void r3_to_pr3_avx2(int count, cvec3_soa r, cvec3_soa r_p, vec3_soa out);
+inline void r3_to_pr3_avx512(int count, cvec3_soa r, cvec3_soa r_p, vec3_soa out);
+inline void pivot_jacobian_avx2(int count, cvec3_soa wk, cvec3_soa r_p, float *out);
+inline void pivot_jacobian_avx512(int count, cvec3_soa wk, cvec3_soa r_p, float *out);
+#endif // PIVOT_SIMD_X86
+
+} // namespace simd
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+
+// *****************************************************************************
+/* GLSL built-ins */
+inline vec2 operator*(float a, const vec2& b) {return vec2(a * b.x, a * b.y);}
+inline vec2 operator*(const vec2& a, float b) {return vec2(a.x * b, a.y * b);}
+inline vec2 operator/(const vec2& a, float b) {return vec2(a.x / b, a.y / b);}
+inline vec2 operator+(const vec2& a, const vec2& b) {return vec2(a.x + b.x, a.y + b.y);}
+inline vec2 operator-(const vec2& a, const vec2& b) {return vec2(a.x - b.x, a.y - b.y);}
+inline vec2 operator-(const vec2& a) {return vec2(-a.x, -a.y);}
+inline vec3 operator*(float a, const vec3& b) {return vec3(a * b.x, a * b.y, a * b.z);}
+inline vec3 operator*(const vec3& a, float b) {return vec3(a.x * b, a.y * b, a.z * b);}
+inline vec3 operator*(const vec3& a, const vec3& b) {return vec3(a.x * b.x, a.y * b.y, a.z * b.z);}
+inline vec3 operator/(const vec3& a, float b) {return vec3(a.x / b, a.y / b, a.z / b);}
+inline vec3 operator+(const vec3& a, const vec3& b) {return vec3(a.x + b.x, a.y + b.y, a.z + b.z);}
+inline vec3 operator-(const vec3& a, const vec3& b) {return vec3(a.x - b.x, a.y - b.y, a.z - b.z);}
+inline vec3 operator-(const vec3& a) {return vec3(-a.x, -a.y, -a.z);}
+inline vec3& operator+=(vec3& a, const vec3& b) {a.x+= b.x; a.y+= b.y; a.z+= b.z; return a;}
+inline vec3& operator*=(vec3& a, float b) {a.x*= b; a.y*= b; a.z*= b; return a;}
+inline float dot(const vec2& a, const vec2& b) {return a.x * b.x + a.y * b.y;}
+inline float dot(const vec3& a, const vec3& b) {return a.x * b.x + a.y * b.y + a.z * b.z;}
+inline float length(const vec2& a) {return std::sqrt(dot(a, a));}
+inline float length(const vec3& a) {return std::sqrt(dot(a, a));}
+inline vec2 normalize(const vec2& a) {return a / length(a);}
+inline vec3 normalize(const vec3& a) {return a / length(a);}
+inline vec3 cross(const vec3& a, const vec3& b)
+{
+	return vec3(a.y * b.z - a.z * b.y,
+	            a.z * b.x - a.x * b.z,
+	            a.x * b.y - a.y * b.x);
+}
+// NaNs are clamped to the lower bound, as with min(max(x, a), b) on GPUs
+inline float clamp(float x, float a, float b) {return std::fmin(std::fmax(x, a), b);}
+inline float smoothstep(float a, float b, float x)
+{
+	float t = clamp((x - a) / (b - a), 0.f, 1.f);
+	return t * t * (3.f - 2.f * t);
+}
+
+#define PIVOT__TWOPI 6.283185307f
+
+// Frisvad's method to build an orthonomal basis around a direction w
+inline void basis(const vec3& w, vec3 *t1, vec3 *t2)
+{
+	if (w.z < -0.9999999f) {
+		*t1 = vec3( 0, -1, 0);
+		*t2 = vec3(-1,  0, 0);
+	} else {
+		const float a = 1.f / (1.f + w.z);
+		const float b = -w.x * w.y * a;
+		*t1 = vec3(1.f - w.x * w.x * a, b, -w.x);
+		*t2 = vec3(b, 1.f - w.y * w.y * a, -w.y);
+	}
+}
+
+inline float cap_solidangle(const cap& c)
+{
+	return PIVOT__TWOPI - PIVOT__TWOPI * c.z;
+}
+
+// Based on Oat and Sander's 2008 technique
+inline float cap_solidangle(const cap& c1, const cap& c2)
+{
+	float r1 = std::acos(c1.z);
+	float r2 = std::acos(c2.z);
+	float rd = std::acos(clamp(dot(c1.dir, c2.dir), -1.f, 1.f));
+	float fArea = 0.f;
+
+	if (rd <= std::fmax(r1, r2) - std::fmin(r1, r2)) {
+		// One cap in completely inside the other
+		fArea = PIVOT__TWOPI - PIVOT__TWOPI * std::fmax(c1.z, c2.z);
+	} else if (rd >= r1 + r2) {
+		// No intersection exists
+		fArea = 0.f;
+	} else {
+		float fDiff = std::fabs(r1 - r2);
+		float den = r1 + r2 - fDiff;
+		float x = 1.f - clamp((rd - fDiff) / den, 0.f, 1.f);
+		fArea = smoothstep(0.f, 1.f, x);
+		fArea*= PIVOT__TWOPI - PIVOT__TWOPI * std::fmax(c1.z, c2.z);
+	}
+
+	return fArea;
+}
+
+inline float
+GGXSphereLightingPivotApprox(const sphere& s, const vec3& wo, const vec3& pivot)
+{
+	(void)wo; // unused, as in the GLSL version
+
+	// compute the spherical cap produced by the sphere
+	float tmp = clamp(s.r * s.r / dot(s.pos, s.pos), 0.f, 1.f);
+	cap c = cap(normalize(s.pos), std::sqrt(1.f - tmp));
+
+	// integrate
+	cap c1 = cap_to_pcap(c, pivot);
+	cap c2 = cap_to_pcap(cap(vec3(0, 0, 1), 0.f), pivot);
+	float res = cap_solidangle(c1, c2) * /*1/4pi*/0.079577472f;
+	return clamp(res, 0.f, 1.f);
+}
+
+// -----------------------------------------------------------------------------
+// sample warps
+
+/* Sphere */
+inline vec3 u2_to_s2(const vec2& u)
+{
+	float z = 2.f * u.x - 1.f; // in [-1, 1)
+	float sin_theta = std::sqrt(1.f - z * z);
+	float phi = PIVOT__TWOPI * u.y; // in [0, 2pi)
+	float x = sin_theta * std::cos(phi);
+	float y = sin_theta * std::sin(phi);
+
+	return vec3(x, y, z);
+}
+
+/* Hemisphere */
+inline vec3 u2_to_h2(const vec2& u)
+{
+	float z = u.x; // in [0, 1)
+	float sin_theta = std::sqrt(1.f - z * z);
+	float phi = PIVOT__TWOPI * u.y; // in [0, 2pi)
+	float x = sin_theta * std::cos(phi);
+	float y = sin_theta * std::sin(phi);
+
+	return vec3(x, y, z);
+}
+
+/* Spherical Cap */
+inline vec3 u2_to_cap(const vec2& u, const cap& c)
+{
+	// generate the sample in the basis aligned with the cap
+	float z = (1.f - c.z) * u.x + c.z; // in [cap_cos, 1)
+	float sin_theta = std::sqrt(1.f - z * z);
+	float phi = PIVOT__TWOPI * u.y; // in [0, 2pi)
+	float x = sin_theta * std::cos(phi);
+	float y = sin_theta * std::sin(phi);
+
+	// compute basis vectors
+	vec3 t1, t2;
+	basis(c.dir, &t1, &t2);
+
+	// warp the sample in the proper basis
+	return normalize(x * t1 + y * t2 + z * c.dir);
+}
+
+/* Disk */
+inline vec2 u2_to_disk(const vec2& u)
+{
+	float r = std::sqrt(u.x);           // in [0, 1)
+	float phi = PIVOT__TWOPI * u.y; // in [0, 2pi)
+	return r * vec2(std::cos(phi), std::sin(phi));
+}
+
+/* Clamped Cosine */
+inline vec3 u2_to_cos(const vec2& u)
+{
+	// project a disk sample back to the hemisphere
+	vec2 d = u2_to_disk(u);
+	float z = std::sqrt(1.f - dot(d, d));
+	return vec3(d, z);
+}
+
+/* Pivot 3D Transformation */
+inline vec3 r3_to_pr3(const vec3& r, const vec3& r_p)
+{
+	vec3 tmp = r - r_p;
+	vec3 cp1 = cross(r, r_p);
+	vec3 cp2 = cross(tmp, cp1);
+	float dp = dot(r, r_p) - 1.f;
+	float qf = dp * dp + dot(cp1, cp1);
+
+	return ((dp * tmp - cp2) / qf);
+}
+inline vec3 s2_to_ps2(const vec3& wk, const vec3& r_p)
+{
+	return r3_to_pr3(wk, r_p);
+}
+
+/* Pivot Transformed Sphere Sample */
+inline vec3 u2_to_ps2(const vec2& u, const vec3& r_p)
+{
+	vec3 std = u2_to_s2(u);
+	return s2_to_ps2(std, r_p);
+}
+
+/* Pivot Transformed Hemisphere Sample */
+inline vec3 u2_to_ph2(const vec2& u, const vec3& r_p)
+{
+	vec3 std = u2_to_h2(u);
+	return s2_to_ps2(std, r_p);
+}
+
+/* Pivot Transformed Cap Sample */
+inline vec3 u2_to_pcap(const vec2& u, const cap& c, const vec3& r_p)
+{
+	vec3 std = u2_to_cap(u, c);
+	return s2_to_ps2(std, r_p);
+}
+
+/* Pivot 2D Transformation */
+inline vec2 r2_to_pr2(const vec2& r, float r_p)
+{
+	vec2 tmp1 = vec2(r.x - r_p, r.y);
+	vec2 tmp2 = r_p * r - vec2(1, 0);
+	float x = dot(tmp1, tmp2);
+	float y = tmp1.y * tmp2.x - tmp1.x * tmp2.y;
+	float qf = dot(tmp2, tmp2);
+
+	return (vec2(x, y) / qf);
+}
+
+/* Pivot Transformed Cap */
+inline cap cap_to_pcap(const cap& c, const vec3& r_p)
+{
+	// extract pivot length and direction
+	float pivot_mag = length(r_p);
+	// special case: the pivot is at the origin
+	if (pivot_mag < 0.001f)
+		return cap(-c.dir, c.z);
+	vec3 pivot_dir = r_p / pivot_mag;
+
+	// 2D cap dir
+	float cos_phi = dot(c.dir, pivot_dir);
+	float sin_phi = std::sqrt(std::fmax(0.f, 1.f - cos_phi * cos_phi));
+
+	// 2D basis = (pivotDir, PivotOrthogonalDirection)
+	vec3 pivot_ortho_dir;
+	if (std::fabs(cos_phi) < 0.9999f) {
+		pivot_ortho_dir = (c.dir - cos_phi * pivot_dir) / sin_phi;
+	} else {
+		pivot_ortho_dir = vec3(0, 0, 0);
+	}
+
+	// compute cap 2D end points
+	float cap_sin = std::sqrt(std::fmax(0.f, 1.f - c.z * c.z));
+	float a1 = cos_phi * c.z;
+	float a2 = sin_phi * cap_sin;
+	float a3 = sin_phi * c.z;
+	float a4 = cos_phi * cap_sin;
+	vec2 dir1 = vec2(a1 + a2, a3 - a4);
+	vec2 dir2 = vec2(a1 - a2, a3 + a4);
+
+	// project in 2D
+	vec2 dir1_xf = r2_to_pr2(dir1, pivot_mag);
+	vec2 dir2_xf = r2_to_pr2(dir2, pivot_mag);
+
+	// compute the cap 2D direction
+	float area = dir1_xf.x * dir2_xf.y - dir1_xf.y * dir2_xf.x;
+	float s = area > 0.f ? 1.f : -1.f;
+	vec2 dir_xf = s * normalize(dir1_xf + dir2_xf);
+
+	// compute the 3D cap parameters
+	vec3 cap_dir = dir_xf.x * pivot_dir + dir_xf.y * pivot_ortho_dir;
+	float cap_cos = dot(dir_xf, dir1_xf);
+
+	return cap(cap_dir, cap_cos);
+}
+
+// -----------------------------------------------------------------------------
+// PDFs
+inline float pdf_cap(const vec3& wk, const cap& c)
+{
+	// make sure the sample lies in the the cap
+	if (dot(wk, c.dir) >= c.z) {
+		return 1.f / cap_solidangle(c);
+	}
+	return 0.f;
+}
+
+inline float pdf_cos(const vec3& wk)
+{
+	return clamp(wk.z, 0.f, 1.f) * /* 1/pi */0.318309886f;
+}
+
+inline float pdf_s2(const vec3&)
+{
+	return /* 1/4pi */ 0.079577472f;
+}
+
+inline float pdf_h2(const vec3& wk)
+{
+	return wk.z > 0.f ?/* 1/2pi */ 0.159154943f : 0.f;
+}
+
+inline float pivot_jacobian(const vec3& wk, const vec3& r_p)
+{
+	float num = 1.f - dot(r_p, r_p);
+	vec3 tmp = wk - r_p;
+	float den = dot(tmp, tmp);
+
+	return (num * num) / (den * den);
+}
+
+inline float pdf_ps2(const vec3& wk, const vec3& r_p)
+{
+	float std = pdf_s2(s2_to_ps2(wk, r_p));
+	float J = pivot_jacobian(wk, r_p);
+	return std * J;
+}
+
+inline float pdf_pcap_fast(const vec3& wk, const cap& c_std, const vec3& r_p)
+{
+	float std = pdf_cap(s2_to_ps2(wk, r_p), c_std);
+	float J = pivot_jacobian(wk, r_p);
+	return std * J;
+}
+
+inline float pdf_pcap(const vec3& wk, const cap& c, const vec3& r_p)
+{
+	return pdf_pcap_fast(wk, cap_to_pcap(c, r_p), r_p);
+}
+
+// *****************************************************************************
+/* Batched API Implementation */
+
+// The loops below are written against restrict-qualified local pointers
+// and call the scalar functions, which are inlined; this lets the compiler
+// vectorize them without any per-sample function call.
+#define PIVOT__LOAD3(v, i) vec3(v##x[i], v##y[i], v##z[i])
+#define PIVOT__STORE3(v, i, a) (v##x[i] = (a).x, v##y[i] = (a).y, v##z[i] = (a).z)
+#define PIVOT__SOA3(name, v) \
+	const float *PIVOT_RESTRICT name##x = v.x; \
+	const float *PIVOT_RESTRICT name##y = v.y; \
+	const float *PIVOT_RESTRICT name##z = v.z
+#define PIVOT__SOA3_OUT(name, v) \
+	float *PIVOT_RESTRICT name##x = v.x; \
+	float *PIVOT_RESTRICT name##y = v.y; \
+	float *PIVOT_RESTRICT name##z = v.z
+
+inline void
+u2_to_pcap(int count, cvec2_soa u, ccap_soa c, cvec3_soa r_p, vec3_soa out)
+{
+	const float *PIVOT_RESTRICT ux = u.x;
+	const float *PIVOT_RESTRICT uy = u.y;
+	const float *PIVOT_RESTRICT cc = c.c;
+	PIVOT__SOA3(c, c);
+	PIVOT__SOA3(p, r_p);
+	PIVOT__SOA3_OUT(o, out);
+
+	PIVOT_ASSERT(count >= 0);
+	for (int i = 0; i < count; ++i) {
+		cap ci = cap(PIVOT__LOAD3(c, i), cc[i]);
+		vec3 wk = u2_to_pcap(vec2(ux[i], uy[i]), ci, PIVOT__LOAD3(p, i));
+
+		PIVOT__STORE3(o, i, wk);
+	}
+}
+
+inline void r3_to_pr3(int count, cvec3_soa r, cvec3_soa r_p, vec3_soa out)
+{
+	PIVOT_ASSERT(count >= 0);
+	switch (simd::level()) {
+#if PIVOT_SIMD_X86
+		case simd::AVX512: simd::r3_to_pr3_avx512(count, r, r_p, out); break;
+		case simd::AVX2: simd::r3_to_pr3_avx2(count, r, r_p, out); break;
+#endif
+		default: simd::r3_to_pr3_scalar(count, r, r_p, out); break;
+	}
+}
+
+inline void cap_to_pcap(int count, ccap_soa c, cvec3_soa r_p, cap_soa out)
+{
+	const float *PIVOT_RESTRICT cc = c.c;
+	float *PIVOT_RESTRICT oc = out.c;
+	PIVOT__SOA3(c, c);
+	PIVOT__SOA3(p, r_p);
+	PIVOT__SOA3_OUT(o, out);
+
+	PIVOT_ASSERT(count >= 0);
+	for (int i = 0; i < count; ++i) {
+		cap ci = cap(PIVOT__LOAD3(c, i), cc[i]);
+		cap co = cap_to_pcap(ci, PIVOT__LOAD3(p, i));
+
+		PIVOT__STORE3(o, i, co.dir);
+		oc[i] = co.z;
+	}
+}
+
+inline void
+pdf_pcap_fast(int count, cvec3_soa wk, ccap_soa c_std, cvec3_soa r_p, float *out)
+{
+	const float *PIVOT_RESTRICT cc = c_std.c;
+	float *PIVOT_RESTRICT o = out;
+	PIVOT__SOA3(w, wk);
+	PIVOT__SOA3(c, c_std);
+	PIVOT__SOA3(p, r_p);
+
+	PIVOT_ASSERT(count >= 0);
+	for (int i = 0; i < count; ++i) {
+		cap ci = cap(PIVOT__LOAD3(c, i), cc[i]);
+
+		o[i] = pdf_pcap_fast(PIVOT__LOAD3(w, i), ci, PIVOT__LOAD3(p, i));
+	}
+}
+
+inline void pivot_jacobian(int count, cvec3_soa wk, cvec3_soa r_p, float *out)
+{
+	PIVOT_ASSERT(count >= 0);
+	switch (simd::level()) {
+#if PIVOT_SIMD_X86
+		case simd::AVX512: simd::pivot_jacobian_avx512(count, wk, r_p, out); break;
+		case simd::AVX2: simd::pivot_jacobian_avx2(count, wk, r_p, out); break;
+#endif
+		default: simd::pivot_jacobian_scalar(count, wk, r_p, out); break;
+	}
+}
+
+// *****************************************************************************
+/* SIMD API Implementation */
+namespace simd {
+
+// -----------------------------------------------------------------------------
+// runtime CPU dispatch
+inline int detect(void)
+{
+#if PIVOT_SIMD_X86 && defined(_MSC_VER)
+	int info[4];
+	bool avx, fma, avx2, avx512;
+	unsigned long long xcr0 = 0;
+
+	__cpuid(info, 1);
+	avx = (info[2] & (1 << 28)) && (info[2] & (1 << 27)); // AVX + OSXSAVE
+	fma = (info[2] & (1 << 12)) != 0;
+	if (avx) xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	avx2 = (info[1] & (1 << 5)) != 0;
+	avx512 = (info[1] & (1 << 16)) != 0;
+
+	if (avx512 && (xcr0 & 0xE6) == 0xE6)
+		return AVX512;
+	if (avx2 && fma && (xcr0 & 0x6) == 0x6)
+		return AVX2;
+#elif PIVOT_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return AVX2;
+#endif
+	return SCALAR;
+}
+
+inline int& level__(void)
+{
+	static int level = detect();
+
+	return level;
+}
+
+inline int level(void)
+{
+	return level__();
+}
+
+inline void set_level(int level)
+{
+	int max = detect();
+
+	level__() = level < SCALAR ? SCALAR : (level > max ? max : level);
+}
+
+// -----------------------------------------------------------------------------
+// scalar kernels
+inline void r3_to_pr3_scalar(int count, cvec3_soa r, cvec3_soa r_p, vec3_soa out)
+{
+	PIVOT__SOA3(r, r);
+	PIVOT__SOA3(p, r_p);
+	PIVOT__SOA3_OUT(o, out);
+
+	for (int i = 0; i < count; ++i) {
+		vec3 wk = r3_to_pr3(PIVOT__LOAD3(r, i), PIVOT__LOAD3(p, i));
+
+		PIVOT__STORE3(o, i, wk);
+	}
+}
+
+inline void
+pivot_jacobian_scalar(int count, cvec3_soa wk, cvec3_soa r_p, float *out)
+{
+	float *PIVOT_RESTRICT o = out;
+	PIVOT__SOA3(w, wk);
+	PIVOT__SOA3(p, r_p);
+
+	for (int i = 0; i < count; ++i)
+		o[i] = pivot_jacobian(PIVOT__LOAD3(w, i), PIVOT__LOAD3(p, i));
+}
+
+#if PIVOT_SIMD_X86
+// -----------------------------------------------------------------------------
+// AVX2 kernels (8 samples per iteration, scalar tail)
+PIVOT__TARGET_AVX2 inline void
+r3_to_pr3_avx2(int count, cvec3_soa r, cvec3_soa r_p, vec3_soa out)
+{
+	const __m256 one = _mm256_set1_ps(1.f);
+	int i = 0;
+
+	for (; i + 8 <= count; i+= 8) {
+		__m256 rx = _mm256_loadu_ps(r.x + i);
+		__m256 ry = _mm256_loadu_ps(r.y + i);
+		__m256 rz = _mm256_loadu_ps(r.z + i);
+		__m256 px = _mm256_loadu_ps(r_p.x + i);
+		__m256 py = _mm256_loadu_ps(r_p.y + i);
+		__m256 pz = _mm256_loadu_ps(r_p.z + i);
+		// tmp = r - r_p
+		__m256 tx = _mm256_sub_ps(rx, px);
+		__m256 ty = _mm256_sub_ps(ry, py);
+		__m256 tz = _mm256_sub_ps(rz, pz);
+		// cp1 = cross(r, r_p)
+		__m256 c1x = _mm256_fmsub_ps(ry, pz, _mm256_mul_ps(rz, py));
+		__m256 c1y = _mm256_fmsub_ps(rz, px, _mm256_mul_ps(rx, pz));
+		__m256 c1z = _mm256_fmsub_ps(rx, py, _mm256_mul_ps(ry, px));
+		// cp2 = cross(tmp, cp1)
+		__m256 c2x = _mm256_fmsub_ps(ty, c1z, _mm256_mul_ps(tz, c1y));
+		__m256 c2y = _mm256_fmsub_ps(tz, c1x, _mm256_mul_ps(tx, c1z));
+		__m256 c2z = _mm256_fmsub_ps(tx, c1y, _mm256_mul_ps(ty, c1x));
+		// dp = dot(r, r_p) - 1
+		__m256 dp = _mm256_fmadd_ps(rx, px,
+		            _mm256_fmadd_ps(ry, py,
+		            _mm256_fmsub_ps(rz, pz, one)));
+		// qf = dp * dp + dot(cp1, cp1)
+		__m256 qf = _mm256_fmadd_ps(dp, dp,
+		            _mm256_fmadd_ps(c1x, c1x,
+		            _mm256_fmadd_ps(c1y, c1y,
+		            _mm256_mul_ps(c1z, c1z))));
+		__m256 nrm = _mm256_div_ps(one, qf);
+
+		_mm256_storeu_ps(out.x + i, _mm256_mul_ps(_mm256_fmsub_ps(dp, tx, c2x), nrm));
+		_mm256_storeu_ps(out.y + i, _mm256_mul_ps(_mm256_fmsub_ps(dp, ty, c2y), nrm));
+		_mm256_storeu_ps(out.z + i, _mm256_mul_ps(_mm256_fmsub_ps(dp, tz, c2z), nrm));
+	}
+	r3_to_pr3_scalar(count - i,
+	                 cvec3_soa(r.x + i, r.y + i, r.z + i),
+	                 cvec3_soa(r_p.x + i, r_p.y + i, r_p.z + i),
+	                 vec3_soa{out.x + i, out.y + i, out.z + i});
+}
+
+PIVOT__TARGET_AVX2 inline void
+pivot_jacobian_avx2(int count, cvec3_soa wk, cvec3_soa r_p, float *out)
+{
+	const __m256 one = _mm256_set1_ps(1.f);
+	int i = 0;
+
+	for (; i + 8 <= count; i+= 8) {
+		__m256 px = _mm256_loadu_ps(r_p.x + i);
+		__m256 py = _mm256_loadu_ps(r_p.y + i);
+		__m256 pz = _mm256_loadu_ps(r_p.z + i);
+		__m256 tx = _mm256_sub_ps(_mm256_loadu_ps(wk.x + i), px);
+		__m256 ty = _mm256_sub_ps(_mm256_loadu_ps(wk.y + i), py);
+		__m256 tz = _mm256_sub_ps(_mm256_loadu_ps(wk.z + i), pz);
+		// num = 1 - dot(r_p, r_p), den = dot(wk - r_p, wk - r_p)
+		__m256 num = _mm256_fnmadd_ps(px, px,
+		             _mm256_fnmadd_ps(py, py,
+		             _mm256_fnmadd_ps(pz, pz, one)));
+		__m256 den = _mm256_fmadd_ps(tx, tx,
+		             _mm256_fmadd_ps(ty, ty,
+		             _mm256_mul_ps(tz, tz)));
+		__m256 q = _mm256_div_ps(num, den);
+
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(q, q));
+	}
+	pivot_jacobian_scalar(count - i,
+	                      cvec3_soa(wk.x + i, wk.y + i, wk.z + i),
+	                      cvec3_soa(r_p.x + i, r_p.y + i, r_p.z + i),
+	                      out + i);
+}
+
+// -----------------------------------------------------------------------------
+// AVX-512 kernels (16 samples per iteration, masked tail)
+PIVOT__TARGET_AVX512 inline void
+r3_to_pr3_avx512(int count, cvec3_soa r, cvec3_soa r_p, vec3_soa out)
+{
+	const __m512 one = _mm512_set1_ps(1.f);
+
+	for (int i = 0; i < count; i+= 16) {
+		__mmask16 m = count - i >= 16 ? 0xFFFF
+		            : (__mmask16)((1u << (count - i)) - 1u);
+		__m512 rx = _mm512_maskz_loadu_ps(m, r.x + i);
+		__m512 ry = _mm512_maskz_loadu_ps(m, r.y + i);
+		__m512 rz = _mm512_maskz_loadu_ps(m, r.z + i);
+		__m512 px = _mm512_maskz_loadu_ps(m, r_p.x + i);
+		__m512 py = _mm512_maskz_loadu_ps(m, r_p.y + i);
+		__m512 pz = _mm512_maskz_loadu_ps(m, r_p.z + i);
+		// tmp = r - r_p
+		__m512 tx = _mm512_sub_ps(rx, px);
+		__m512 ty = _mm512_sub_ps(ry, py);
+		__m512 tz = _mm512_sub_ps(rz, pz);
+		// cp1 = cross(r, r_p)
+		__m512 c1x = _mm512_fmsub_ps(ry, pz, _mm512_mul_ps(rz, py));
+		__m512 c1y = _mm512_fmsub_ps(rz, px, _mm512_mul_ps(rx, pz));
+		__m512 c1z = _mm512_fmsub_ps(rx, py, _mm512_mul_ps(ry, px));
+		// cp2 = cross(tmp, cp1)
+		__m512 c2x = _mm512_fmsub_ps(ty, c1z, _mm512_mul_ps(tz, c1y));
+		__m512 c2y = _mm512_fmsub_ps(tz, c1x, _mm512_mul_ps(tx, c1z));
+		__m512 c2z = _mm512_fmsub_ps(tx, c1y, _mm512_mul_ps(ty, c1x));
+		// dp = dot(r, r_p) - 1
+		__m512 dp = _mm512_fmadd_ps(rx, px,
+		            _mm512_fmadd_ps(ry, py,
+		            _mm512_fmsub_ps(rz, pz, one)));
+		// qf = dp * dp + dot(cp1, cp1)
+		__m512 qf = _mm512_fmadd_ps(dp, dp,
+		            _mm512_fmadd_ps(c1x, c1x,
+		            _mm512_fmadd_ps(c1y, c1y,
+		            _mm512_mul_ps(c1z, c1z))));
+		__m512 nrm = _mm512_div_ps(one, qf);
+
+		_mm512_mask_storeu_ps(out.x + i, m, _mm512_mul_ps(_mm512_fmsub_ps(dp, tx, c2x), nrm));
+		_mm512_mask_storeu_ps(out.y + i, m, _mm512_mul_ps(_mm512_fmsub_ps(dp, ty, c2y), nrm));
+		_mm512_mask_storeu_ps(out.z + i, m, _mm512_mul_ps(_mm512_fmsub_ps(dp, tz, c2z), nrm));
+	}
+}
+
+PIVOT__TARGET_AVX512 inline void
+pivot_jacobian_avx512(int count, cvec3_soa wk, cvec3_soa r_p, float *out)
+{
+	const __m512 one = _mm512_set1_ps(1.f);
+
+	for (int i = 0; i < count; i+= 16) {
+		__mmask16 m = count - i >= 16 ? 0xFFFF
+		            : (__mmask16)((1u << (count - i)) - 1u);
+		__m512 px = _mm512_maskz_loadu_ps(m, r_p.x + i);
+		__m512 py = _mm512_maskz_loadu_ps(m, r_p.y + i);
+		__m512 pz = _mm512_maskz_loadu_ps(m, r_p.z + i);
+		__m512 tx = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, wk.x + i), px);
+		__m512 ty = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, wk.y + i), py);
+		__m512 tz = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, wk.z + i), pz);
+		// num = 1 - dot(r_p, r_p), den = dot(wk - r_p, wk - r_p)
+		__m512 num = _mm512_fnmadd_ps(px, px,
+		             _mm512_fnmadd_ps(py, py,
+		             _mm512_fnmadd_ps(pz, pz, one)));
+		__m512 den = _mm512_fmadd_ps(tx, tx,
+		             _mm512_fmadd_ps(ty, ty,
+		             _mm512_mul_ps(tz, tz)));
+		__m512 q = _mm512_div_ps(num, den);
+
+		_mm512_mask_storeu_ps(out + i, m, _mm512_mul_ps(q, q));
+	}
+}
+#endif // PIVOT_SIMD_X86
+
+} // namespace simd
+
+#undef PIVOT__LOAD3
+#undef PIVOT__STORE3
+#undef PIVOT__SOA3
+#undef PIVOT__SOA3_OUT
+#undef PIVOT__TWOPI
+#undef PIVOT__TARGET_AVX2
+#undef PIVOT__TARGET_AVX512
+
+} // namespace pivot
+
+#endif // PIVOT_INCLUDE_PIVOT_H
+
@@ -0,0 +1,137 @@
+/* pivot_fit.h - public domain C++ library
+by Jonathan Dupuy
+
+	This file provides a closed-form approximation of the pivot fit table
+	(fit.inl) used by the sphere light shading technique described in my
+	paper "A Spherical Cap Preserving Parameterization for Spherical
+	Distributions". It mirrors pivot_fit.glsl one-to-one.
+
+	The fit maps a GGX BRDF of roughness alpha, seen from a direction wo
+	at elevation theta in tangent space, to the pivot
+
+		pivot = (-t * wo.x, -t * wo.y, n)
+
+	and to the BRDF scale s, where t, n and s are polynomials of total
+	degree 6 in sqrt(alpha) and cos(theta). This way, the pivot is computed
+	without any table lookup nor trigonometric function.
+
+	USAGE
+
+	The library is header-only: simply include this file. All functions
+	live in the pivot namespace. The fitting function is constexpr when
+	compiled as C++14 or later.
+
+	NOTES
+
+	The coefficients were produced by "fit --analytic 6" (see fit.cpp), which
+	reports the following errors against the 64x64 table of fit.inl:
+		pivot norm       mean 0.0024 max 0.035
+		pivot elevation  mean 0.0068 max 0.148 (radians)
+		BRDF scale       mean 0.0047 max 0.043
+		pivot (3D)       mean 0.0047 max 0.054
+	The largest elevation errors occur for rough BRDFs, where the norm of
+	the pivot is small and its elevation hardly matters. Note that the norm
+	of the pivot may slightly exceed 1 for very smooth BRDFs; callers should
+	clamp it, as the table does, to 0.999.
+*/
+
+#ifndef PIVOT_INCLUDE_PIVOT_FIT_H
+#define PIVOT_INCLUDE_PIVOT_FIT_H
+
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#	define PIVOT_FIT_CONSTEXPR constexpr
+#	define PIVOT__FIT_CONST constexpr
+#else
+#	define PIVOT_FIT_CONSTEXPR inline
+#	define PIVOT__FIT_CONST const
+#endif
+
+namespace pivot {
+
+// Fitted parameters
+struct fit_params {
+	float t; // tangent coefficient: the pivot is (-t * wo.x, -t * wo.y, n)
+	float n; // normal coefficient
+	float s; // BRDF scale, in [0, 1]
+};
+
+// Evaluate the fit; roughness is sqrt(alpha) and cos_theta is wo.z
+PIVOT_FIT_CONSTEXPR fit_params ggx_pivot_fit(float roughness, float cos_theta);
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+
+#define PIVOT__FIT_DEGREE 6
+#define PIVOT__FIT_TERMS  28 // (degree + 1) * (degree + 2) / 2
+
+// monomials x^i c^j with i + j <= degree, sorted by i then j
+static PIVOT__FIT_CONST float pivot__fit_coeffs[3][PIVOT__FIT_TERMS] = {
+	{ // t
+		 1.00807187e+00f,  5.34041456e-01f, -7.20329255e+00f,  3.09009377e+01f,
+		-5.78998966e+01f,  4.94796040e+01f, -1.58344755e+01f, -6.51984055e-01f,
+		 2.87618958e+00f, -5.50038050e+00f, -4.02030619e+00f,  1.70627135e+01f,
+		-9.41184555e+00f,  4.40212170e+00f, -1.10269946e+01f,  1.83166531e+01f,
+		-2.10172461e+01f,  5.10391850e+00f, -1.81582726e+01f,  1.88434563e+01f,
+		-5.04584073e+00f,  7.19992705e+00f,  2.63461816e+01f, -1.85633056e+01f,
+		-2.19726473e+00f, -1.78736528e+01f,  7.36746789e+00f,  4.92370589e+00f
+	}, { // n
+		 2.49928279e-03f,  8.79940567e-01f,  1.20313663e+00f, -4.02613901e+00f,
+		 5.97536835e+00f, -4.19856939e+00f,  1.16866151e+00f,  5.80976173e-03f,
+		-1.47128805e+00f,  5.46659962e+00f, -4.65057733e+00f,  2.53302638e-01f,
+		 2.47719966e-01f,  9.54389002e-01f, -4.84075644e+00f, -4.92762400e+00f,
+		 9.46499655e+00f, -1.40860235e+00f,  2.54756275e+00f,  4.07868377e+00f,
+		-8.27181480e+00f, -3.09546756e+00f, -5.28871852e+00f,  9.54293412e+00f,
+		 6.59394212e+00f,  4.39345859e-01f, -7.90557336e+00f,  1.59853879e+00f
+	}, { // s
+		 9.87785362e-01f,  3.42159373e-01f, -1.80901044e+00f,  4.50520824e+00f,
+		-7.22395377e+00f,  6.60465707e+00f, -2.39400149e+00f, -5.09581648e-01f,
+		 2.61866831e+00f,  8.66499533e-01f, -3.47822649e+00f, -2.17676297e+00f,
+		 2.29883166e+00f, -1.37119083e+00f, -1.19147191e+01f,  1.30949122e+01f,
+		 5.40781264e+00f, -3.24630597e+00f,  1.05797673e+01f,  6.17280335e+00f,
+		-2.01042270e+01f,  1.58765684e+00f, -1.85618236e+01f,  5.08467706e+00f,
+		 6.57180262e+00f,  1.32628105e+01f, -3.38278553e+00f, -3.50723587e+00f
+	}
+};
+
+// -----------------------------------------------------------------------------
+// bivariate polynomial evaluation (Horner scheme in both variables)
+PIVOT_FIT_CONSTEXPR float pivot__fit_eval(const float *coeffs, float x, float c)
+{
+	float p = 0.f;
+
+	for (int i = PIVOT__FIT_DEGREE; i >= 0; --i) {
+		int offset = i * (PIVOT__FIT_DEGREE + 1) - i * (i - 1) / 2;
+		float q = 0.f;
+
+		for (int j = PIVOT__FIT_DEGREE - i; j >= 0; --j)
+			q = q * c + coeffs[offset + j];
+		p = p * x + q;
+	}
+
+	return p;
+}
+
+// -----------------------------------------------------------------------------
+PIVOT_FIT_CONSTEXPR fit_params ggx_pivot_fit(float roughness, float cos_theta)
+{
+	float x = roughness < 0.f ? 0.f : (roughness > 1.f ? 1.f : roughness);
+	float c = cos_theta < 0.f ? 0.f : (cos_theta > 1.f ? 1.f : cos_theta);
+	fit_params p = {
+		pivot__fit_eval(pivot__fit_coeffs[0], x, c),
+		pivot__fit_eval(pivot__fit_coeffs[1], x, c),
+		pivot__fit_eval(pivot__fit_coeffs[2], x, c)
+	};
+
+	p.s = p.s < 0.f ? 0.f : (p.s > 1.f ? 1.f : p.s);
+
+	return p;
+}
+
+#undef PIVOT__FIT_DEGREE
+#undef PIVOT__FIT_TERMS
+
+} // namespace pivot
+
+#endif // PIVOT_INCLUDE_PIVOT_FIT_H
+
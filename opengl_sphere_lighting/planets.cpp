@@ -3,7 +3,7 @@
 // Complete program (this compiles):
 // Sphere Light Shading Demo
 //
-// g++ `sdl2-config --cflags` -I imgui planets.cpp gl_core_4_3.cpp  imgui/imgui*.cpp `sdl2-config --libs` -ldl -lGL -o planets
+// g++ `sdl2-config --cflags` -I imgui planets.cpp gl_core_4_3.cpp  imgui/imgui*.cpp `sdl2-config --libs` -ldl -lGL -pthread -o planets
 //
 
 #include <cassert>
@@ -31,6 +31,9 @@
 #define DJ_ALGEBRA_IMPLEMENTATION 1
 #include "dj_algebra.h"
 
+#include "scene.h"
+#include "lights.h"
+
 #include "imgui.h"
 #include "imgui_impl_sdl_gl3.h"
 
@@ -41,6 +44,8 @@
 ////////////////////////////////////////////////////////////////////////////////
 #define VIEWER_DEFAULT_WIDTH  1280
 #define VIEWER_DEFAULT_HEIGHT 720
+#define ADAPTIVE_TILE_SIZE    16
+#define ADAPTIVE_READBACK_COUNT 4 // active tile counts in flight
 
 ////////////////////////////////////////////////////////////////////////////////
 // Global Variables
@@ -52,111 +57,23 @@
 enum { AA_NONE, AA_MSAA2, AA_MSAA4, AA_MSAA8, AA_MSAA16 };
 struct FramebufferManager {
 	int w, h, aa, pass, samplesPerPass, samplesPerPixel;
+	int sampler;
 	struct {bool progressive, reset;} flags;
 	struct {int fixed;} msaa;
 	struct {float r, g, b;} clearColor;
+	struct {
+		bool enabled;
+		float threshold;     // relative error target
+		int minPassCount;    // passes rendered before estimating the variance
+		int activeTileCount; // tiles that have not converged yet
+	} adaptive;
 } g_framebuffer = {
 	VIEWER_DEFAULT_WIDTH, VIEWER_DEFAULT_HEIGHT, AA_MSAA2, 0, 8, 1024,
+	SAMPLER_SOBOL,
 	{true, true},
 	{false},
-	{61./255., 119./255., 192./225}
-};
-
-// -----------------------------------------------------------------------------
-// Camera Manager
-struct CameraManager {
-	float fovy, zNear, zFar; // perspective settings
-	dja::vec3 pos;           // 3D position
-	dja::mat3 axis;          // 3D frame
-} g_camera = {
-	55.f, 0.01f, 1024.f,
-	dja::vec3(1.5, 0, 0.4),
-	dja::mat3(
-		0.971769, -0.129628, -0.197135,
-		0.127271, 0.991562, -0.024635,
-		0.198665, -0.001150, 0.980067
-	)
-};
-
-// -----------------------------------------------------------------------------
-// Planet Manager
-enum {
-	SHADING_PIVOT,
-	SHADING_MC_MIS,
-	SHADING_MC_MIS_JOINT,
-	SHADING_MC_CAP,
-	SHADING_MC_GGX,
-	SHADING_MC_COS,
-	SHADING_MC_H2,
-	SHADING_MC_S2,
-	SHADING_DEBUG
-};
-struct PlanetManager {
-	struct {bool animate, showLines;} flags;
-	struct {
-		int xTess, yTess;
-		int vertexCnt, indexCnt;
-	} sphere;
-	struct {
-		const char **files;
-		int cnt;
-	} roughnessTextures, albedoTextures;
-	struct Planet {
-		float orbitRadius, orbitAngle, orbitVelocity;
-		float rotationAngle, rotationVelocity;
-		float scale;
-		float roughness;
-		float emissionIntensity;
-		struct {float r, g, b;} emissionColor;
-		int roughnessTexture, albedoTexture;
-	} planets[4];
-	int activePlanet;
-	int shadingMode;
-} g_planets = {
-	{true, false},
-	{24, 48, -1, -1}, // sphere
-	{NULL, -1},       // roughnessTextures
-	{NULL, -1},       // albedoTextures
-	{
-		{
-			0, 0, 0,
-			0, 0,
-			0.2,
-			1,
-			5,
-			{224.f/255.f, 224.f/255.f, 255.f/255.f},
-			0, 0
-		},
-		{
-			0.35, 45, 0.1,
-			0.0, 0.5,
-			0.1,
-			1,
-			0,
-			{0.1, 0.1, 0.1},
-			0, 0
-		},
-		{
-			0.58, 170, 0.4,
-			0, 0.8,
-			0.08,
-			1,
-			10,
-			{224.f/255.f, 0.f/255.f, 0.f/255.f},
-			0, 0
-		},
-		{
-			0.9, 0, 0.15,
-			0, 0.2,
-			0.17,
-			1,
-			0,
-			{0.1, 0.1, 0.1},
-			0, 0
-		}
-	},
-	1,
-	SHADING_PIVOT
+	{61./255., 119./255., 192./225},
+	{false, 0.05f, 4, 0}
 };
 
 // -----------------------------------------------------------------------------
@@ -191,25 +108,40 @@ struct AppManager {
 enum { CLOCK_SPF, CLOCK_COUNT };
 enum { FRAMEBUFFER_BACK, FRAMEBUFFER_SCENE, FRAMEBUFFER_COUNT };
 enum { VERTEXARRAY_EMPTY, VERTEXARRAY_SPHERE, VERTEXARRAY_COUNT };
-enum { STREAM_SPHERES, STREAM_TRANSFORM, STREAM_RANDOM, STREAM_COUNT };
+enum {
+	STREAM_SPHERES,
+	STREAM_TRANSFORM,
+	STREAM_RANDOM,
+	STREAM_LIGHTS,
+	STREAM_CLUSTERS,
+	STREAM_LIGHT_TREE,
+	STREAM_INSTANCES,
+	STREAM_COUNT
+};
+enum { BUFFER_BINDING_TILES = STREAM_COUNT }; // adaptive sampling tiles
 enum {
 	TEXTURE_BACK,
 	TEXTURE_SCENE,
+	TEXTURE_SCENE_MOMENTS,
 	TEXTURE_Z,
 	TEXTURE_ROUGHNESS,
 	TEXTURE_ALBEDO,
 	TEXTURE_PIVOT,
+	TEXTURE_PIVOT_ANISO,
 	TEXTURE_COUNT
 };
 enum {
 	BUFFER_SPHERE_VERTICES,
 	BUFFER_SPHERE_INDEXES,
+	BUFFER_ADAPTIVE_TILES,
+	BUFFER_ADAPTIVE_READBACK,
 	BUFFER_COUNT
 };
 enum {
 	PROGRAM_VIEWER,
 	PROGRAM_BACKGROUND,
 	PROGRAM_SPHERE,
+	PROGRAM_VARIANCE,
 	PROGRAM_COUNT
 };
 enum {
@@ -221,9 +153,21 @@ enum {
 	UNIFORM_BACKGROUND_CLEAR_COLOR,
 
 	UNIFORM_SPHERE_SAMPLES_PER_PASS,
+	UNIFORM_SPHERE_SAMPLE_OFFSET,
+	UNIFORM_SPHERE_INSTANCE_OFFSET,
+	UNIFORM_SPHERE_PROJECTION,
+	UNIFORM_SPHERE_PROJECTION_INVERSE,
 	UNIFORM_SPHERE_PIVOT_SAMPLER,
+	UNIFORM_SPHERE_PIVOT_ANISO_SAMPLER,
 	UNIFORM_SPHERE_ROUGHNESS_SAMPLER,
-	UNIFORM_SPHERE_COUNT,
+	UNIFORM_SPHERE_LIGHT_COUNT,
+	UNIFORM_SPHERE_CLUSTER_GRID,
+	UNIFORM_SPHERE_CLUSTER_DEPTH,
+	UNIFORM_SPHERE_TILE_COUNT_X,
+
+	UNIFORM_VARIANCE_MOMENT_SAMPLER,
+	UNIFORM_VARIANCE_THRESHOLD,
+	UNIFORM_VARIANCE_MIN_PASS_COUNT,
 
 	UNIFORM_COUNT
 };
@@ -235,27 +179,59 @@ struct OpenGLManager {
 	GLuint buffers[BUFFER_COUNT];
 	GLint uniforms[UNIFORM_COUNT];
 	djg_buffer *streams[STREAM_COUNT];
+	int streamSizes[STREAM_COUNT];
 	djg_clock *clocks[CLOCK_COUNT];
+	djg_profiler *profiler;
 	djg_font *font;
 } g_gl = {{0}};
 
+// -----------------------------------------------------------------------------
+// Active tile count readback (adaptive sampling); the counts are copied to a
+// ring of slots that are read once their fence has signaled, so the CPU never
+// waits for the GPU
+struct AdaptiveReadback {
+	const uint32_t *counts; // persistent mapping (NULL without buffer storage)
+	GLsync fences[ADAPTIVE_READBACK_COUNT];
+	int head, tail;         // number of slots written and read
+} g_adaptiveReadback;
+
+// -----------------------------------------------------------------------------
+// Texture Streaming Manager (roughness maps that load while rendering)
+struct TextureStreamManager {
+	char file[256];
+	int kibPerFrame; // upload budget
+	djg_texture_stream *stream;
+} g_textureStream = {"./textures/moon.png", 1024, NULL};
+
+// -----------------------------------------------------------------------------
+// Sphere Data Manager (updated each frame)
+struct SphereDataManager {
+	std::vector<SphereTransform> transforms;
+	std::vector<SphereData> spheres;
+	std::vector<int32_t> lightIds;
+	int lightCount;
+	LightClusters clusters;
+	LightTree lightTree;
+	std::vector<int32_t> instances; // sphere indexes, sorted by LOD
+	dja::mat4 projection;           // camera projection (for impostors)
+	struct {int offset, count;} lods[SPHERE_LOD_COUNT]; // ranges of instances
+} g_spheres;
+
+// -----------------------------------------------------------------------------
+// Pivot table of anisotropic GGX, in half precision (see fit.cpp)
+const uint16_t g_pivotAnisoTable[] = {
+#include "fit_aniso.inl"
+};
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // Utility functions
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-#ifndef M_PI
-#define M_PI 3.141592654
-#endif
 #define BUFFER_SIZE(x)    ((int)(sizeof(x)/sizeof(x[0])))
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
-float radians(float degrees)
-{
-	return degrees * M_PI / 180.f;
-}
-
 char *strcat2(char *dst, const char *src1, const char *src2)
 {
 	strcpy(dst, src1);
@@ -304,9 +280,56 @@ void configureSphereProgram()
 	glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
 	                   g_gl.uniforms[UNIFORM_SPHERE_PIVOT_SAMPLER],
 	                   TEXTURE_PIVOT);
+	glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+	                   g_gl.uniforms[UNIFORM_SPHERE_PIVOT_ANISO_SAMPLER],
+	                   TEXTURE_PIVOT_ANISO);
 	glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
 	                   g_gl.uniforms[UNIFORM_SPHERE_ROUGHNESS_SAMPLER],
 	                   TEXTURE_ROUGHNESS);
+	glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+	                   g_gl.uniforms[UNIFORM_SPHERE_LIGHT_COUNT],
+	                   g_spheres.lightCount);
+	if (g_lightClusters.enabled) {
+		glProgramUniform4i(g_gl.programs[PROGRAM_SPHERE],
+		                   g_gl.uniforms[UNIFORM_SPHERE_CLUSTER_GRID],
+		                   g_spheres.clusters.xTiles,
+		                   g_spheres.clusters.yTiles,
+		                   g_spheres.clusters.zSlices,
+		                   g_spheres.clusters.tileSize);
+		glProgramUniform2f(g_gl.programs[PROGRAM_SPHERE],
+		                   g_gl.uniforms[UNIFORM_SPHERE_CLUSTER_DEPTH],
+		                   g_spheres.clusters.zNear,
+		                   g_spheres.clusters.depthScale);
+	}
+	glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+	                   g_gl.uniforms[UNIFORM_SPHERE_TILE_COUNT_X],
+	                   (g_framebuffer.w + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE);
+	if (g_planets.flags.impostors) {
+		dja::mat4 projectionInv = dja::inverse(g_spheres.projection);
+
+		// dja matrices are row-major
+		glProgramUniformMatrix4fv(g_gl.programs[PROGRAM_SPHERE],
+		                          g_gl.uniforms[UNIFORM_SPHERE_PROJECTION],
+		                          1, GL_TRUE, &g_spheres.projection[0][0]);
+		glProgramUniformMatrix4fv(g_gl.programs[PROGRAM_SPHERE],
+		                          g_gl.uniforms[UNIFORM_SPHERE_PROJECTION_INVERSE],
+		                          1, GL_TRUE, &projectionInv[0][0]);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// set Variance program uniforms
+void configureVarianceProgram()
+{
+	glProgramUniform1i(g_gl.programs[PROGRAM_VARIANCE],
+	                   g_gl.uniforms[UNIFORM_VARIANCE_MOMENT_SAMPLER],
+	                   TEXTURE_SCENE_MOMENTS);
+	glProgramUniform1f(g_gl.programs[PROGRAM_VARIANCE],
+	                   g_gl.uniforms[UNIFORM_VARIANCE_THRESHOLD],
+	                   g_framebuffer.adaptive.threshold);
+	glProgramUniform1i(g_gl.programs[PROGRAM_VARIANCE],
+	                   g_gl.uniforms[UNIFORM_VARIANCE_MIN_PASS_COUNT],
+	                   g_framebuffer.adaptive.minPassCount);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -427,12 +450,44 @@ bool loadSphereProgram()
 			djgp_push_string(djp, "#define SHADE_MC_MIS_JOINT 1\n");
 			break;
 	};
+	switch (g_framebuffer.sampler) {
+		case SAMPLER_RANDOM:
+			djgp_push_string(djp, "#define SAMPLER_RANDOM 1\n");
+			break;
+		case SAMPLER_SOBOL:
+			djgp_push_string(djp, "#define SAMPLER_SOBOL 1\n");
+			break;
+		case SAMPLER_LATTICE:
+			djgp_push_string(djp, "#define SAMPLER_LATTICE 1\n");
+			break;
+	};
 	djgp_push_string(djp, "#define BUFFER_BINDING_RANDOM %i\n", STREAM_RANDOM);
 	djgp_push_string(djp, "#define BUFFER_BINDING_TRANSFORMS %i\n", STREAM_TRANSFORM);
 	djgp_push_string(djp, "#define BUFFER_BINDING_SPHERES %i\n", STREAM_SPHERES);
-	djgp_push_string(djp, "#define SPHERE_COUNT %i\n", BUFFER_SIZE(g_planets.planets));
+	djgp_push_string(djp, "#define BUFFER_BINDING_LIGHTS %i\n", STREAM_LIGHTS);
+	djgp_push_string(djp, "#define BUFFER_BINDING_INSTANCES %i\n", STREAM_INSTANCES);
+	if (g_lightClusters.enabled) {
+		djgp_push_string(djp, "#define CLUSTERED_LIGHTING 1\n");
+		djgp_push_string(djp, "#define BUFFER_BINDING_CLUSTERS %i\n", STREAM_CLUSTERS);
+	}
+	if (g_framebuffer.adaptive.enabled) {
+		djgp_push_string(djp, "#define ADAPTIVE_SAMPLING 1\n");
+		djgp_push_string(djp, "#define TILE_SIZE %i\n", ADAPTIVE_TILE_SIZE);
+		djgp_push_string(djp, "#define BUFFER_BINDING_TILES %i\n", BUFFER_BINDING_TILES);
+	}
+	if (g_planets.flags.analyticPivotFit)
+		djgp_push_string(djp, "#define PIVOT_FIT_ANALYTIC 1\n");
+	if (g_planets.flags.impostors)
+		djgp_push_string(djp, "#define SPHERE_IMPOSTOR 1\n");
+	djgp_push_string(djp, "#define PIVOT_ANISO_PHI_RES %i\n", (int)g_pivotAnisoTable[2]);
+	if (g_lightTree.enabled) {
+		djgp_push_string(djp, "#define LIGHT_TREE 1\n");
+		djgp_push_string(djp, "#define BUFFER_BINDING_LIGHT_TREE %i\n", STREAM_LIGHT_TREE);
+	}
 	djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "ggx.glsl"));
 	djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "pivot.glsl"));
+	djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "pivot_fit.glsl"));
+	djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "sampler.glsl"));
 	djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "sphere.glsl"));
 
 	if (!djgp_gl_upload(djp, 430, false, true, program)) {
@@ -445,16 +500,73 @@ bool loadSphereProgram()
 
 	g_gl.uniforms[UNIFORM_SPHERE_SAMPLES_PER_PASS] =
 		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_SamplesPerPass");
+	g_gl.uniforms[UNIFORM_SPHERE_SAMPLE_OFFSET] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_SampleOffset");
+	g_gl.uniforms[UNIFORM_SPHERE_INSTANCE_OFFSET] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_InstanceOffset");
+	g_gl.uniforms[UNIFORM_SPHERE_PROJECTION] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_Projection");
+	g_gl.uniforms[UNIFORM_SPHERE_PROJECTION_INVERSE] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_ProjectionInverse");
 	g_gl.uniforms[UNIFORM_SPHERE_PIVOT_SAMPLER] =
 		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_PivotSampler");
+	g_gl.uniforms[UNIFORM_SPHERE_PIVOT_ANISO_SAMPLER] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_PivotAnisoSampler");
 	g_gl.uniforms[UNIFORM_SPHERE_ROUGHNESS_SAMPLER] =
 		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_RoughnessSampler");
+	g_gl.uniforms[UNIFORM_SPHERE_LIGHT_COUNT] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_LightCount");
+	g_gl.uniforms[UNIFORM_SPHERE_CLUSTER_GRID] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_ClusterGrid");
+	g_gl.uniforms[UNIFORM_SPHERE_CLUSTER_DEPTH] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_ClusterDepth");
+	g_gl.uniforms[UNIFORM_SPHERE_TILE_COUNT_X] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_SPHERE], "u_TileCountX");
 
 	configureSphereProgram();
 
 	return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Variance Program
+ *
+ * This program estimates the convergence of the tiles of the scene
+ * framebuffer for adaptive sampling.
+ */
+bool loadVarianceProgram()
+{
+	djg_program *djp = djgp_create();
+	GLuint *program = &g_gl.programs[PROGRAM_VARIANCE];
+	char buf[1024];
+
+	LOG("Loading {Variance-Program}\n");
+	if (g_framebuffer.aa >= AA_MSAA2 && g_framebuffer.aa <= AA_MSAA16)
+		djgp_push_string(djp, "#define MSAA_FACTOR %i\n", 1 << g_framebuffer.aa);
+	djgp_push_string(djp, "#define TILE_SIZE %i\n", ADAPTIVE_TILE_SIZE);
+	djgp_push_string(djp, "#define BUFFER_BINDING_TILES %i\n", BUFFER_BINDING_TILES);
+	djgp_push_file(djp, strcat2(buf, g_app.dir.shader, "variance.glsl"));
+	if (!djgp_gl_upload(djp, 430, false, true, program)) {
+		LOG("=> Failure <=\n");
+		djgp_release(djp);
+
+		return false;
+	}
+	djgp_release(djp);
+
+	g_gl.uniforms[UNIFORM_VARIANCE_MOMENT_SAMPLER] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_VARIANCE], "u_MomentSampler");
+	g_gl.uniforms[UNIFORM_VARIANCE_THRESHOLD] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_VARIANCE], "u_Threshold");
+	g_gl.uniforms[UNIFORM_VARIANCE_MIN_PASS_COUNT] =
+		glGetUniformLocation(g_gl.programs[PROGRAM_VARIANCE], "u_MinPassCount");
+
+	configureVarianceProgram();
+
+	return (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load All Programs
@@ -467,6 +579,7 @@ bool loadPrograms()
 	v&= loadViewerProgram();
 	v&= loadBackgroundProgram();
 	v&= loadSphereProgram();
+	v&= loadVarianceProgram();
 
 	return v;
 }
@@ -483,16 +596,20 @@ bool loadPrograms()
  * Depending on the scene framebuffer AA mode, this function load 2 or
  * 3 textures. In FSAA mode, two RGBA16F and one DEPTH24_STENCIL8 textures
  * are created. In other modes, one RGBA16F and one DEPTH24_STENCIL8 textures
- * are created.
+ * are created. An additional RGBA32F texture accumulates the luminance
+ * moments of the passes for adaptive sampling.
  */
 bool loadSceneFramebufferTexture()
 {
 	if (glIsTexture(g_gl.textures[TEXTURE_SCENE]))
 		glDeleteTextures(1, &g_gl.textures[TEXTURE_SCENE]);
+	if (glIsTexture(g_gl.textures[TEXTURE_SCENE_MOMENTS]))
+		glDeleteTextures(1, &g_gl.textures[TEXTURE_SCENE_MOMENTS]);
 	if (glIsTexture(g_gl.textures[TEXTURE_Z]))
 		glDeleteTextures(1, &g_gl.textures[TEXTURE_Z]);
 	glGenTextures(1, &g_gl.textures[TEXTURE_Z]);
 	glGenTextures(1, &g_gl.textures[TEXTURE_SCENE]);
+	glGenTextures(1, &g_gl.textures[TEXTURE_SCENE_MOMENTS]);
 
 	switch (g_framebuffer.aa) {
 		case AA_NONE:
@@ -517,6 +634,17 @@ bool loadSceneFramebufferTexture()
 			               g_framebuffer.h);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+			LOG("Loading {Scene-Moments-Framebuffer-Texture}\n");
+			glActiveTexture(GL_TEXTURE0 + TEXTURE_SCENE_MOMENTS);
+			glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_SCENE_MOMENTS]);
+			glTexStorage2D(GL_TEXTURE_2D,
+			               1,
+			               GL_RGBA32F,
+			               g_framebuffer.w,
+			               g_framebuffer.h);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 			break;
 		case AA_MSAA2:
 		case AA_MSAA4:
@@ -550,6 +678,17 @@ bool loadSceneFramebufferTexture()
 			                          g_framebuffer.w,
 			                          g_framebuffer.h,
 			                          g_framebuffer.msaa.fixed);
+
+			LOG("Loading {Scene-MSAA-Moments-Framebuffer-Texture}\n");
+			glActiveTexture(GL_TEXTURE0 + TEXTURE_SCENE_MOMENTS);
+			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE,
+			              g_gl.textures[TEXTURE_SCENE_MOMENTS]);
+			glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE,
+			                          samples,
+			                          GL_RGBA32F,
+			                          g_framebuffer.w,
+			                          g_framebuffer.h,
+			                          g_framebuffer.msaa.fixed);
 		} break;
 	}
 	glActiveTexture(GL_TEXTURE0);
@@ -600,19 +739,20 @@ bool loadPivotTexture()
 		glDeleteTextures(1, &g_gl.textures[TEXTURE_PIVOT]);
 	glGenTextures(1, &g_gl.textures[TEXTURE_PIVOT]);
 
-	// 64x64 table
+	// square RGBA table (see fit.cpp)
 	const float data[] = {
 	#include "fit.inl"
 	};
+	int res = (int)std::sqrt((double)(BUFFER_SIZE(data) / 4));
 
 	glActiveTexture(GL_TEXTURE0 + TEXTURE_PIVOT);
 	glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_PIVOT]);
 	glTexStorage2D(GL_TEXTURE_2D,
 	               1,
 	               GL_RGBA32F,
-	               64,
-	               64);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 64, 64, GL_RGBA, GL_FLOAT, data);
+	               res,
+	               res);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, res, res, GL_RGBA, GL_FLOAT, data);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -623,6 +763,44 @@ bool loadPivotTexture()
 	return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Anisotropic Pivot Texture
+ *
+ * This loads the precomputed table of anisotropic GGX, whose
+ * four dimensions are packed into a 3D texture: the azimuth of the view
+ * direction and the roughness alpha_y share the depth of the texture. The
+ * table is much larger than that of isotropic GGX, so fit.cpp stores it in
+ * half precision, and its texels upload as they are.
+ */
+bool loadAnisoPivotTexture()
+{
+	LOG("Loading {Pivot-Anisotropic-Texture}\n");
+	if (glIsTexture(g_gl.textures[TEXTURE_PIVOT_ANISO]))
+		glDeleteTextures(1, &g_gl.textures[TEXTURE_PIVOT_ANISO]);
+	glGenTextures(1, &g_gl.textures[TEXTURE_PIVOT_ANISO]);
+
+	// the table starts with its resolution (see fit.cpp)
+	const uint16_t *data = &g_pivotAnisoTable[4];
+	int w = (int)g_pivotAnisoTable[0];
+	int h = (int)g_pivotAnisoTable[1];
+	int d = (int)g_pivotAnisoTable[2] * (int)g_pivotAnisoTable[3];
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_PIVOT_ANISO);
+	glBindTexture(GL_TEXTURE_3D, g_gl.textures[TEXTURE_PIVOT_ANISO]);
+	glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA16F, w, h, d);
+	glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, w, h, d, GL_RGBA, GL_HALF_FLOAT, data);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glActiveTexture(GL_TEXTURE0);
+
+	return (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load the Roughness Texture
@@ -636,14 +814,29 @@ bool loadRoughnessTextures()
 		glDeleteTextures(1, &g_gl.textures[TEXTURE_ROUGHNESS]);
 	glGenTextures(1, &g_gl.textures[TEXTURE_ROUGHNESS]);
 
+	const char *files[] = {"./textures/moon.png"};
+	double seconds[BUFFER_SIZE(files)];
 	djg_texture *djgt = djgt_create(1);
 	GLuint *glt = &g_gl.textures[TEXTURE_ROUGHNESS];
 
 	glActiveTexture(GL_TEXTURE0 + TEXTURE_ROUGHNESS);
-	djgt_push_image(djgt, "./textures/moon.png", 0);
+	if (!djgt_push_images(djgt, files, BUFFER_SIZE(files), false, seconds)) {
+		LOG("=> Failure <=\n");
+		djgt_release(djgt);
+
+		return false;
+	}
+	for (int i = 0; i < BUFFER_SIZE(files); ++i) {
+		LOG("-- Decoded %s in %.1f ms\n", files[i], seconds[i] * 1e3);
+	}
 
-	if (!djgt_gl_upload(djgt, GL_TEXTURE_2D, GL_R8, 1, 1, glt)) {
+	// the MIP chain is computed on the CPU so that it does not depend on
+	// the driver
+	djg_texture *mipmaps = djgt_create_mipmaps(djgt, false);
+
+	if (!djgt_gl_upload_mipmaps(mipmaps, GL_R8, glt)) {
 		LOG("=> Failure <=\n");
+		djgt_release(mipmaps);
 		djgt_release(djgt);
 
 		return false;
@@ -654,6 +847,7 @@ bool loadRoughnessTextures()
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.f);
 	glActiveTexture(GL_TEXTURE0);
 
+	djgt_release(mipmaps);
 	djgt_release(djgt);
 
 	return (glGetError() == GL_NO_ERROR);
@@ -671,6 +865,7 @@ bool loadTextures()
 	v&= loadBackFramebufferTexture();
 	v&= loadRoughnessTextures();
 	v&= loadPivotTexture();
+	v&= loadAnisoPivotTexture();
 
 	return v;
 }
@@ -690,98 +885,156 @@ bool loadTextures()
 void animatePlanets(float dt)
 {
 	if (g_planets.flags.animate) {
-		for (int i = 0; i < BUFFER_SIZE(g_planets.planets); ++i) {
-			g_planets.planets[i].orbitAngle+=
-				g_planets.planets[i].orbitVelocity * dt;
-			g_planets.planets[i].rotationAngle+=
-				g_planets.planets[i].rotationVelocity * dt;
-
-			while (g_planets.planets[i].orbitAngle > 360.f)
-				g_planets.planets[i].orbitAngle-= 360.f;
-			while (g_planets.planets[i].rotationAngle > 360.f)
-				g_planets.planets[i].rotationAngle-= 360.f;
-		}
+		advancePlanets(dt);
 		g_framebuffer.flags.reset = true;
 	}
 }
 
-bool loadSphereDataBuffers(float dt = 0)
+// (re)create a stream buffer whenever the size of its data changes; the
+// buffer is persistently mapped when the GL supports it, so that streaming
+// requires no mapping calls
+void loadStream(int stream, int dataSize)
+{
+	if (g_gl.streamSizes[stream] != dataSize) {
+		djg_buffer *buffer = NULL;
+
+		if (g_gl.streams[stream])
+			djgb_release(g_gl.streams[stream]);
+		if (ogl_ext_ARB_buffer_storage == ogl_LOAD_SUCCEEDED)
+			buffer = djgb_create_persistent(dataSize);
+		if (!buffer)
+			buffer = djgb_create(dataSize);
+		g_gl.streams[stream] = buffer;
+		g_gl.streamSizes[stream] = dataSize;
+	}
+}
+
+/*
+Selects the LOD of each sphere from its projected radius: LOD i has
+2^-i times the meridian segments of the finest LOD, and we pick the
+coarsest LOD whose segments project below the target edge length. The
+spheres are then sorted by LOD, so that each LOD is drawn at once.
+*/
+void computeSphereLods()
 {
-	static bool first = true;
-	struct Transform {
-		dja::mat4 model, modelView, modelViewProjection, viewInv;
-	} transforms[BUFFER_SIZE(g_planets.planets)];
-	struct Sphere {
-		dja::vec4 geometry;
-		dja::vec4 light;
-		dja::vec4 brdf;
-		dja::vec4 reserved;
-	} spheres[BUFFER_SIZE(g_planets.planets)];
-
-	if (first) {
-		g_gl.streams[STREAM_TRANSFORM] = djgb_create(sizeof(transforms));
-		g_gl.streams[STREAM_SPHERES] = djgb_create(sizeof(spheres));
-		first = false;
+	const std::vector<SphereData>& spheres = g_spheres.spheres;
+	float tanFovy = tanf(0.5f * radians(g_camera.fovy));
+	float pixelsPerUnit = 0.5f * g_framebuffer.h / tanFovy;
+	std::vector<int> lods(spheres.size(), 0);
+	int i;
+
+	for (i = 0; i < SPHERE_LOD_COUNT; ++i)
+		g_spheres.lods[i].count = 0;
+	for (i = 0; i < (int)spheres.size(); ++i) {
+		const dja::vec4& g = spheres[i].geometry;
+		float distance = sqrtf(g.x * g.x + g.y * g.y + g.z * g.z);
+
+		if (g_planets.sphere.lodEnabled && distance > g.w) {
+			float radiusPixels = pixelsPerUnit * g.w / distance;
+			float edgePixels = 2.f * M_PI * radiusPixels
+			                 / (std::max(4, g_planets.sphere.yTess) + 1);
+			float lod = log2f(g_planets.sphere.lodEdgePixels / edgePixels);
+
+			lods[i] = std::max(0, std::min(g_planets.sphere.lodCnt - 1, (int)lod));
+		}
+		++g_spheres.lods[lods[i]].count;
 	}
 
-	// extract view and projection matrices
-	dja::mat4 projection = dja::mat4::homogeneous::perspective(
-		radians(g_camera.fovy),
-		(float)g_framebuffer.w / (float)g_framebuffer.h,
-		g_camera.zNear,
-		g_camera.zFar
-	);
-	dja::mat4 viewInv = dja::mat4::homogeneous::translation(g_camera.pos)
-	                  * dja::mat4::homogeneous::from_mat3(g_camera.axis);
-	dja::mat4 view = dja::inverse(viewInv);
+	// counting sort
+	g_spheres.instances.resize(std::max((size_t)1, spheres.size()));
+	g_spheres.lods[0].offset = 0;
+	for (i = 1; i < SPHERE_LOD_COUNT; ++i)
+		g_spheres.lods[i].offset = g_spheres.lods[i - 1].offset
+		                         + g_spheres.lods[i - 1].count;
+	for (i = 0; i < SPHERE_LOD_COUNT; ++i)
+		g_spheres.lods[i].count = 0;
+	for (i = 0; i < (int)spheres.size(); ++i) {
+		int lod = lods[i];
+
+		g_spheres.instances[g_spheres.lods[lod].offset
+		                    + g_spheres.lods[lod].count++] = i;
+	}
+}
 
+bool loadSphereDataBuffers(float dt = 0)
+{
 	// compute new planet positions
 	animatePlanets(dt);
-	for (int i = 0; i < BUFFER_SIZE(g_planets.planets); ++i) {
-		float orbitAngle = radians(g_planets.planets[i].orbitAngle);
-		float rotationAngle = radians(g_planets.planets[i].rotationAngle);
-		dja::mat4 m1 = dja::mat4::homogeneous::rotation(
-			dja::vec3(0, 0, 1), orbitAngle
-		);
-		dja::mat4 m2 = dja::mat4::homogeneous::translation(
-			dja::vec3(g_planets.planets[i].orbitRadius, 0, 0)
-		);
-		dja::mat4 m3 = dja::mat4::homogeneous::rotation(
-			dja::vec3(0, 0, 1), rotationAngle
-		);
-		dja::mat4 m4 = dja::mat4::homogeneous::scale(
-			dja::vec3(g_planets.planets[i].scale)
-		);
-
-		// upload transformations
-		transforms[i].model     = m1 * m2 * m3 * m4;
-		transforms[i].modelView = view * transforms[i].model;
-		transforms[i].modelViewProjection = projection * transforms[i].modelView;
-
-		dja::vec4 spherePos = transforms[i].modelView * dja::vec4(0, 0, 0, 1);
-		spheres[i].geometry = dja::vec4(
-			spherePos.x, spherePos.y, spherePos.z, g_planets.planets[i].scale
-		);
-		spheres[i].light = dja::vec4(
-			g_planets.planets[i].emissionColor.r * g_planets.planets[i].emissionIntensity,
-			g_planets.planets[i].emissionColor.g * g_planets.planets[i].emissionIntensity,
-			g_planets.planets[i].emissionColor.b * g_planets.planets[i].emissionIntensity,
-			g_planets.planets[i].emissionIntensity > 0. ? 1.f : 0.f
-		);
-		spheres[i].brdf = dja::vec4(
-			g_planets.planets[i].roughness
-		);
+	computeSphereData((float)g_framebuffer.w / (float)g_framebuffer.h,
+	                  &g_spheres.transforms,
+	                  &g_spheres.spheres,
+	                  &g_spheres.lightIds,
+	                  &g_spheres.projection);
+	g_spheres.lightCount = (int)g_spheres.lightIds.size();
+	computeSphereLods();
+	if (g_lightTree.enabled) {
+		buildLightTree(g_spheres.spheres, g_spheres.lightIds,
+		               &g_spheres.lightTree);
+		if (g_spheres.lightTree.nodes.empty())
+			g_spheres.lightTree.nodes.resize(1); // buffers can't be empty
 	}
+	if (g_lightClusters.enabled) {
+		buildLightClusters(g_framebuffer.w, g_framebuffer.h,
+		                   g_spheres.spheres, g_spheres.lightIds,
+		                   &g_spheres.clusters);
+		g_spheres.lightIds = g_spheres.clusters.lightIds;
+	}
+	if (g_spheres.lightIds.empty())
+		g_spheres.lightIds.push_back(-1); // buffers can't be empty
 
 	// upload planet data
-	djgb_gl_upload(g_gl.streams[STREAM_TRANSFORM], (const void *)transforms, NULL);
+	loadStream(STREAM_TRANSFORM,
+	           sizeof(SphereTransform) * (int)g_spheres.transforms.size());
+	loadStream(STREAM_SPHERES,
+	           sizeof(SphereData) * (int)g_spheres.spheres.size());
+	loadStream(STREAM_LIGHTS,
+	           sizeof(int32_t) * (int)g_spheres.lightIds.size());
+	loadStream(STREAM_INSTANCES,
+	           sizeof(int32_t) * (int)g_spheres.instances.size());
+	djgb_gl_upload(g_gl.streams[STREAM_TRANSFORM],
+	               (const void *)&g_spheres.transforms[0], NULL);
 	djgb_glbindrange(g_gl.streams[STREAM_TRANSFORM],
-	                 GL_UNIFORM_BUFFER,
+	                 GL_SHADER_STORAGE_BUFFER,
 	                 STREAM_TRANSFORM);
-	djgb_gl_upload(g_gl.streams[STREAM_SPHERES], (const void *)spheres, NULL);
+	djgb_gl_upload(g_gl.streams[STREAM_SPHERES],
+	               (const void *)&g_spheres.spheres[0], NULL);
 	djgb_glbindrange(g_gl.streams[STREAM_SPHERES],
-	                 GL_UNIFORM_BUFFER,
+	                 GL_SHADER_STORAGE_BUFFER,
 	                 STREAM_SPHERES);
+	djgb_gl_upload(g_gl.streams[STREAM_LIGHTS],
+	               (const void *)&g_spheres.lightIds[0], NULL);
+	djgb_glbindrange(g_gl.streams[STREAM_LIGHTS],
+	                 GL_SHADER_STORAGE_BUFFER,
+	                 STREAM_LIGHTS);
+	djgb_gl_upload(g_gl.streams[STREAM_INSTANCES],
+	               (const void *)&g_spheres.instances[0], NULL);
+	djgb_glbindrange(g_gl.streams[STREAM_INSTANCES],
+	                 GL_SHADER_STORAGE_BUFFER,
+	                 STREAM_INSTANCES);
+	if (g_lightClusters.enabled) {
+		const std::vector<int32_t>& ranges = g_spheres.clusters.ranges;
+
+		loadStream(STREAM_CLUSTERS, sizeof(int32_t) * (int)ranges.size());
+		djgb_gl_upload(g_gl.streams[STREAM_CLUSTERS],
+		               (const void *)&ranges[0], NULL);
+		djgb_glbindrange(g_gl.streams[STREAM_CLUSTERS],
+		                 GL_SHADER_STORAGE_BUFFER,
+		                 STREAM_CLUSTERS);
+	}
+	if (g_lightTree.enabled) {
+		const std::vector<LightNode>& nodes = g_spheres.lightTree.nodes;
+
+		loadStream(STREAM_LIGHT_TREE, sizeof(LightNode) * (int)nodes.size());
+		djgb_gl_upload(g_gl.streams[STREAM_LIGHT_TREE],
+		               (const void *)&nodes[0], NULL);
+		djgb_glbindrange(g_gl.streams[STREAM_LIGHT_TREE],
+		                 GL_SHADER_STORAGE_BUFFER,
+		                 STREAM_LIGHT_TREE);
+	}
+
+	// update the light count and the cluster grid
+	if (glIsProgram(g_gl.programs[PROGRAM_SPHERE]))
+		configureSphereProgram();
 
 	return (glGetError() == GL_NO_ERROR);
 }
@@ -792,7 +1045,8 @@ bool loadSphereDataBuffers(float dt = 0)
  *
  * This buffer holds the random samples used by the GLSL Monte Carlo integrator.
  * It should be updated at each frame. The random samples are generated using 
- * the Marsaglia pseudo-random generator.
+ * the Marsaglia pseudo-random generator. Note that the buffer is only read
+ * by the SAMPLER_RANDOM sampler; the others are generated in the shader.
  */
 uint32_t mrand() // Marsaglia random generator
 {
@@ -806,14 +1060,10 @@ uint32_t mrand() // Marsaglia random generator
 
 bool loadRandomBuffer()
 {
-	static bool first = true;
 	float buffer[256];
 	int offset = 0;
 
-	if (first) {
-		g_gl.streams[STREAM_RANDOM] = djgb_create(sizeof(buffer));
-		first = false;
-	}
+	loadStream(STREAM_RANDOM, sizeof(buffer));
 
 	for (int i = 0; i < BUFFER_SIZE(buffer); ++i) {
 		buffer[i] = (float)((double)mrand() / (double)0xFFFFFFFFu);
@@ -832,16 +1082,75 @@ bool loadRandomBuffer()
 /**
  * Load Sphere Mesh Buffer
  *
- * This loads a vertex and an index buffer for a mesh.
+ * This loads a vertex and an index buffer for a mesh. The buffers hold
+ * up to SPHERE_LOD_COUNT sphere meshes; each LOD halves the tessellation
+ * of the previous one, down to a few dozen triangles, and indexes its
+ * vertices from its own base vertex. The chain stops early when the
+ * tessellation reaches its minimum, so that no LOD is finer than the
+ * previous one. All LODs share the index width of the finest.
  */
 bool loadSphereMeshBuffers()
 {
-	int vertexCnt, indexCnt;
-	djg_mesh *mesh = djgm_load_sphere(
-		1.f, g_planets.sphere.xTess, g_planets.sphere.yTess
-	);
-	const djgm_vertex *vertices = djgm_get_vertices(mesh, &vertexCnt);
-	const uint16_t *indexes = djgm_get_triangles(mesh, &indexCnt);
+	std::vector<djgm_vertex> vertices;
+	std::vector<uint32_t> indexes32;
+	std::vector<uint16_t> indexes16;
+	int indexSize = sizeof(uint16_t);
+	int xTess = std::max(2, g_planets.sphere.xTess);
+	int yTess = std::max(4, g_planets.sphere.yTess);
+	int i;
+
+	for (i = 0; i < SPHERE_LOD_COUNT; ++i) {
+		djg_mesh *mesh;
+		const djgm_vertex *meshVertices;
+		int vertexCnt, indexCnt;
+		float acmr;
+
+		// stop once the tessellation no longer decreases
+		if (i > 0) {
+			int x = std::max(2, xTess >> 1), y = std::max(4, yTess >> 1);
+
+			if (x == xTess && y == yTess)
+				break;
+			xTess = x;
+			yTess = y;
+		}
+		mesh = djgm_load_sphere(1.f, xTess, yTess);
+		acmr = djgm_acmr(mesh, 32);
+
+		// reorder the mesh for the post-transform vertex cache
+		if (djgm_optimize(mesh)) {
+			LOG("Sphere mesh LOD %i ACMR: %.3f -> %.3f\n",
+			    i, acmr, djgm_acmr(mesh, 32));
+		}
+		meshVertices = djgm_get_vertices(mesh, &vertexCnt);
+
+		// large meshes require 32-bit indexes
+		if (i == 0 && djgm_get_index_type(mesh) == GL_UNSIGNED_INT)
+			indexSize = sizeof(uint32_t);
+		g_planets.sphere.lods[i].firstIndex = (int)std::max(indexes16.size(),
+		                                                    indexes32.size());
+		g_planets.sphere.lods[i].baseVertex = (int)vertices.size();
+		if (djgm_get_index_type(mesh) == GL_UNSIGNED_INT) {
+			const uint32_t *meshIndexes = djgm_get_triangles32(mesh, &indexCnt);
+
+			indexes32.insert(indexes32.end(), meshIndexes, meshIndexes + indexCnt);
+		} else {
+			const uint16_t *meshIndexes = djgm_get_triangles(mesh, &indexCnt);
+
+			if (indexSize == sizeof(uint32_t))
+				indexes32.insert(indexes32.end(), meshIndexes, meshIndexes + indexCnt);
+			else
+				indexes16.insert(indexes16.end(), meshIndexes, meshIndexes + indexCnt);
+		}
+		g_planets.sphere.lods[i].indexCnt = indexCnt;
+		vertices.insert(vertices.end(), meshVertices, meshVertices + vertexCnt);
+		if (i == 0) {
+			g_planets.sphere.vertexCnt = vertexCnt;
+			g_planets.sphere.indexCnt = indexCnt;
+		}
+		djgm_release(mesh);
+	}
+	g_planets.sphere.lodCnt = i;
 
 	if (glIsBuffer(g_gl.buffers[BUFFER_SPHERE_VERTICES]))
 		glDeleteBuffers(1, &g_gl.buffers[BUFFER_SPHERE_VERTICES]);
@@ -852,27 +1161,145 @@ bool loadSphereMeshBuffers()
 	glGenBuffers(1, &g_gl.buffers[BUFFER_SPHERE_VERTICES]);
 	glBindBuffer(GL_ARRAY_BUFFER, g_gl.buffers[BUFFER_SPHERE_VERTICES]);
 	glBufferData(GL_ARRAY_BUFFER,
-	             sizeof(djgm_vertex) * vertexCnt,
-	             (const void*)vertices,
+	             sizeof(djgm_vertex) * vertices.size(),
+	             (const void*)&vertices[0],
 	             GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	LOG("Loading {Mesh-Grid-Index-Buffer}\n");
 	glGenBuffers(1, &g_gl.buffers[BUFFER_SPHERE_INDEXES]);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_gl.buffers[BUFFER_SPHERE_INDEXES]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	             sizeof(uint16_t) * indexCnt,
-	             (const void *)indexes,
-	             GL_STATIC_DRAW);
+	if (indexSize == sizeof(uint32_t))
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		             sizeof(uint32_t) * indexes32.size(),
+		             (const void *)&indexes32[0],
+		             GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		             sizeof(uint16_t) * indexes16.size(),
+		             (const void *)&indexes16[0],
+		             GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	g_planets.sphere.indexCnt = indexCnt;
-	g_planets.sphere.vertexCnt = vertexCnt;
-	djgm_release(mesh);
+	g_planets.sphere.indexSize = indexSize;
+
+	return (glGetError() == GL_NO_ERROR);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Reset the Active Tile Count Readback
+ *
+ * This drops the pending counts, which refer to tiles that were reset.
+ */
+void resetAdaptiveReadback()
+{
+	AdaptiveReadback& readback = g_adaptiveReadback;
+
+	for (; readback.tail < readback.head; ++readback.tail)
+		glDeleteSync(readback.fences[readback.tail % ADAPTIVE_READBACK_COUNT]);
+	readback.head = readback.tail = 0;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Release the Active Tile Count Readback
+ *
+ * This drops the pending counts; deleting the buffer also unmaps it.
+ */
+void releaseAdaptiveReadback()
+{
+	resetAdaptiveReadback();
+	g_adaptiveReadback.counts = NULL;
+	if (glIsBuffer(g_gl.buffers[BUFFER_ADAPTIVE_READBACK]))
+		glDeleteBuffers(1, &g_gl.buffers[BUFFER_ADAPTIVE_READBACK]);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Active Tile Count Readback
+ *
+ * This loads the ring of slots the active tile counts are copied to; it
+ * does not depend on the framebuffer, so it is only created once.
+ */
+bool loadAdaptiveReadback()
+{
+	if (glIsBuffer(g_gl.buffers[BUFFER_ADAPTIVE_READBACK]))
+		return true;
+
+	glGenBuffers(1, &g_gl.buffers[BUFFER_ADAPTIVE_READBACK]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, g_gl.buffers[BUFFER_ADAPTIVE_READBACK]);
+	if (ogl_ext_ARB_buffer_storage == ogl_LOAD_SUCCEEDED) {
+		GLbitfield flags = GL_MAP_READ_BIT
+		                 | GL_MAP_PERSISTENT_BIT
+		                 | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_COPY_WRITE_BUFFER,
+		                sizeof(uint32_t) * ADAPTIVE_READBACK_COUNT,
+		                NULL,
+		                flags);
+		g_adaptiveReadback.counts = (const uint32_t *)
+			glMapBufferRange(GL_COPY_WRITE_BUFFER,
+			                 0,
+			                 sizeof(uint32_t) * ADAPTIVE_READBACK_COUNT,
+			                 flags);
+	} else {
+		glBufferData(GL_COPY_WRITE_BUFFER,
+		             sizeof(uint32_t) * ADAPTIVE_READBACK_COUNT,
+		             NULL,
+		             GL_STREAM_READ);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
 	return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load Adaptive Tile Buffer
+ *
+ * This loads the buffer that holds the number of active tiles of the scene
+ * framebuffer, followed by the activity flag of each tile. All the tiles
+ * are marked active, so that adaptive sampling restarts from scratch, and
+ * the pending active tile counts are dropped. The buffer is reallocated
+ * only when the number of tiles changes; otherwise, it is refilled in
+ * place, as this runs each time the framebuffer is reset.
+ */
+bool loadAdaptiveTileBuffer()
+{
+	int tileCountX = (g_framebuffer.w + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+	int tileCountY = (g_framebuffer.h + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+	const uint32_t tileCount = (uint32_t)(tileCountX * tileCountY);
+	const uint32_t one = 1u;
+	GLsizeiptr size = sizeof(uint32_t) * (1 + tileCount);
+	GLint bufferSize = 0;
+
+	if (glIsBuffer(g_gl.buffers[BUFFER_ADAPTIVE_TILES])) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_ADAPTIVE_TILES]);
+		glGetBufferParameteriv(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &bufferSize);
+		if (bufferSize != size)
+			glDeleteBuffers(1, &g_gl.buffers[BUFFER_ADAPTIVE_TILES]);
+	}
+	if (bufferSize != size) {
+		glGenBuffers(1, &g_gl.buffers[BUFFER_ADAPTIVE_TILES]);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_ADAPTIVE_TILES]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+		                 BUFFER_BINDING_TILES,
+		                 g_gl.buffers[BUFFER_ADAPTIVE_TILES]);
+	}
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER,
+	                  GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &one);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(tileCount), &tileCount);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	g_framebuffer.adaptive.activeTileCount = (int)tileCount;
+
+	// pending counts refer to the previous tiles
+	resetAdaptiveReadback();
+
+	return loadAdaptiveReadback() && (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load All Buffers
@@ -885,6 +1312,7 @@ bool loadBuffers()
 	v&= loadSphereDataBuffers();
 	v&= loadRandomBuffer();
 	v&= loadSphereMeshBuffers();
+	v&= loadAdaptiveTileBuffer();
 
 	return v;
 }
@@ -1003,7 +1431,7 @@ bool loadBackFramebuffer()
  * Load the Scene Framebuffer
  *
  * This framebuffer is used to draw the 3D scene.
- * A single framebuffer is created, holding a color and Z buffer. 
+ * A single framebuffer is created, holding a color, a moment and a Z buffer.
  * The scene writes directly to it.
  */
 bool loadSceneFramebuffer()
@@ -1021,6 +1449,11 @@ bool loadSceneFramebuffer()
 		                       GL_TEXTURE_2D_MULTISAMPLE,
 		                       g_gl.textures[TEXTURE_SCENE],
 		                       0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER,
+		                       GL_COLOR_ATTACHMENT1,
+		                       GL_TEXTURE_2D_MULTISAMPLE,
+		                       g_gl.textures[TEXTURE_SCENE_MOMENTS],
+		                       0);
 		glFramebufferTexture2D(GL_FRAMEBUFFER,
 		                       GL_DEPTH_STENCIL_ATTACHMENT,
 		                       GL_TEXTURE_2D_MULTISAMPLE,
@@ -1032,6 +1465,11 @@ bool loadSceneFramebuffer()
 		                       GL_TEXTURE_2D,
 		                       g_gl.textures[TEXTURE_SCENE],
 		                       0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER,
+		                       GL_COLOR_ATTACHMENT1,
+		                       GL_TEXTURE_2D,
+		                       g_gl.textures[TEXTURE_SCENE_MOMENTS],
+		                       0);
 		glFramebufferTexture2D(GL_FRAMEBUFFER,
 		                       GL_DEPTH_STENCIL_ATTACHMENT,
 		                       GL_TEXTURE_2D,
@@ -1039,7 +1477,8 @@ bool loadSceneFramebuffer()
 		                       0);
 	}
 
-	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+	glDrawBuffers(BUFFER_SIZE(drawBuffers), drawBuffers);
 	if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) {
 		LOG("=> Failure <=\n");
 
@@ -1085,6 +1524,8 @@ void load()
 			djgc_release(g_gl.clocks[i]);
 		g_gl.clocks[i] = djgc_create();
 	}
+	if (g_gl.profiler) djgq_release(g_gl.profiler);
+	g_gl.profiler = djgq_create();
 
 	if (g_gl.font) djgf_release(g_gl.font);
 	g_gl.font = djgf_create(GL_TEXTURE0 + TEXTURE_COUNT);
@@ -1105,6 +1546,8 @@ void release()
 	for (i = 0; i < CLOCK_COUNT; ++i)
 		if (g_gl.clocks[i])
 			djgc_release(g_gl.clocks[i]);
+	if (g_gl.profiler)
+		djgq_release(g_gl.profiler);
 	for (i = 0; i < STREAM_COUNT; ++i)
 		if (g_gl.streams[i])
 			djgb_release(g_gl.streams[i]);
@@ -1114,6 +1557,7 @@ void release()
 	for (i = 0; i < TEXTURE_COUNT; ++i)
 		if (glIsTexture(g_gl.textures[i]))
 			glDeleteTextures(1, &g_gl.textures[i]);
+	releaseAdaptiveReadback();
 	for (i = 0; i < BUFFER_COUNT; ++i)
 		if (glIsBuffer(g_gl.buffers[i]))
 			glDeleteBuffers(1, &g_gl.buffers[i]);
@@ -1124,6 +1568,10 @@ void release()
 		if (glIsVertexArray(g_gl.vertexArrays[i]))
 			glDeleteVertexArrays(1, &g_gl.vertexArrays[i]);
 	if (g_gl.font) djgf_release(g_gl.font);
+	if (g_textureStream.stream) {
+		djgt_stream_release(g_textureStream.stream);
+		g_textureStream.stream = NULL;
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1131,6 +1579,70 @@ void release()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Update the Adaptive Sampling Tiles
+ *
+ * This pass flags the tiles of the scene framebuffer that have not converged
+ * yet, so that the next passes only shade the pixels of the active tiles.
+ * The number of active tiles is read back to stop rendering once it is zero;
+ * the readback completes a few passes late, so that the CPU never stalls.
+ */
+void updateAdaptiveTiles()
+{
+	AdaptiveReadback& readback = g_adaptiveReadback;
+	int tileCountX = (g_framebuffer.w + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+	int tileCountY = (g_framebuffer.h + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+	const uint32_t zero = 0u;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_ADAPTIVE_TILES]);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	glUseProgram(g_gl.programs[PROGRAM_VARIANCE]);
+	glDispatchCompute(tileCountX, tileCountY, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// copy the count to a free slot (if all slots are in flight, this count
+	// is skipped: a later one will do)
+	if (readback.head - readback.tail < ADAPTIVE_READBACK_COUNT) {
+		int slot = readback.head % ADAPTIVE_READBACK_COUNT;
+
+		glBindBuffer(GL_COPY_READ_BUFFER, g_gl.buffers[BUFFER_ADAPTIVE_TILES]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, g_gl.buffers[BUFFER_ADAPTIVE_READBACK]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+		                    0, sizeof(uint32_t) * slot, sizeof(uint32_t));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		readback.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		++readback.head;
+	}
+
+	// read the counts that are ready, without waiting
+	while (readback.tail < readback.head) {
+		int slot = readback.tail % ADAPTIVE_READBACK_COUNT;
+		GLenum status = glClientWaitSync(readback.fences[slot],
+		                                 GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		uint32_t activeTileCount;
+
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		if (readback.counts) {
+			activeTileCount = readback.counts[slot];
+		} else {
+			glBindBuffer(GL_COPY_READ_BUFFER, g_gl.buffers[BUFFER_ADAPTIVE_READBACK]);
+			glGetBufferSubData(GL_COPY_READ_BUFFER,
+			                   sizeof(uint32_t) * slot,
+			                   sizeof(uint32_t),
+			                   &activeTileCount);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glDeleteSync(readback.fences[slot]);
+		++readback.tail;
+		g_framebuffer.adaptive.activeTileCount = (int)activeTileCount;
+	}
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Render the Scene
@@ -1147,8 +1659,13 @@ void renderSceneProgressive()
 	glEnable(GL_CULL_FACE);
 
 	if (g_framebuffer.flags.reset) {
+		const GLfloat zeros[] = {0, 0, 0, 0};
+
 		glClearColor(0, 0, 0, g_framebuffer.samplesPerPass);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glClearBufferfv(GL_COLOR, 1, zeros);
+		if (g_framebuffer.adaptive.enabled)
+			loadAdaptiveTileBuffer();
 		g_framebuffer.pass = 0;
 		g_framebuffer.flags.reset = false;
 	}
@@ -1166,30 +1683,69 @@ void renderSceneProgressive()
 	}
 
 	// stop progressive drawing once the desired sampling rate has been reached
+	// or once all the tiles have converged
 	if (g_framebuffer.pass * g_framebuffer.samplesPerPass
-		< g_framebuffer.samplesPerPixel) {
+		< g_framebuffer.samplesPerPixel
+	&& !(g_framebuffer.adaptive.enabled
+	     && g_framebuffer.adaptive.activeTileCount == 0)) {
 
 		// draw planets
+		djgq_push(g_gl.profiler, "Spheres");
 		if (g_planets.flags.showLines)
 			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+		glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+		                   g_gl.uniforms[UNIFORM_SPHERE_SAMPLE_OFFSET],
+		                   g_framebuffer.pass * g_framebuffer.samplesPerPass);
 		glUseProgram(g_gl.programs[PROGRAM_SPHERE]);
-		glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_SPHERE]);
-		glDrawElementsInstanced(GL_TRIANGLES,
-		                        g_planets.sphere.indexCnt,
-		                        GL_UNSIGNED_SHORT,
-		                        NULL,
-		                        BUFFER_SIZE(g_planets.planets));
+		if (g_planets.flags.impostors) {
+			// one quad per sphere, facing the camera
+			glDisable(GL_CULL_FACE);
+			glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+			                   g_gl.uniforms[UNIFORM_SPHERE_INSTANCE_OFFSET],
+			                   0);
+			glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+			                      (GLsizei)g_spheres.spheres.size());
+			glEnable(GL_CULL_FACE);
+		} else {
+			glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_SPHERE]);
+			for (int i = 0; i < SPHERE_LOD_COUNT; ++i) {
+				int indexSize = g_planets.sphere.indexSize;
+
+				if (g_spheres.lods[i].count == 0)
+					continue;
+				glProgramUniform1i(g_gl.programs[PROGRAM_SPHERE],
+				                   g_gl.uniforms[UNIFORM_SPHERE_INSTANCE_OFFSET],
+				                   g_spheres.lods[i].offset);
+				glDrawElementsInstancedBaseVertex(
+					GL_TRIANGLES,
+					g_planets.sphere.lods[i].indexCnt,
+					indexSize == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT,
+					BUFFER_OFFSET(indexSize * g_planets.sphere.lods[i].firstIndex),
+					g_spheres.lods[i].count,
+					g_planets.sphere.lods[i].baseVertex
+				);
+			}
+		}
 
 		if (g_planets.flags.showLines)
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		djgq_pop(g_gl.profiler);
 
 		// draw background
+		djgq_push(g_gl.profiler, "Background");
 		glUseProgram(g_gl.programs[PROGRAM_BACKGROUND]);
 		glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
 		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		djgq_pop(g_gl.profiler);
 
 		++g_framebuffer.pass;
+
+		// update the active tiles
+		if (g_framebuffer.adaptive.enabled
+		&& g_framebuffer.pass >= g_framebuffer.adaptive.minPassCount)
+			updateAdaptiveTiles();
 	}
 
 	// restore GL state
@@ -1203,7 +1759,9 @@ void renderSceneProgressive()
 
 void renderScene()
 {
+	djgq_push(g_gl.profiler, "Upload");
 	loadSphereDataBuffers(1.f);
+	djgq_pop(g_gl.profiler);
 	if (g_framebuffer.flags.progressive) {
 		renderSceneProgressive();
 	} else {
@@ -1228,7 +1786,7 @@ void renderScene()
 void imguiSetAa()
 {
 	if (!loadSceneFramebufferTexture() || !loadSceneFramebuffer() 
-	|| !loadViewerProgram()) {
+	|| !loadViewerProgram() || !loadVarianceProgram()) {
 		LOG("=> Framebuffer config failed <=\n");
 		throw std::exception();
 	}
@@ -1244,12 +1802,15 @@ void renderViewer(double cpuDt, double gpuDt)
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	// post process the scene framebuffer
+	djgq_push(g_gl.profiler, "Viewer");
 	glUseProgram(g_gl.programs[PROGRAM_VIEWER]);
 	glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	djgq_pop(g_gl.profiler);
 
 	// draw HUD
 	if (g_app.viewer.hud) {
+		djgq_push(g_gl.profiler, "ImGui");
 		glUseProgram(0);
 		glBindVertexArray(0);
 
@@ -1267,7 +1828,7 @@ void renderViewer(double cpuDt, double gpuDt)
 		// ImGui
 		// Viewer Widgets
 		ImGui::SetNextWindowPos(ImVec2(270, 10)/*, ImGuiSetCond_FirstUseEver*/);
-		ImGui::SetNextWindowSize(ImVec2(250, 120)/*, ImGuiSetCond_FirstUseEver*/);
+		ImGui::SetNextWindowSize(ImVec2(250, 200)/*, ImGuiSetCond_FirstUseEver*/);
 		ImGui::Begin("Framebuffer");
 		{
 			const char* aaItems[] = { 
@@ -1281,12 +1842,31 @@ void renderViewer(double cpuDt, double gpuDt)
 				imguiSetAa();
 			if (ImGui::Combo("MSAA", &g_framebuffer.msaa.fixed, "Fixed\0Random\0\0"))
 				imguiSetAa();
+			if (ImGui::Combo("Sampler", &g_framebuffer.sampler, "Random\0Sobol\0Lattice\0\0")) {
+				loadSphereProgram();
+				g_framebuffer.flags.reset = true;
+			}
 			ImGui::Checkbox("Progressive", &g_framebuffer.flags.progressive);
 			if (g_framebuffer.flags.progressive) {
 				ImGui::SameLine();
 				if (ImGui::Button("Reset"))
 					g_framebuffer.flags.reset = true;
 			}
+			if (ImGui::Checkbox("Adaptive", &g_framebuffer.adaptive.enabled)) {
+				loadSphereProgram();
+				g_framebuffer.flags.reset = true;
+			}
+			if (g_framebuffer.adaptive.enabled) {
+				if (ImGui::SliderFloat("Threshold", &g_framebuffer.adaptive.threshold, 0.005f, 0.5f, "%.3f", 2.f)) {
+					configureVarianceProgram();
+					g_framebuffer.flags.reset = true;
+				}
+				if (ImGui::SliderInt("MinPasses", &g_framebuffer.adaptive.minPassCount, 2, 64)) {
+					configureVarianceProgram();
+					g_framebuffer.flags.reset = true;
+				}
+				ImGui::Text("Active Tiles: %i", g_framebuffer.adaptive.activeTileCount);
+			}
 		}
 		ImGui::End();
 		// Framebuffer Widgets
@@ -1357,21 +1937,42 @@ void renderViewer(double cpuDt, double gpuDt)
 				ImGui::SameLine();
 				if (ImGui::Checkbox("Wireframe", &g_planets.flags.showLines))
 					g_framebuffer.flags.reset = true;
+				if (ImGui::Checkbox("Analytic Pivot Fit", &g_planets.flags.analyticPivotFit)) {
+					loadSphereProgram();
+					g_framebuffer.flags.reset = true;
+				}
+				if (ImGui::Checkbox("Impostors", &g_planets.flags.impostors)) {
+					loadSphereProgram();
+					g_framebuffer.flags.reset = true;
+				}
 			}
 			if (ImGui::CollapsingHeader("Geometry", ImGuiTreeNodeFlags_DefaultOpen)) {
-				if (ImGui::SliderInt("xTess", &g_planets.sphere.xTess, 0, 128)) {
+				if (ImGui::SliderInt("xTess", &g_planets.sphere.xTess, 0, 1024)) {
 					loadSphereMeshBuffers();
 					loadSphereVertexArray();
 					g_framebuffer.flags.reset = true;
 				}
-				if (ImGui::SliderInt("yTess", &g_planets.sphere.yTess, 0, 128)) {
+				if (ImGui::SliderInt("yTess", &g_planets.sphere.yTess, 0, 1024)) {
 					loadSphereMeshBuffers();
 					loadSphereVertexArray();
 					g_framebuffer.flags.reset = true;
 				}
+				ImGui::Text("Vertices: %i (%i-bit indexes)",
+				            g_planets.sphere.vertexCnt,
+				            8 * g_planets.sphere.indexSize);
+				if (ImGui::Checkbox("LOD", &g_planets.sphere.lodEnabled))
+					g_framebuffer.flags.reset = true;
+				if (g_planets.sphere.lodEnabled) {
+					if (ImGui::SliderFloat("LOD Edge (px)", &g_planets.sphere.lodEdgePixels, 1.f, 64.f))
+						g_framebuffer.flags.reset = true;
+					ImGui::Text("Spheres per LOD: %i %i %i %i %i",
+					            g_spheres.lods[0].count, g_spheres.lods[1].count,
+					            g_spheres.lods[2].count, g_spheres.lods[3].count,
+					            g_spheres.lods[4].count);
+				}
 			}
 			if (ImGui::CollapsingHeader("Planet Properties", ImGuiTreeNodeFlags_DefaultOpen)) {
-				ImGui::Combo("Id", &g_planets.activePlanet, "Sun\0Planet1\0Planet2\0Planet3\0\0");
+				ImGui::SliderInt("Id", &g_planets.activePlanet, 0, (int)g_planets.planets.size() - 1);
 				int id = g_planets.activePlanet;
 				if (ImGui::SliderFloat("Radius", &g_planets.planets[id].scale, 0.0f, 0.5f))
 					g_framebuffer.flags.reset = true;
@@ -1379,6 +1980,8 @@ void renderViewer(double cpuDt, double gpuDt)
 					g_framebuffer.flags.reset = true;
 				if (ImGui::ColorEdit3("Emission Color", &g_planets.planets[id].emissionColor.r))
 					g_framebuffer.flags.reset = true;
+				if (ImGui::SliderFloat("Anisotropy", &g_planets.planets[id].anisotropy, 0.0f, 1.0f))
+					g_framebuffer.flags.reset = true;
 				if (id != 0) {
 					if (ImGui::SliderFloat("Orbit Angle", &g_planets.planets[id].orbitAngle, 0.0f, 360.0f))
 						g_framebuffer.flags.reset = true;
@@ -1393,10 +1996,89 @@ void renderViewer(double cpuDt, double gpuDt)
 						g_framebuffer.flags.reset = true;
 				}
 			}
+			if (ImGui::CollapsingHeader("Roughness Map")) {
+				ImGui::InputText("File", g_textureStream.file, sizeof(g_textureStream.file));
+				ImGui::SliderInt("Upload (KiB/frame)", &g_textureStream.kibPerFrame, 64, 16384);
+				if (g_textureStream.stream) {
+					ImGui::Text("Streaming...");
+				} else if (ImGui::Button("Load")) {
+					g_textureStream.stream =
+						djgt_stream_create(g_textureStream.file, 1, GL_R8, false);
+				}
+			}
+			if (ImGui::CollapsingHeader("Extra Lights")) {
+				static int count = g_planets.extraLights.count;
+
+				ImGui::InputInt("Count", &count, 256, 4096);
+				if (count < 0) count = 0;
+				if (ImGui::Button("Generate")) {
+					setExtraLights(count, g_planets.extraLights.seed + 1);
+					g_framebuffer.flags.reset = true;
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Clear")) {
+					setExtraLights(0, g_planets.extraLights.seed);
+					g_framebuffer.flags.reset = true;
+				}
+			}
+			if (ImGui::CollapsingHeader("Light Culling")) {
+				if (ImGui::Checkbox("Clustered", &g_lightClusters.enabled)) {
+					loadSphereDataBuffers();
+					loadSphereProgram();
+					g_framebuffer.flags.reset = true;
+				}
+				if (ImGui::SliderFloat("Cutoff", &g_lightClusters.cutoff, 1e-5f, 1e-1f, "%.5f", 4.f))
+					g_framebuffer.flags.reset = true;
+				if (ImGui::SliderInt("Tile Size", &g_lightClusters.tileSize, 8, 256))
+					g_framebuffer.flags.reset = true;
+				if (ImGui::SliderInt("Depth Slices", &g_lightClusters.zSlices, 1, 128))
+					g_framebuffer.flags.reset = true;
+				if (ImGui::Checkbox("Light Tree (MC MIS)", &g_lightTree.enabled)) {
+					loadSphereDataBuffers();
+					loadSphereProgram();
+					g_framebuffer.flags.reset = true;
+				}
+				ImGui::Text("Light References: %i",
+				            g_lightClusters.enabled ? (int)g_spheres.clusters.lightIds.size()
+				                                    : g_spheres.lightCount);
+			}
+		}
+		ImGui::End();
+		// Profiler Widgets
+		ImGui::SetNextWindowPos(ImVec2(g_app.viewer.w - 350, 60)/*, ImGuiSetCond_FirstUseEver*/);
+		ImGui::SetNextWindowSize(ImVec2(340, 220)/*, ImGuiSetCond_FirstUseEver*/);
+		ImGui::Begin("Profiler");
+		{
+			ImGui::Columns(4, "ProfilerColumns");
+			ImGui::Text("Scope"); ImGui::NextColumn();
+			ImGui::Text("GPU mean"); ImGui::NextColumn();
+			ImGui::Text("GPU p99"); ImGui::NextColumn();
+			ImGui::Text("CPU mean"); ImGui::NextColumn();
+			ImGui::Separator();
+			for (int i = 0; i < djgq_scope_count(g_gl.profiler); ++i) {
+				djgq_stats stats;
+
+				djgq_scope_stats(g_gl.profiler, i, &stats);
+				ImGui::Text("%*s%s", 2 * stats.depth, "", stats.name);
+				ImGui::NextColumn();
+				ImGui::Text("%.3f ms", stats.gpu_mean * 1e3); ImGui::NextColumn();
+				ImGui::Text("%.3f ms", stats.gpu_p99 * 1e3); ImGui::NextColumn();
+				ImGui::Text("%.3f ms", stats.cpu_mean * 1e3); ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
+			if (ImGui::Button("Save CSV")) {
+				char path[1024];
+
+				strcat2(path, g_app.dir.output, "profile.csv");
+				if (djgq_save_csv(g_gl.profiler, path)) {
+					LOG("Profile saved to %s\n", path);
+				}
+			}
 		}
 		ImGui::End();
 
 		ImGui::Render();
+		djgq_pop(g_gl.profiler);
 	}
 
 	// screen recording
@@ -1426,6 +2108,7 @@ void renderViewer(double cpuDt, double gpuDt)
  */
 void renderBack()
 {
+	djgq_push(g_gl.profiler, "Blit");
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, g_gl.framebuffers[FRAMEBUFFER_BACK]);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
@@ -1434,23 +2117,68 @@ void renderBack()
 	                  0, 0, g_app.viewer.w, g_app.viewer.h,
 	                  GL_COLOR_BUFFER_BIT,
 	                  GL_NEAREST);
+	djgq_pop(g_gl.profiler);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Stream the Roughness Texture
+ *
+ * This uploads a slice of the roughness map that is being loaded, if any,
+ * and swaps it in once complete.
+ */
+void updateTextureStream()
+{
+	djg_texture_stream *stream = g_textureStream.stream;
+	GLuint glt;
+
+	if (!stream)
+		return;
+
+	djgq_push(g_gl.profiler, "Texture Stream");
+	switch (djgt_stream_update(stream, g_textureStream.kibPerFrame << 10, &glt)) {
+		case DJGT_STREAM_READY:
+			LOG("Loading {Roughness-Texture} (streamed)\n");
+			glDeleteTextures(1, &g_gl.textures[TEXTURE_ROUGHNESS]);
+			g_gl.textures[TEXTURE_ROUGHNESS] = glt;
+			glActiveTexture(GL_TEXTURE0 + TEXTURE_ROUGHNESS);
+			glBindTexture(GL_TEXTURE_2D, glt);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.f);
+			glActiveTexture(GL_TEXTURE0);
+			g_framebuffer.flags.reset = true;
+			// fall through
+		case DJGT_STREAM_FAILED:
+			djgt_stream_release(stream);
+			g_textureStream.stream = NULL;
+			break;
+	}
+	djgq_pop(g_gl.profiler);
 }
 
 // -----------------------------------------------------------------------------
 /**
  * Render Everything
  *
+ * Each pass is timed by the profiler, whose statistics are shown in the HUD.
  */
 void render()
 {
 	double cpuDt, gpuDt;
 
+	djgq_begin_frame(g_gl.profiler);
+	updateTextureStream();
 	djgc_start(g_gl.clocks[CLOCK_SPF]);
+	djgq_push(g_gl.profiler, "Scene");
 	renderScene();
+	djgq_pop(g_gl.profiler);
 	djgc_stop(g_gl.clocks[CLOCK_SPF]);
 	djgc_ticks(g_gl.clocks[CLOCK_SPF], &cpuDt, &gpuDt);
 	renderViewer(cpuDt, gpuDt);
 	renderBack();
+	djgq_end_frame(g_gl.profiler);
 	++g_app.frame;
 }
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,172 @@
+/* sampler.h - public domain C++ library
+by Jonathan Dupuy
+
+	This file is a CPU port of sampler.glsl. It provides low-discrepancy
+	sample generators for the Monte Carlo integrators: an Owen-scrambled
+	Sobol sequence and a randomly shifted extensible rank-1 lattice.
+
+	USAGE
+
+	The library is header-only: simply include this file. All functions
+	mirror their GLSL counterparts one-to-one, and produce bit-identical
+	sequences.
+*/
+
+#ifndef PIVOT_INCLUDE_SAMPLER_H
+#define PIVOT_INCLUDE_SAMPLER_H
+
+#include <stdint.h>
+
+// Hash a 32-bit integer
+inline uint32_t sampler_hash(uint32_t x);
+
+// Compute the seed of a pixel
+inline uint32_t sampler_seed(uint32_t x, uint32_t y);
+
+// Compute the i-th point of an Owen-scrambled Sobol sequence
+inline void sampler_sobol(uint32_t i, uint32_t seed, float out[4]);
+
+// Compute the i-th point of a randomly shifted rank-1 lattice
+inline void sampler_lattice(uint32_t i, uint32_t seed, float out[4]);
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+
+// *****************************************************************************
+/**
+ * Utility Functions
+ *
+ */
+
+// lowbias32 hash by Chris Wellons
+inline uint32_t sampler_hash(uint32_t x)
+{
+	x^= x >> 16; x*= 0x7feb352du;
+	x^= x >> 15; x*= 0x846ca68bu;
+	x^= x >> 16;
+
+	return x;
+}
+
+inline uint32_t sampler_seed(uint32_t x, uint32_t y)
+{
+	return sampler_hash(x ^ sampler_hash(y));
+}
+
+// seed of the d-th dimension
+inline uint32_t sampler_dimensionSeed(uint32_t seed, uint32_t d)
+{
+	return sampler_hash(seed ^ (0x9e3779b9u * (d + 1u)));
+}
+
+inline uint32_t sampler_reverse(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+
+	return (x >> 16) | (x << 16);
+}
+
+// convert a 0.32 fixed point number to a float in [0, 1)
+inline float sampler_tofloat(uint32_t x)
+{
+	return (float)(x >> 8) * (1.f / 16777216.f);
+}
+
+// *****************************************************************************
+/**
+ * Owen-Scrambled Sobol Sequence
+ *
+ */
+
+// direction numbers of dimensions 1 to 3 (Joe and Kuo's new-joe-kuo-6.21201)
+static const uint32_t sampler_sobolDirections[3][32] = {
+	{
+		0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u,
+		0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+		0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u,
+		0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+		0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u,
+		0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+		0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u,
+		0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu
+	}, {
+		0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u,
+		0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+		0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u,
+		0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+		0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u,
+		0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+		0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u,
+		0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u
+	}, {
+		0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u,
+		0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+		0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u,
+		0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+		0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u,
+		0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+		0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u,
+		0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u
+	}
+};
+
+// Laine-Karras style permutation; the higher bits only depend on the
+// lower ones, so that it scrambles bit reversed numbers hierarchically
+inline uint32_t sampler_laineKarras(uint32_t x, uint32_t seed)
+{
+	x^= x * 0x3d20adeau;
+	x+= seed;
+	x*= (seed >> 16) | 1u;
+	x^= x * 0x05526c56u;
+	x^= x * 0x53a22864u;
+
+	return x;
+}
+
+// nested uniform scrambling, i.e., Owen scrambling, of a 0.32 fixed point
+inline uint32_t sampler_owen(uint32_t x, uint32_t seed)
+{
+	return sampler_reverse(sampler_laineKarras(sampler_reverse(x), seed));
+}
+
+inline void sampler_sobol(uint32_t i, uint32_t seed, float out[4])
+{
+	// shuffle the sequence, this preserves its stratification
+	uint32_t index = sampler_owen(i, seed);
+	uint32_t x[4] = {sampler_reverse(index), 0u, 0u, 0u};
+
+	for (int bit = 0; index != 0u; index>>= 1, ++bit) {
+		if (index & 1u) {
+			x[1]^= sampler_sobolDirections[0][bit];
+			x[2]^= sampler_sobolDirections[1][bit];
+			x[3]^= sampler_sobolDirections[2][bit];
+		}
+	}
+	for (int d = 0; d < 4; ++d)
+		out[d] = sampler_tofloat(sampler_owen(x[d], sampler_dimensionSeed(seed, d)));
+}
+
+// *****************************************************************************
+/**
+ * Rank-1 Lattice
+ *
+ * The lattice is enumerated in radical inverse order, so that its first
+ * 2^m points form a rank-1 lattice of 2^m points for any m. The generating
+ * vector is that of Cools, Kuo and Nuyens' extensible lattice sequences.
+ */
+inline void sampler_lattice(uint32_t i, uint32_t seed, float out[4])
+{
+	static const uint32_t g[4] = {1u, 182667u, 469891u, 498753u};
+	uint32_t phi = sampler_reverse(i);
+
+	// modulo 2^32 arithmetic computes fract(phi(i) * g + shift)
+	for (int d = 0; d < 4; ++d)
+		out[d] = sampler_tofloat(phi * g[d] + sampler_dimensionSeed(seed, d));
+}
+
+#endif // PIVOT_INCLUDE_SAMPLER_H
+
@@ -0,0 +1,319 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Sphere Light Shading Demo - Scene
+//
+// This file holds the scene state (camera and planets) that is shared by the
+// OpenGL demo (planets.cpp) and the headless CPU renderer (headless.cpp).
+// It must be included after dj_algebra.h.
+//
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdint.h>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.141592654
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Global Variables
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// -----------------------------------------------------------------------------
+// Camera Manager
+struct CameraManager {
+	float fovy, zNear, zFar; // perspective settings
+	dja::vec3 pos;           // 3D position
+	dja::mat3 axis;          // 3D frame
+} g_camera = {
+	55.f, 0.01f, 1024.f,
+	dja::vec3(1.5, 0, 0.4),
+	dja::mat3(
+		0.971769, -0.129628, -0.197135,
+		0.127271, 0.991562, -0.024635,
+		0.198665, -0.001150, 0.980067
+	)
+};
+
+// -----------------------------------------------------------------------------
+// Planet Manager
+enum {
+	SHADING_PIVOT,
+	SHADING_MC_MIS,
+	SHADING_MC_MIS_JOINT,
+	SHADING_MC_CAP,
+	SHADING_MC_GGX,
+	SHADING_MC_COS,
+	SHADING_MC_H2,
+	SHADING_MC_S2,
+	SHADING_DEBUG
+};
+
+// -----------------------------------------------------------------------------
+// Monte Carlo samplers (see sampler.glsl)
+enum {
+	SAMPLER_RANDOM,  // Marsaglia random numbers shifted per pixel
+	SAMPLER_SOBOL,   // Owen-scrambled Sobol sequence
+	SAMPLER_LATTICE  // randomly shifted rank-1 lattice
+};
+// number of levels of detail of the sphere mesh
+#define SPHERE_LOD_COUNT 5
+
+struct PlanetManager {
+	struct {
+		bool animate, showLines;
+		bool analyticPivotFit; // closed-form pivot fit instead of fit.inl
+		bool impostors;        // ray-traced quads instead of sphere meshes
+	} flags;
+	struct {
+		int xTess, yTess;    // tessellation of the finest LOD
+		int vertexCnt, indexCnt;
+		int indexSize; // in Bytes: 2 or 4, depending on the vertex count
+		bool lodEnabled;
+		float lodEdgePixels; // target projected edge length of the LODs
+		int lodCnt;          // number of loaded LODs
+		struct {
+			int firstIndex, indexCnt, baseVertex;
+		} lods[SPHERE_LOD_COUNT]; // each LOD halves the tessellation
+	} sphere;
+	struct {
+		const char **files;
+		int cnt;
+	} roughnessTextures, albedoTextures;
+	struct Planet {
+		float orbitRadius, orbitAngle, orbitVelocity;
+		float rotationAngle, rotationVelocity;
+		float scale;
+		float roughness;
+		float anisotropy; // in [0, 1], stretches the roughness along the meridians
+		float emissionIntensity;
+		struct {float r, g, b;} emissionColor;
+		int roughnessTexture, albedoTexture;
+	};
+	std::vector<Planet> planets;
+	struct {int count; uint32_t seed;} extraLights;
+	int activePlanet;
+	int shadingMode;
+} g_planets = {
+	{true, false, false, false},
+	{24, 48, -1, -1, 2, true, 8.f, 1, {}}, // sphere
+	{NULL, -1},       // roughnessTextures
+	{NULL, -1},       // albedoTextures
+	{
+		{
+			0, 0, 0,
+			0, 0,
+			0.2,
+			1, 0,
+			5,
+			{224.f/255.f, 224.f/255.f, 255.f/255.f},
+			0, 0
+		},
+		{
+			0.35, 45, 0.1,
+			0.0, 0.5,
+			0.1,
+			1, 0,
+			0,
+			{0.1, 0.1, 0.1},
+			0, 0
+		},
+		{
+			0.58, 170, 0.4,
+			0, 0.8,
+			0.08,
+			1, 0,
+			10,
+			{224.f/255.f, 0.f/255.f, 0.f/255.f},
+			0, 0
+		},
+		{
+			0.9, 0, 0.15,
+			0, 0.2,
+			0.17,
+			1, 0,
+			0,
+			{0.1, 0.1, 0.1},
+			0, 0
+		}
+	},
+	{0, 0}, // extraLights
+	1,
+	SHADING_PIVOT
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Scene Utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+
+float radians(float degrees)
+{
+	return degrees * M_PI / 180.f;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Advance the Planets
+ *
+ * This procedure moves the planets along their orbit and spins them
+ * around their axis by dt time units.
+ */
+void advancePlanets(float dt)
+{
+	for (int i = 0; i < (int)g_planets.planets.size(); ++i) {
+		g_planets.planets[i].orbitAngle+=
+			g_planets.planets[i].orbitVelocity * dt;
+		g_planets.planets[i].rotationAngle+=
+			g_planets.planets[i].rotationVelocity * dt;
+
+		while (g_planets.planets[i].orbitAngle > 360.f)
+			g_planets.planets[i].orbitAngle-= 360.f;
+		while (g_planets.planets[i].rotationAngle > 360.f)
+			g_planets.planets[i].rotationAngle-= 360.f;
+	}
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Set the Extra Lights
+ *
+ * This procedure replaces the extra lights of the scene, i.e., small
+ * emissive spheres with random orbits, colors and intensities that are
+ * appended to the planets on orbits that lie beyond those of the planets.
+ * It is used to stress the renderers with large light counts.
+ */
+void setExtraLights(int count, uint32_t seed)
+{
+	int planetCount = (int)g_planets.planets.size() - g_planets.extraLights.count;
+	uint32_t m_z = 1u + seed, m_w = 2u + 7u * seed;
+	auto rand = [&]() {
+		m_z = 36969u * (m_z & 65535u) + (m_z >> 16u);
+		m_w = 18000u * (m_w & 65535u) + (m_w >> 16u);
+
+		return (float)((double)((m_z << 16u) + m_w) / (double)0xFFFFFFFFu);
+	};
+
+	g_planets.planets.resize(planetCount);
+	for (int i = 0; i < count; ++i) {
+		PlanetManager::Planet p;
+
+		p.orbitRadius = 1.1f + 1.4f * rand();
+		p.orbitAngle = 360.f * rand();
+		p.orbitVelocity = 0.5f * rand();
+		p.rotationAngle = 0.f;
+		p.rotationVelocity = 0.f;
+		p.scale = 0.005f + 0.015f * rand();
+		p.roughness = 1.f;
+		p.anisotropy = 0.f;
+		p.emissionIntensity = 1.f + 19.f * rand();
+		p.emissionColor.r = rand();
+		p.emissionColor.g = rand();
+		p.emissionColor.b = rand();
+		p.roughnessTexture = p.albedoTexture = 0;
+		g_planets.planets.push_back(p);
+	}
+	g_planets.extraLights.count = count;
+	g_planets.extraLights.seed = seed;
+	if (g_planets.activePlanet >= (int)g_planets.planets.size())
+		g_planets.activePlanet = (int)g_planets.planets.size() - 1;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Compute Sphere Data
+ *
+ * This procedure computes the transformations and the data of the spheres
+ * that are used in the demo, as well as the list of the spheres that emit
+ * light. The memory layout of the structures matches that of the GLSL code.
+ */
+struct SphereTransform {
+	dja::mat4 model, modelView, modelViewProjection, viewInv;
+};
+struct SphereData {
+	dja::vec4 geometry; // xyz: view-space position; w: radius
+	dja::vec4 light;    // rgb: emission; a: isLight
+	dja::vec4 brdf;     // r: roughness; g: anisotropy
+	dja::vec4 reserved;
+};
+
+void
+computeSphereData(
+	float aspect,
+	std::vector<SphereTransform> *transforms,
+	std::vector<SphereData> *spheres,
+	std::vector<int32_t> *lightIds,
+	dja::mat4 *projectionOut = NULL
+) {
+	int sphereCount = (int)g_planets.planets.size();
+
+	// extract view and projection matrices
+	dja::mat4 projection = dja::mat4::homogeneous::perspective(
+		radians(g_camera.fovy),
+		aspect,
+		g_camera.zNear,
+		g_camera.zFar
+	);
+	dja::mat4 viewInv = dja::mat4::homogeneous::translation(g_camera.pos)
+	                  * dja::mat4::homogeneous::from_mat3(g_camera.axis);
+	dja::mat4 view = dja::inverse(viewInv);
+
+	if (projectionOut) *projectionOut = projection;
+
+	// compute planet positions
+	transforms->resize(sphereCount);
+	spheres->resize(sphereCount);
+	lightIds->resize(0);
+	for (int i = 0; i < sphereCount; ++i) {
+		SphereTransform& transform = (*transforms)[i];
+		SphereData& sphere = (*spheres)[i];
+		float orbitAngle = radians(g_planets.planets[i].orbitAngle);
+		float rotationAngle = radians(g_planets.planets[i].rotationAngle);
+		dja::mat4 m1 = dja::mat4::homogeneous::rotation(
+			dja::vec3(0, 0, 1), orbitAngle
+		);
+		dja::mat4 m2 = dja::mat4::homogeneous::translation(
+			dja::vec3(g_planets.planets[i].orbitRadius, 0, 0)
+		);
+		dja::mat4 m3 = dja::mat4::homogeneous::rotation(
+			dja::vec3(0, 0, 1), rotationAngle
+		);
+		dja::mat4 m4 = dja::mat4::homogeneous::scale(
+			dja::vec3(g_planets.planets[i].scale)
+		);
+
+		// transformations
+		transform.model     = m1 * m2 * m3 * m4;
+		transform.modelView = view * transform.model;
+		transform.modelViewProjection = projection * transform.modelView;
+		transform.viewInv = viewInv;
+
+		// sphere data
+		dja::vec4 spherePos = transform.modelView * dja::vec4(0, 0, 0, 1);
+		sphere.geometry = dja::vec4(
+			spherePos.x, spherePos.y, spherePos.z, g_planets.planets[i].scale
+		);
+		sphere.light = dja::vec4(
+			g_planets.planets[i].emissionColor.r * g_planets.planets[i].emissionIntensity,
+			g_planets.planets[i].emissionColor.g * g_planets.planets[i].emissionIntensity,
+			g_planets.planets[i].emissionColor.b * g_planets.planets[i].emissionIntensity,
+			g_planets.planets[i].emissionIntensity > 0. ? 1.f : 0.f
+		);
+		sphere.brdf = dja::vec4(
+			g_planets.planets[i].roughness,
+			g_planets.planets[i].anisotropy,
+			0, 0
+		);
+
+		// light list
+		if (sphere.light.w > 0.f)
+			lightIds->push_back(i);
+	}
+}
+
+#endif // SCENE_H
+
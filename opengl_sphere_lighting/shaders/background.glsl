@@ -19,9 +19,13 @@ void main() {
 // --------------------------------------------------
 #ifdef FRAGMENT_SHADER
 layout(location = 0) out vec4 o_FragColor;
+layout(location = 1) out vec4 o_FragMoments;
 
 void main() {
+	float Y = dot(u_ClearColor, vec3(0.2126, 0.7152, 0.0722));
+
 	o_FragColor = vec4(u_ClearColor, 1);
+	o_FragMoments = vec4(Y, Y * Y, 1, 0);
 }
 #endif
 
@@ -9,12 +9,14 @@ by Jonathan Dupuy
 
 // Evaluate GGX BRDF (brdf times cosine)
 float ggx_evalp(vec3 wi, vec3 wo, float alpha, out float pdf);
+float ggx_evalp(vec3 wi, vec3 wo, float alpha_x, float alpha_y, out float pdf);
 
 // Importance sample a visible microfacet normal from direction wi
 // Note: the algorithm I use is an improvement over Eric Heit'z
 // algorithm. It relies on Shirley's concentric mapping and produces less
 // distortion.
 vec3 ggx_sample(vec2 u, vec3 wi, float alpha);
+vec3 ggx_sample(vec2 u, vec3 wi, float alpha_x, float alpha_y);
 
 //
 //
@@ -29,10 +31,11 @@ vec3 ggx_sample(vec2 u, vec3 wi, float alpha);
 #define PI 3.141592654
 
 // -----------------------------------------------------------------------------
-// Evaluation
-float ggx_evalp(vec3 wi, vec3 wo, float alpha, out float pdf)
+// Evaluation (the roughness may be anisotropic, i.e., alpha_x != alpha_y)
+float ggx_evalp(vec3 wi, vec3 wo, float alpha_x, float alpha_y, out float pdf)
 {
 	if (wo.z > 0.0 && wi.z > 0.0) {
+		vec2 alpha = vec2(alpha_x, alpha_y);
 		vec3 wh = normalize(wi + wo);
 		vec3 wh_xform = vec3(wh.xy / alpha, wh.z);
 		vec3 wi_xform = vec3(wi.xy * alpha, wi.z);
@@ -47,7 +50,7 @@ float ggx_evalp(vec3 wi, vec3 wo, float alpha, out float pdf)
 		float sigma_o = 0.5 + 0.5 * wo_xform.z;
 		float Gi = clamp(wi.z, 0.0, 1.0) / (sigma_i * wi_xform_mag);
 		float Go = clamp(wo.z, 0.0, 1.0) / (sigma_o * wo_xform_mag);
-		float J = alpha * alpha * wh_xform_mag * wh_xform_mag * wh_xform_mag;
+		float J = alpha_x * alpha_y * wh_xform_mag * wh_xform_mag * wh_xform_mag;
 		float Dvis = clamp(dot(wo_xform, wh_xform), 0.0, 1.0) / (sigma_o * PI * J);
 		float Gcond = Gi / (Gi + Go - Gi * Go);
 		float cos_theta_d = dot(wh, wo);
@@ -59,6 +62,11 @@ float ggx_evalp(vec3 wi, vec3 wo, float alpha, out float pdf)
 	return 0.0;
 }
 
+float ggx_evalp(vec3 wi, vec3 wo, float alpha, out float pdf)
+{
+	return ggx_evalp(wi, wo, alpha, alpha, pdf);
+}
+
 // -----------------------------------------------------------------------------
 // uniform to concentric disk
 vec2 ggx__u2_to_d2(vec2 u)
@@ -167,5 +175,10 @@ vec3 ggx_sample(vec2 u, vec3 wi, float alpha)
 	return ggx__u2_to_h2(u, wi, alpha, alpha);
 }
 
+vec3 ggx_sample(vec2 u, vec3 wi, float alpha_x, float alpha_y)
+{
+	return ggx__u2_to_h2(u, wi, alpha_x, alpha_y);
+}
+
 #undef PI
 
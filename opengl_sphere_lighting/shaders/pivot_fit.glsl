@@ -0,0 +1,73 @@
+#line 1
+/* pivot_fit.glsl - public domain GLSL library
+by Jonathan Dupuy
+
+	This file provides a closed-form approximation of the pivot fit table
+	(fit.inl); see pivot_fit.h, which it mirrors one-to-one, for details.
+*/
+
+// Evaluate the fit; roughness is sqrt(alpha) and cos_theta is wo.z
+// returns (t, n, s) such that the pivot is (-t * wo.x, -t * wo.y, n) and s
+// is the BRDF scale; the norm of the pivot should be clamped to 0.999
+vec3 ggx_pivot_fit(float roughness, float cos_theta);
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+
+#define PIVOT_FIT_DEGREE 6
+#define PIVOT_FIT_TERMS  28 // (degree + 1) * (degree + 2) / 2
+
+// monomials x^i c^j with i + j <= degree, sorted by i then j
+const float PIVOT_FIT_COEFFS_T[PIVOT_FIT_TERMS] = float[PIVOT_FIT_TERMS](
+		 1.00807187e+00f,  5.34041456e-01f, -7.20329255e+00f,  3.09009377e+01f,
+		-5.78998966e+01f,  4.94796040e+01f, -1.58344755e+01f, -6.51984055e-01f,
+		 2.87618958e+00f, -5.50038050e+00f, -4.02030619e+00f,  1.70627135e+01f,
+		-9.41184555e+00f,  4.40212170e+00f, -1.10269946e+01f,  1.83166531e+01f,
+		-2.10172461e+01f,  5.10391850e+00f, -1.81582726e+01f,  1.88434563e+01f,
+		-5.04584073e+00f,  7.19992705e+00f,  2.63461816e+01f, -1.85633056e+01f,
+		-2.19726473e+00f, -1.78736528e+01f,  7.36746789e+00f,  4.92370589e+00f
+);
+const float PIVOT_FIT_COEFFS_N[PIVOT_FIT_TERMS] = float[PIVOT_FIT_TERMS](
+		 2.49928279e-03f,  8.79940567e-01f,  1.20313663e+00f, -4.02613901e+00f,
+		 5.97536835e+00f, -4.19856939e+00f,  1.16866151e+00f,  5.80976173e-03f,
+		-1.47128805e+00f,  5.46659962e+00f, -4.65057733e+00f,  2.53302638e-01f,
+		 2.47719966e-01f,  9.54389002e-01f, -4.84075644e+00f, -4.92762400e+00f,
+		 9.46499655e+00f, -1.40860235e+00f,  2.54756275e+00f,  4.07868377e+00f,
+		-8.27181480e+00f, -3.09546756e+00f, -5.28871852e+00f,  9.54293412e+00f,
+		 6.59394212e+00f,  4.39345859e-01f, -7.90557336e+00f,  1.59853879e+00f
+);
+const float PIVOT_FIT_COEFFS_S[PIVOT_FIT_TERMS] = float[PIVOT_FIT_TERMS](
+		 9.87785362e-01f,  3.42159373e-01f, -1.80901044e+00f,  4.50520824e+00f,
+		-7.22395377e+00f,  6.60465707e+00f, -2.39400149e+00f, -5.09581648e-01f,
+		 2.61866831e+00f,  8.66499533e-01f, -3.47822649e+00f, -2.17676297e+00f,
+		 2.29883166e+00f, -1.37119083e+00f, -1.19147191e+01f,  1.30949122e+01f,
+		 5.40781264e+00f, -3.24630597e+00f,  1.05797673e+01f,  6.17280335e+00f,
+		-2.01042270e+01f,  1.58765684e+00f, -1.85618236e+01f,  5.08467706e+00f,
+		 6.57180262e+00f,  1.32628105e+01f, -3.38278553e+00f, -3.50723587e+00f
+);
+
+// bivariate polynomial evaluation (Horner scheme in both variables)
+vec3 ggx_pivot_fit(float roughness, float cos_theta)
+{
+	float x = clamp(roughness, 0.0, 1.0);
+	float c = clamp(cos_theta, 0.0, 1.0);
+	vec3 p = vec3(0);
+
+	for (int i = PIVOT_FIT_DEGREE; i >= 0; --i) {
+		int offset = i * (PIVOT_FIT_DEGREE + 1) - i * (i - 1) / 2;
+		vec3 q = vec3(0);
+
+		for (int j = PIVOT_FIT_DEGREE - i; j >= 0; --j) {
+			q = q * c + vec3(PIVOT_FIT_COEFFS_T[offset + j],
+			                 PIVOT_FIT_COEFFS_N[offset + j],
+			                 PIVOT_FIT_COEFFS_S[offset + j]);
+		}
+		p = p * x + q;
+	}
+
+	return vec3(p.xy, clamp(p.z, 0.0, 1.0));
+}
+
+#undef PIVOT_FIT_DEGREE
+#undef PIVOT_FIT_TERMS
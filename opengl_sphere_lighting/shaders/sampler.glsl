@@ -0,0 +1,157 @@
+/* sampler.glsl - public domain GLSL library
+by Jonathan Dupuy
+
+	This file provides low-discrepancy sample generators for the Monte Carlo
+	integrators: an Owen-scrambled Sobol sequence, which relies on the
+	hash-based Laine-Karras permutation of Burley's "Practical Hash-based
+	Owen Scrambling", and a randomly shifted extensible rank-1 lattice.
+	Each generator produces 4D points and is decorrelated per pixel by a
+	seed, while keeping the stratification of the points of a pixel
+	across passes.
+*/
+
+// Hash a 32-bit integer
+uint sampler_hash(uint x);
+
+// Compute the seed of a pixel
+uint sampler_seed(uvec2 pixel);
+
+// Compute the i-th point of an Owen-scrambled Sobol sequence
+vec4 sampler_sobol(uint i, uint seed);
+
+// Compute the i-th point of a randomly shifted rank-1 lattice
+vec4 sampler_lattice(uint i, uint seed);
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+
+// *****************************************************************************
+/**
+ * Utility Functions
+ *
+ */
+
+// lowbias32 hash by Chris Wellons
+uint sampler_hash(uint x)
+{
+	x^= x >> 16; x*= 0x7feb352du;
+	x^= x >> 15; x*= 0x846ca68bu;
+	x^= x >> 16;
+
+	return x;
+}
+
+uint sampler_seed(uvec2 pixel)
+{
+	return sampler_hash(pixel.x ^ sampler_hash(pixel.y));
+}
+
+// seed of the d-th dimension
+uint sampler_dimensionSeed(uint seed, uint d)
+{
+	return sampler_hash(seed ^ (0x9e3779b9u * (d + 1u)));
+}
+
+// convert a 0.32 fixed point number to a float in [0, 1)
+vec4 sampler_tofloat(uvec4 x)
+{
+	return vec4(x >> 8u) * (1.0 / 16777216.0);
+}
+
+// *****************************************************************************
+/**
+ * Owen-Scrambled Sobol Sequence
+ *
+ */
+
+// direction numbers of dimensions 1 to 3 (Joe and Kuo's new-joe-kuo-6.21201)
+const uint SAMPLER_SOBOL_DIRECTIONS[96] = uint[96](
+	0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u,
+	0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+	0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u,
+	0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+	0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u,
+	0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+	0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u,
+	0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu,
+
+	0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u,
+	0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+	0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u,
+	0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+	0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u,
+	0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+	0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u,
+	0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u,
+
+	0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u,
+	0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+	0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u,
+	0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+	0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u,
+	0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+	0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u,
+	0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u
+);
+
+// Laine-Karras style permutation; the higher bits only depend on the
+// lower ones, so that it scrambles bit reversed numbers hierarchically
+uint sampler_laineKarras(uint x, uint seed)
+{
+	x^= x * 0x3d20adeau;
+	x+= seed;
+	x*= (seed >> 16) | 1u;
+	x^= x * 0x05526c56u;
+	x^= x * 0x53a22864u;
+
+	return x;
+}
+
+// nested uniform scrambling, i.e., Owen scrambling, of a 0.32 fixed point
+uint sampler_owen(uint x, uint seed)
+{
+	return bitfieldReverse(sampler_laineKarras(bitfieldReverse(x), seed));
+}
+
+vec4 sampler_sobol(uint i, uint seed)
+{
+	// shuffle the sequence, this preserves its stratification
+	uint index = sampler_owen(i, seed);
+	uvec4 x = uvec4(bitfieldReverse(index), 0u, 0u, 0u);
+
+	for (int bit = 0; index != 0u; index>>= 1, ++bit) {
+		if ((index & 1u) != 0u) {
+			x.y^= SAMPLER_SOBOL_DIRECTIONS[bit];
+			x.z^= SAMPLER_SOBOL_DIRECTIONS[32 + bit];
+			x.w^= SAMPLER_SOBOL_DIRECTIONS[64 + bit];
+		}
+	}
+	x.x = sampler_owen(x.x, sampler_dimensionSeed(seed, 0u));
+	x.y = sampler_owen(x.y, sampler_dimensionSeed(seed, 1u));
+	x.z = sampler_owen(x.z, sampler_dimensionSeed(seed, 2u));
+	x.w = sampler_owen(x.w, sampler_dimensionSeed(seed, 3u));
+
+	return sampler_tofloat(x);
+}
+
+// *****************************************************************************
+/**
+ * Rank-1 Lattice
+ *
+ * The lattice is enumerated in radical inverse order, so that its first
+ * 2^m points form a rank-1 lattice of 2^m points for any m. The generating
+ * vector is that of Cools, Kuo and Nuyens' extensible lattice sequences.
+ */
+vec4 sampler_lattice(uint i, uint seed)
+{
+	const uvec4 g = uvec4(1u, 182667u, 469891u, 498753u);
+	uvec4 shift = uvec4(sampler_dimensionSeed(seed, 0u),
+	                    sampler_dimensionSeed(seed, 1u),
+	                    sampler_dimensionSeed(seed, 2u),
+	                    sampler_dimensionSeed(seed, 3u));
+
+	// modulo 2^32 arithmetic computes fract(phi(i) * g + shift)
+	return sampler_tofloat(bitfieldReverse(i) * g + shift);
+}
+
@@ -4,20 +4,28 @@
  *
  */
 uniform int u_SamplesPerPass;
+uniform int u_SampleOffset; // index of the first sample of the pass
+uniform int u_LightCount;
+uniform int u_InstanceOffset; // offset of the LOD in u_Instances
+#if SPHERE_IMPOSTOR
+uniform mat4 u_Projection;        // camera projection, constant over a frame
+uniform mat4 u_ProjectionInverse;
+#endif
 
 uniform sampler2D u_PivotSampler;
+uniform sampler3D u_PivotAnisoSampler;
 uniform sampler2D u_RoughnessSampler;
 
 struct Sphere {
 	vec4 geometry; // xyz: pos; w: radius
 	vec4 light;    // rgb: color; a: isLight
-	vec4 brdf;     // r: roughness; yzw: reserved
+	vec4 brdf;     // r: roughness; g: anisotropy; zw: reserved
 	vec4 reserved;
 };
 
-layout(std140, binding = BUFFER_BINDING_SPHERES)
-uniform Spheres {
-	Sphere u_Spheres[SPHERE_COUNT];
+layout(std430, binding = BUFFER_BINDING_SPHERES)
+readonly buffer Spheres {
+	Sphere u_Spheres[];
 };
 
 struct Transform {
@@ -27,11 +35,61 @@ struct Transform {
 	mat4 viewInv;
 };
 
-layout(std140, row_major, binding = BUFFER_BINDING_TRANSFORMS)
-uniform Transforms {
-	Transform u_Transforms[SPHERE_COUNT];
+layout(std430, row_major, binding = BUFFER_BINDING_TRANSFORMS)
+readonly buffer Transforms {
+	Transform u_Transforms[];
+};
+
+// indexes of the drawn spheres, sorted by LOD
+layout(std430, binding = BUFFER_BINDING_INSTANCES)
+readonly buffer Instances {
+	int u_Instances[];
+};
+
+// indexes of the spheres that emit light (with clustered lighting,
+// this holds the concatenated light lists of all clusters)
+layout(std430, binding = BUFFER_BINDING_LIGHTS)
+readonly buffer Lights {
+	int u_LightIds[];
+};
+
+#if CLUSTERED_LIGHTING
+// (offset, count) light list of each cluster
+layout(std430, binding = BUFFER_BINDING_CLUSTERS)
+readonly buffer Clusters {
+	ivec2 u_ClusterRanges[];
+};
+
+uniform ivec4 u_ClusterGrid;  // xyz: cluster counts; w: tile size in pixels
+uniform vec2 u_ClusterDepth;  // x: zNear; y: slice count / log(zFar / zNear)
+#endif
+
+#if LIGHT_TREE
+// bounding volume hierarchy over the lights; the root is the first node
+struct LightNode {
+	vec4 bounds;     // xyz: pos; w: radius
+	float energy;    // sum of radiance times squared radius
+	int children[2]; // -1 for leaves
+	int sphereId;    // -1 for inner nodes
+};
+
+layout(std430, binding = BUFFER_BINDING_LIGHT_TREE)
+readonly buffer LightTree {
+	LightNode u_LightNodes[];
+};
+#endif
+
+#if ADAPTIVE_SAMPLING
+// activity flag of each tile of the framebuffer (see variance.glsl)
+layout(std430, binding = BUFFER_BINDING_TILES)
+readonly buffer Tiles {
+	uint u_ActiveTileCount;
+	uint u_TileActive[];
 };
 
+uniform int u_TileCountX; // number of tiles along the framebuffer width
+#endif
+
 layout(std140, binding = BUFFER_BINDING_RANDOM)
 uniform Random {
 	vec4 value[64];
@@ -50,8 +108,57 @@ float hash(vec2 p)
  * Vertex Shader
  *
  * The shader outputs attributes relevant for shading in view space.
+ * In impostor mode, it outputs a quad that covers the silhouette of the
+ * sphere instead, and the fragment shader intersects the sphere.
  */
 #ifdef VERTEX_SHADER
+#if SPHERE_IMPOSTOR
+layout(location = 0) out vec4 o_Position;
+layout(location = 4) flat out int o_SphereId;
+
+void main(void)
+{
+	int sphereId = u_Instances[u_InstanceOffset + gl_InstanceID];
+	vec3 c = u_Spheres[sphereId].geometry.xyz;
+	float r = u_Spheres[sphereId].geometry.w;
+	float d = length(c);
+
+	// the quad is tangent to the sphere at its closest point to the camera,
+	// and is large enough to hold the cone that bounds the sphere
+	vec3 w = c / d;
+	vec3 u = normalize(abs(w.x) < 0.9 ? cross(w, vec3(1, 0, 0))
+	                                  : cross(w, vec3(0, 1, 0)));
+	vec3 v = cross(w, u);
+	float h = (d - r) * r * inversesqrt(max(d * d - r * r, 1e-12));
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1 & 1) * 2.0 - 1.0;
+	vec3 p = (d - r) * w + h * (corner.x * u + corner.y * v);
+	bool nearClipped = false;
+
+	// the quad of a sphere that gets close to the camera may cross the near
+	// plane; the sphere is then traced through a screen quad that lies on
+	// the near plane, in front of all the visible points of the sphere
+	for (int i = 0; i < 4; ++i) {
+		vec2 q = vec2(i & 1, i >> 1 & 1) * 2.0 - 1.0;
+		vec4 clip = u_Projection * vec4((d - r) * w + h * (q.x * u + q.y * v), 1);
+
+		nearClipped = nearClipped || clip.z < -clip.w;
+	}
+	if (nearClipped) {
+		vec4 near = u_ProjectionInverse * vec4(corner, -1, 1);
+
+		p = near.xyz / near.w;
+		gl_Position = vec4(corner, -1, 1);
+	} else {
+		gl_Position = u_Projection * vec4(p, 1);
+	}
+
+	o_Position = vec4(p, 1);
+	o_SphereId = sphereId;
+
+	// spheres that hold the camera are not drawn
+	if (d <= r) gl_Position = vec4(0);
+}
+#else
 layout(location = 0) in vec4 i_Position;
 layout(location = 1) in vec4 i_TexCoord;
 layout(location = 2) in vec4 i_Tangent1;
@@ -64,14 +171,17 @@ layout(location = 4) flat out int o_SphereId;
 
 void main(void)
 {
-	o_Position = u_Transforms[gl_InstanceID].modelView * i_Position;
+	int sphereId = u_Instances[u_InstanceOffset + gl_InstanceID];
+
+	o_Position = u_Transforms[sphereId].modelView * i_Position;
 	o_TexCoord = i_TexCoord;
-	o_Tangent1 = u_Transforms[gl_InstanceID].modelView * i_Tangent1;
-	o_Tangent2 = u_Transforms[gl_InstanceID].modelView * i_Tangent2;
-	o_SphereId = gl_InstanceID;
+	o_Tangent1 = u_Transforms[sphereId].modelView * i_Tangent1;
+	o_Tangent2 = u_Transforms[sphereId].modelView * i_Tangent2;
+	o_SphereId = sphereId;
 
-	gl_Position = u_Transforms[gl_InstanceID].modelViewProjection * i_Position;
+	gl_Position = u_Transforms[sphereId].modelViewProjection * i_Position;
 }
+#endif // SPHERE_IMPOSTOR
 #endif // VERTEX_SHADER
 
 // *****************************************************************************
@@ -85,16 +195,114 @@ layout(location = 1) in vec4 i_TexCoord;
 layout(location = 2) in vec4 i_Tangent1;
 layout(location = 3) in vec4 i_Tangent2;
 layout(location = 4) flat in int i_SphereId;
+#if SPHERE_IMPOSTOR
+// the quad lies in front of the sphere, so early depth tests remain valid
+layout(depth_greater) out float gl_FragDepth;
+#endif
 layout(location = 0) out vec4 o_FragColor;
+layout(location = 1) out vec4 o_FragMoments;
+
+// helper function to compute the j-th uniform sample of the pass
+vec4 sample4(int j)
+{
+#if SAMPLER_SOBOL
+	uint seed = sampler_seed(uvec2(gl_FragCoord.xy));
+
+	return sampler_sobol(uint(u_SampleOffset + j), seed);
+#elif SAMPLER_LATTICE
+	uint seed = sampler_seed(uvec2(gl_FragCoord.xy));
+
+	return sampler_lattice(uint(u_SampleOffset + j), seed);
+#else // SAMPLER_RANDOM
+	float h1 = hash(gl_FragCoord.xy);
+	float h2 = hash(gl_FragCoord.yx);
+
+	return mod(vec4(h1, h2, h1, h2) + rand(j), vec4(1.0));
+#endif
+}
+
+// helper function to fetch the range of lights that may affect the fragment
+ivec2 lightRange(vec3 pos)
+{
+#if CLUSTERED_LIGHTING
+	ivec2 tile = ivec2(gl_FragCoord.xy) / u_ClusterGrid.w;
+	int slice = int(log(-pos.x / u_ClusterDepth.x) * u_ClusterDepth.y);
+	ivec3 c = clamp(ivec3(tile, slice), ivec3(0), u_ClusterGrid.xyz - 1);
+
+	return u_ClusterRanges[(c.z * u_ClusterGrid.y + c.y) * u_ClusterGrid.x + c.x];
+#else
+	return ivec2(0, u_LightCount);
+#endif
+}
+
+#if LIGHT_TREE
+// helper function to estimate the contribution of a light tree node: the
+// energy of the node is spread over its bounding sphere, and integrated
+// against the pivot approximation of the BRDF
+float lightNodeImportance(int n, vec3 pos, mat3 tg, vec3 wo, vec3 pivot)
+{
+	vec4 bounds = u_LightNodes[n].bounds;
+	sphere s = sphere(tg * (bounds.xyz - pos), bounds.w);
+	int i = u_LightNodes[n].sphereId;
+
+	if (i == i_SphereId) return 0.0;
+	if (i >= 0 && dot(s.pos, s.pos) <= s.r * s.r) return 0.0; // overlapping light
+
+	return u_LightNodes[n].energy / (s.r * s.r)
+	     * GGXSphereLightingPivotApprox(s, wo, pivot);
+}
+
+// helper function to select a light proportionally to its importance;
+// returns the sphere index of the light and its probability, or -1
+int lightTreeSample(vec3 pos, mat3 tg, vec3 wo, vec3 pivot, float u, out float pdf)
+{
+	int n = 0;
+
+	pdf = 1.0;
+	if (u_LightCount == 0) return -1;
+	while (u_LightNodes[n].sphereId < 0) {
+		int n1 = u_LightNodes[n].children[0];
+		int n2 = u_LightNodes[n].children[1];
+		float i1 = lightNodeImportance(n1, pos, tg, wo, pivot);
+		float i2 = lightNodeImportance(n2, pos, tg, wo, pivot);
+
+		if (i1 + i2 <= 0.0) return -1;
+		float p1 = i1 / (i1 + i2);
+		if (u < p1) {
+			n = n1;
+			pdf*= p1;
+			u = min(u / p1, 0.99999994);
+		} else {
+			n = n2;
+			pdf*= 1.0 - p1;
+			u = min((u - p1) / (1.0 - p1), 0.99999994);
+		}
+	}
+
+	return u_LightNodes[n].sphereId;
+}
+#endif
 
 // helper function to extract the pivot parameters
 // wo is assumed to be expressed in tangent space
 vec3 extractPivot(vec3 wo, float alpha, out float brdfScale)
 {
+#if PIVOT_FIT_ANALYTIC
+	// evaluate the closed-form fit (see pivot_fit.glsl)
+	vec3 fit = ggx_pivot_fit(sqrt(alpha), wo.z);
+	vec3 pivot = vec3(-fit.x * wo.xy, fit.y);
+	float nrm2 = dot(pivot, pivot);
+
+	if (nrm2 > 0.998) pivot*= 0.999 * inversesqrt(nrm2);
+	brdfScale = fit.z;
+
+	return pivot;
+#else
 	// fetch pivot fit params
 	float theta = acos(wo.z);
 	vec2 fitLookup = vec2(sqrt(alpha), 2.0 * theta / 3.14159);
-	fitLookup = fma(fitLookup, vec2(63.0 / 64.0), vec2(0.5 / 64.0));
+	vec2 fitRes = vec2(textureSize(u_PivotSampler, 0));
+	fitLookup = fma(fitLookup, (fitRes - 1.0) / fitRes, 0.5 / fitRes);
 	vec4 pivotParams = texture(u_PivotSampler, fitLookup);
 	float pivotNorm = pivotParams.r;
 	float pivotElev = pivotParams.g;
@@ -107,20 +315,159 @@ vec3 extractPivot(vec3 wo, float alpha, out float brdfScale)
 	basis[2] = vec3(0, 0, 1);
 	pivot = basis * pivot;
 
+	// return
+	brdfScale = pivotParams.a;
+	return pivot;
+#endif
+}
+
+// helper function to extract the pivot parameters of anisotropic GGX
+// wo is assumed to be expressed in tangent space; the closed-form fit
+// only covers isotropic GGX, so this always relies on fit_aniso.inl,
+// whose texels store the pivot for wo.x, wo.y >= 0 (see fit.cpp)
+vec3 extractPivot(vec3 wo, vec2 alpha, out float brdfScale)
+{
+	if (alpha.x == alpha.y)
+		return extractPivot(wo, alpha.x, brdfScale);
+
+	// fold wo into the first quadrant
+	vec2 quadrant = mix(vec2(-1), vec2(1), greaterThanEqual(wo.xy, vec2(0)));
+	float theta = acos(wo.z);
+	float phi = atan(abs(wo.y), max(abs(wo.x), 1e-7)); // atan(0, 0) is undefined
+
+	// fetch pivot fit params: the slices along the depth of the texture
+	// are indexed by phi first and sqrt(alpha_y) second, so we filter
+	// sqrt(alpha_y) manually
+	vec3 fitRes = vec3(textureSize(u_PivotAnisoSampler, 0));
+	float phiRes = float(PIVOT_ANISO_PHI_RES);
+	float alphaYRes = fitRes.z / phiRes;
+	vec2 fitLookup = vec2(sqrt(alpha.x), 2.0 * theta / 3.14159);
+	fitLookup = fma(fitLookup, (fitRes.xy - 1.0) / fitRes.xy, 0.5 / fitRes.xy);
+	float phiSlice = 2.0 * phi / 3.14159 * (phiRes - 1.0);
+	float alphaYSlice = sqrt(alpha.y) * (alphaYRes - 1.0);
+	float l0 = min(floor(alphaYSlice), alphaYRes - 2.0);
+	vec4 pivotParams = mix(
+		texture(u_PivotAnisoSampler,
+		        vec3(fitLookup, (l0 * phiRes + phiSlice + 0.5) / fitRes.z)),
+		texture(u_PivotAnisoSampler,
+		        vec3(fitLookup, ((l0 + 1.0) * phiRes + phiSlice + 0.5) / fitRes.z)),
+		alphaYSlice - l0
+	);
+	vec3 pivot = pivotParams.rgb; // in the frame of wo
+
+	// express the pivot in tangent space and unfold it
+	mat3 basis;
+	basis[0] = vec3(cos(phi), sin(phi), 0);
+	basis[1] = vec3(-sin(phi), cos(phi), 0);
+	basis[2] = vec3(0, 0, 1);
+	pivot = basis * pivot;
+	pivot.xy*= quadrant;
+
 	// return
 	brdfScale = pivotParams.a;
 	return pivot;
 }
 
+// Burley's remapping of the anisotropy to the roughness along each
+// tangent, which preserves the roughness of isotropic surfaces
+vec2 anisotropicAlpha(float alpha, float anisotropy)
+{
+	float aspect = sqrt(1.0 - 0.9 * anisotropy);
+
+	return clamp(vec2(alpha / aspect, alpha * aspect), 5e-3, 1.0);
+}
+
+#if SPHERE_IMPOSTOR
+// helper function to intersect the sphere seen through the fragment; the
+// attributes match those of the meshes of djgm_load_sphere, i.e., the
+// texture coordinates are (phi / 2pi, theta / pi) in model space. The
+// attributes are always written, so that texture gradients remain valid
+// along the silhouette: rays that miss the sphere take the point of the
+// sphere that is closest to them, and the function returns false.
+bool intersectSphere(out vec3 pos, out vec2 uv, out vec3 wx, out vec3 wy)
+{
+	vec3 dir = normalize(i_Position.xyz);
+	vec3 c = u_Spheres[i_SphereId].geometry.xyz;
+	float r = u_Spheres[i_SphereId].geometry.w;
+	float b = dot(dir, c);
+	float disc = b * b - dot(c, c) + r * r;
+	bool hit = disc >= 0.0;
+
+	if (hit) {
+		pos = (b - sqrt(disc)) * dir;
+	} else {
+		pos = c + r * normalize(b * dir - c);
+	}
+
+	// depth; points in front of the near plane are clipped
+	vec4 clip = u_Projection * vec4(pos, 1);
+	hit = hit && clip.z >= -clip.w;
+	gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+
+	// parameterization; the model-view matrix is a similarity
+	mat3 modelView = mat3(u_Transforms[i_SphereId].modelView);
+	vec3 n = normalize(transpose(modelView) * (pos - c));
+	float theta = acos(clamp(n.z, -1.0, 1.0));
+	float phi = atan(n.y, n.x);
+	float cosTheta = cos(theta), sinTheta = sin(theta);
+
+	uv = vec2(fract(phi / 6.283185307), theta / 3.141592654);
+	wx = modelView * vec3(cosTheta * cos(phi), cosTheta * sin(phi), -sinTheta);
+	wy = modelView * vec3(-sin(phi), cos(phi), 0);
+
+	return hit;
+}
+
+// helper function to fetch the roughness texture without filtering
+// artifacts along the seam at phi = 0, where uv.x wraps around; it must be
+// called in uniform control flow, i.e., before any discard
+vec4 textureSeamless(sampler2D s, vec2 uv)
+{
+	vec2 uvAlt = vec2(fract(uv.x + 0.5), uv.y);
+	vec2 dx = dFdx(uv), dy = dFdy(uv);
+	vec2 dxAlt = dFdx(uvAlt), dyAlt = dFdy(uvAlt);
+
+	if (abs(dxAlt.x) + abs(dyAlt.x) < abs(dx.x) + abs(dy.x)) {
+		dx.x = dxAlt.x;
+		dy.x = dyAlt.x;
+	}
+
+	return textureGrad(s, uv, dx, dy);
+}
+#endif
+
 void main(void)
 {
+#if ADAPTIVE_SAMPLING
+	// skip the tiles that have converged
+	ivec2 tile = ivec2(gl_FragCoord.xy) / TILE_SIZE;
+	if (u_TileActive[tile.y * u_TileCountX + tile.x] == 0u) discard;
+#endif
+
 	// extract attributes
+#if SPHERE_IMPOSTOR
+	vec3 pos, wx, wy;
+	vec2 uv;
+
+	bool hit = intersectSphere(pos, uv, wx, wy);
+	float roughness = textureSeamless(u_RoughnessSampler, uv).r;
+
+	if (!hit) discard;
+	wx = normalize(wx);
+	wy = normalize(wy);
+#else
+	vec3 pos = i_Position.xyz;
 	vec3 wx = normalize(i_Tangent1.xyz);
 	vec3 wy = normalize(i_Tangent2.xyz);
+	float roughness = texture(u_RoughnessSampler, i_TexCoord.xy).r;
+#endif
 	vec3 wn = normalize(cross(wx, wy));
-	vec3 wo = normalize(-i_Position.xyz);
+	vec3 wo = normalize(-pos);
 	mat3 tg = transpose(mat3(wx, wy, wn));
-	float alpha = max(5e-3, texture(u_RoughnessSampler, i_TexCoord.xy).r);
+	vec2 alpha = anisotropicAlpha(
+		max(5e-3, roughness),
+		u_Spheres[i_SphereId].brdf.g
+	);
 
 	// express data in tangent space
 	wo = tg * wo;
@@ -129,6 +476,7 @@ void main(void)
 	// initialize emitted and outgoing radiance
 	vec3 Le = u_Spheres[i_SphereId].light.rgb;
 	vec3 Lo = vec3(0);
+	ivec2 lights = lightRange(pos);
 
 // -----------------------------------------------------------------------------
 /**
@@ -146,12 +494,13 @@ void main(void)
 	float brdfScale;
 	vec3 pivot = extractPivot(wo, alpha, brdfScale);
 
-	for (int i = 0; i < SPHERE_COUNT; ++i) {
+	for (int k = lights.x; k < lights.x + lights.y; ++k) {
+		int i = u_LightIds[k];
 		if (i_SphereId == i) continue;
-		if (u_Spheres[i].light.a == 0.0) continue;
-		vec3 spherePos = tg * (u_Spheres[i].geometry.xyz - i_Position.xyz);
+		vec3 spherePos = tg * (u_Spheres[i].geometry.xyz - pos);
 		float sphereRadius = (u_Spheres[i].geometry.w);
 		sphere s = sphere(spherePos, sphereRadius);
+		if (dot(s.pos, s.pos) <= s.r * s.r) continue; // overlapping light
 
 		Lo+= GGXSphereLightingPivotApprox(s, wo, pivot)
 		   * u_Spheres[i].light.rgb;
@@ -173,12 +522,13 @@ void main(void)
  */
 #elif (SHADE_MC_GGX || SHADE_MC_CAP || SHADE_MC_COS || SHADE_MC_H2 || SHADE_MC_S2)
 	// iterate over all spheres
-	for (int i = 0; i < SPHERE_COUNT; ++i) {
+	for (int k = lights.x; k < lights.x + lights.y; ++k) {
+		int i = u_LightIds[k];
 		if (i_SphereId == i) continue;
-		if (u_Spheres[i].light.a == 0.0) continue;
-		vec3 spherePos = tg * (u_Spheres[i].geometry.xyz - i_Position.xyz);
+		vec3 spherePos = tg * (u_Spheres[i].geometry.xyz - pos);
 		float sphereRadius = u_Spheres[i].geometry.w;
 		sphere s = sphere(spherePos, sphereRadius);
+		if (dot(s.pos, s.pos) <= s.r * s.r) continue; // overlapping light
 		vec3 Li = u_Spheres[i].light.rgb;
 		float invSphereMagSqr = 1.0 / dot(s.pos, s.pos);
 		vec3 capDir = s.pos * sqrt(invSphereMagSqr);
@@ -188,9 +538,7 @@ void main(void)
 		// loop over all samples
 		for (int j = 0; j < u_SamplesPerPass; ++j) {
 			// compute a uniform sample
-			float h1 = hash(gl_FragCoord.xy);
-			float h2 = hash(gl_FragCoord.yx);
-			vec2 u2 = mod(vec2(h1, h2) + rand(j).xy, vec2(1.0));
+			vec2 u2 = sample4(j).xy;
 #if SHADE_MC_CAP
 			vec3 wi = u2_to_cap(u2, c);
 			float pdf = pdf_cap(wi, c);
@@ -204,12 +552,12 @@ void main(void)
 			vec3 wi = u2_to_s2(u2);
 			float pdf = pdf_s2(wi);
 #elif SHADE_MC_GGX
-			vec3 wm = ggx_sample(u2, wo, alpha);
+			vec3 wm = ggx_sample(u2, wo, alpha.x, alpha.y);
 			vec3 wi = 2.0 * wm * dot(wo, wm) - wo;
 			float pdf = 0.0; // initialized below
 #endif
 			float pdf_dummy;
-			float frp = ggx_evalp(wi, wo, alpha, pdf_dummy);
+			float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, pdf_dummy);
 			float raySphereIntersection = pdf_cap(wi, c);
 #if SHADE_MC_GGX
 			pdf = pdf_dummy;
@@ -234,32 +582,47 @@ void main(void)
  * renderers.
  */
 #elif SHADE_MC_MIS
+#if LIGHT_TREE
+	// fetch pivot fit params
+	float brdfScale; // this won't be used here
+	vec3 pivot = extractPivot(wo, alpha, brdfScale);
+
+	// select one sphere per sample
+	for (int k = 0; k < u_SamplesPerPass; ++k) {
+		float lightPdf;
+		float u1 = sample4(k).z;
+		int i = lightTreeSample(pos, tg, wo, pivot, u1, lightPdf);
+		if (i < 0) continue;
+		int firstSample = k, sampleCnt = 1;
+#else
 	// iterate over all spheres
-	for (int i = 0; i < SPHERE_COUNT; ++i) {
+	for (int k = lights.x; k < lights.x + lights.y; ++k) {
+		int i = u_LightIds[k];
+		float lightPdf = 1.0;
+		int firstSample = 0, sampleCnt = u_SamplesPerPass;
+#endif
 		if (i_SphereId == i) continue;
-		if (u_Spheres[i].light.a == 0.0) continue;
-		vec3 spherePos = tg * (u_Spheres[i].geometry.xyz - i_Position.xyz);
+		vec3 spherePos = tg * (u_Spheres[i].geometry.xyz - pos);
 		float sphereRadius = u_Spheres[i].geometry.w;
 		sphere s = sphere(spherePos, sphereRadius);
-		vec3 Li = u_Spheres[i].light.rgb;
+		if (dot(s.pos, s.pos) <= s.r * s.r) continue; // overlapping light
+		vec3 Li = u_Spheres[i].light.rgb / lightPdf;
 		float invSphereMagSqr = 1.0 / dot(s.pos, s.pos);
 		vec3 capDir = s.pos * sqrt(invSphereMagSqr);
 		float capCos = sqrt(1.0 - s.r * s.r * invSphereMagSqr);
 		cap c = cap(capDir, capCos);
 
 		// loop over all samples
-		for (int j = 0; j < u_SamplesPerPass; ++j) {
+		for (int j = firstSample; j < firstSample + sampleCnt; ++j) {
 			// compute a uniform sample
-			float h1 = hash(gl_FragCoord.xy);
-			float h2 = hash(gl_FragCoord.yx);
-			vec2 u2 = mod(vec2(h1, h2) + rand(j).xy, vec2(1.0));
+			vec2 u2 = sample4(j).xy;
 
 			// importance sample the BRDF
 			if (true) {
-				vec3 wm = ggx_sample(u2, wo, alpha);
+				vec3 wm = ggx_sample(u2, wo, alpha.x, alpha.y);
 				vec3 wi = 2.0 * wm * dot(wo, wm) - wo;
 				float pdf1;
-				float frp = ggx_evalp(wi, wo, alpha, pdf1);
+				float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, pdf1);
 				float raySphereIntersection = pdf_cap(wi, c);
 
 				// raytrace the sphere light
@@ -276,7 +639,7 @@ void main(void)
 			if (true) {
 				vec3 wi = u2_to_cap(u2, c);
 				float pdf1;
-				float frp = ggx_evalp(wi, wo, alpha, pdf1);
+				float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, pdf1);
 				float pdf2 = pdf_cap(wi, c);
 
 				if (pdf2 > 0.0) {
@@ -308,14 +671,27 @@ void main(void)
 	float brdfScale; // this won't be used here
 	vec3 pivot = extractPivot(wo, alpha, brdfScale);
 
+#if LIGHT_TREE
+	// select one sphere per sample
+	for (int k = 0; k < u_SamplesPerPass; ++k) {
+		float lightPdf;
+		float u1 = sample4(k).z;
+		int i = lightTreeSample(pos, tg, wo, pivot, u1, lightPdf);
+		if (i < 0) continue;
+		int firstSample = k, sampleCnt = 1;
+#else
 	// iterate over all spheres
-	for (int i = 0; i < SPHERE_COUNT; ++i) {
+	for (int k = lights.x; k < lights.x + lights.y; ++k) {
+		int i = u_LightIds[k];
+		float lightPdf = 1.0;
+		int firstSample = 0, sampleCnt = u_SamplesPerPass;
+#endif
 		if (i_SphereId == i) continue;
-		if (u_Spheres[i].light.a == 0.0) continue;
-		vec3 spherePos = tg * (u_Spheres[i].geometry.xyz - i_Position.xyz);
+		vec3 spherePos = tg * (u_Spheres[i].geometry.xyz - pos);
 		float sphereRadius = u_Spheres[i].geometry.w;
 		sphere s = sphere(spherePos, sphereRadius);
-		vec3 Li = u_Spheres[i].light.rgb;
+		if (dot(s.pos, s.pos) <= s.r * s.r) continue; // overlapping light
+		vec3 Li = u_Spheres[i].light.rgb / lightPdf;
 		float invSphereMagSqr = 1.0 / dot(s.pos, s.pos);
 		vec3 capDir = s.pos * sqrt(invSphereMagSqr);
 		float capCos = sqrt(1.0 - s.r * s.r * invSphereMagSqr);
@@ -324,18 +700,16 @@ void main(void)
 
 		if (c.z < 0.99) {
 			// Joint MIS: loop over all samples
-			for (int j = 0; j < u_SamplesPerPass; ++j) {
+			for (int j = firstSample; j < firstSample + sampleCnt; ++j) {
 				// compute a uniform sample
-				float h1 = hash(gl_FragCoord.xy);
-				float h2 = hash(gl_FragCoord.yx);
-				vec2 u2 = mod(vec2(h1, h2) + rand(j).xy, vec2(1.0));
+				vec2 u2 = sample4(j).xy;
 
 				// importance sample the BRDF
 				if (true) {
-					vec3 wm = ggx_sample(u2, wo, alpha);
+					vec3 wm = ggx_sample(u2, wo, alpha.x, alpha.y);
 					vec3 wi = 2.0 * wm * dot(wo, wm) - wo;
 					float pdf1;
-					float frp = ggx_evalp(wi, wo, alpha, pdf1);
+					float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, pdf1);
 					float raySphereIntersection = pdf_cap(wi, c);
 
 					// raytrace the sphere light
@@ -352,7 +726,7 @@ void main(void)
 				if (true) {
 					vec3 wi = u2_to_pcap(u2, c_std, pivot);
 					float pdf1;
-					float frp = ggx_evalp(wi, wo, alpha, pdf1);
+					float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, pdf1);
 					float pdf2 = pdf_pcap_fast(wi, c_std, pivot);
 
 					if (pdf2 > 0.0) {
@@ -365,18 +739,16 @@ void main(void)
 			}
 		} else {
 			// classic MIS: loop over all samples
-			for (int j = 0; j < u_SamplesPerPass; ++j) {
+			for (int j = firstSample; j < firstSample + sampleCnt; ++j) {
 				// compute a uniform sample
-				float h1 = hash(gl_FragCoord.xy);
-				float h2 = hash(gl_FragCoord.yx);
-				vec2 u2 = mod(vec2(h1, h2) + rand(j).xy, vec2(1.0));
+				vec2 u2 = sample4(j).xy;
 
 				// importance sample the BRDF
 				if (true) {
-					vec3 wm = ggx_sample(u2, wo, alpha);
+					vec3 wm = ggx_sample(u2, wo, alpha.x, alpha.y);
 					vec3 wi = 2.0 * wm * dot(wo, wm) - wo;
 					float pdf1;
-					float frp = ggx_evalp(wi, wo, alpha, pdf1);
+					float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, pdf1);
 					float raySphereIntersection = pdf_cap(wi, c);
 
 					// raytrace the sphere light
@@ -393,7 +765,7 @@ void main(void)
 				if (true) {
 					vec3 wi = u2_to_cap(u2, c);
 					float pdf1;
-					float frp = ggx_evalp(wi, wo, alpha, pdf1);
+					float frp = ggx_evalp(wi, wo, alpha.x, alpha.y, pdf1);
 					float pdf2 = pdf_cap(wi, c);
 
 					if (pdf2 > 0.0) {
@@ -420,6 +792,9 @@ void main(void)
 // -----------------------------------------------------------------------------
 #endif // SHADE
 
+	// moments of the luminance of the pass estimate (see variance.glsl)
+	float Y = dot(o_FragColor.rgb, vec3(0.2126, 0.7152, 0.0722)) / o_FragColor.a;
+	o_FragMoments = vec4(Y, Y * Y, 1, 0);
 }
 #endif // FRAGMENT_SHADER
 
@@ -0,0 +1,84 @@
+// *****************************************************************************
+/**
+ * Uniforms
+ *
+ */
+uniform float u_Threshold;   // relative error target
+uniform int u_MinPassCount;  // passes rendered before estimating the variance
+
+#if MSAA_FACTOR
+uniform sampler2DMS u_MomentSampler;
+#else
+uniform sampler2D   u_MomentSampler;
+#endif
+
+// number of active tiles, followed by the activity flag of each tile
+layout(std430, binding = BUFFER_BINDING_TILES)
+buffer Tiles {
+	uint u_ActiveTileCount;
+	uint u_TileActive[];
+};
+
+// *****************************************************************************
+/**
+ * Compute Shader
+ *
+ * This shader estimates the convergence of each tile of the scene
+ * framebuffer, using the moments of the luminance of the pass estimates
+ * that sphere.glsl accumulates (x: sum; y: sum of squares; z: pass count).
+ * A pixel has converged once the standard error of its mean falls below a
+ * fraction of the mean (clamped to an absolute floor so that dark pixels
+ * converge too); a tile is active as long as one of its pixels has not
+ * converged. Active tiles are counted so that the application knows when
+ * to stop rendering. One work group processes one tile.
+ */
+#ifdef COMPUTE_SHADER
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+shared uint s_Active;
+
+bool converged(vec4 moments)
+{
+	float n = moments.z;
+
+	if (n < float(u_MinPassCount))
+		return false;
+
+	float mean = moments.x / n;
+	float var = max(0.0, moments.y / n - mean * mean);
+	float error = sqrt(var / n);
+
+	return error <= u_Threshold * max(mean, 1e-2);
+}
+
+void main(void)
+{
+	ivec2 P = ivec2(gl_GlobalInvocationID.xy);
+	bool active = false;
+
+	if (gl_LocalInvocationIndex == 0u)
+		s_Active = 0u;
+	barrier();
+
+#if MSAA_FACTOR
+	if (all(lessThan(P, textureSize(u_MomentSampler))))
+		for (int i = 0; i < MSAA_FACTOR; ++i)
+			active = active || !converged(texelFetch(u_MomentSampler, P, i));
+#else
+	if (all(lessThan(P, textureSize(u_MomentSampler, 0))))
+		active = !converged(texelFetch(u_MomentSampler, P, 0));
+#endif
+	if (active)
+		atomicOr(s_Active, 1u);
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0u) {
+		uint tile = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+
+		u_TileActive[tile] = s_Active;
+		if (s_Active != 0u)
+			atomicAdd(u_ActiveTileCount, 1u);
+	}
+}
+#endif // COMPUTE_SHADER
+